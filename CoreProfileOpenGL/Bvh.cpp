@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+#include "Bvh.h"
+
+// Half the surface area of a box, SAH costs are only compared with each other
+static inline float mfHalfArea(const glm::vec3& pMin, const glm::vec3& pMax)
+{
+	glm::vec3 lSize = glm::max(pMax - pMin, glm::vec3(0.0f));
+	return lSize.x * lSize.y + lSize.y * lSize.z + lSize.z * lSize.x;
+}
+
+// Slab test with the reciprocal direction precomputed, only hits closer than pMaxDistance count
+static inline bool mfIntersectRayBoxInv(const glm::vec3& pOrigin, const glm::vec3& pInvDirection, const glm::vec3& pMin, const glm::vec3& pMax,
+										float pMaxDistance, float& pDistance)
+{
+	glm::vec3 lT0 = (pMin - pOrigin) * pInvDirection;
+	glm::vec3 lT1 = (pMax - pOrigin) * pInvDirection;
+	glm::vec3 lNear = glm::min(lT0, lT1);
+	glm::vec3 lFar = glm::max(lT0, lT1);
+
+	pDistance = std::max(std::max(lNear.x, lNear.y), std::max(lNear.z, 0.0f));
+	return pDistance <= std::min(std::min(lFar.x, lFar.y), std::min(lFar.z, pMaxDistance));
+}
+
+bool mfIntersectRayBox(const glm::vec3& pOrigin, const glm::vec3& pDirection, const glm::vec3& pMin, const glm::vec3& pMax, float& pDistance)
+{
+	return mfIntersectRayBoxInv(pOrigin, 1.0f / pDirection, pMin, pMax, FLT_MAX, pDistance);
+}
+
+// The cone against sphere test of LightClusters for a single sphere
+static inline bool mfConeTest(const glm::vec3& pCenter, float pRadius, const glm::vec3& pApex, const glm::vec3& pDirection, float pCos, float pSin, float pRange)
+{
+	glm::vec3 lV = pCenter - pApex;
+	float lAlong = glm::dot(lV, pDirection);
+	float lAcross = std::sqrt(std::max(glm::dot(lV, lV) - lAlong * lAlong, 0.0f));
+	float lDistance = pCos * lAcross - lAlong * pSin;
+	return lDistance <= pRadius && lAlong <= pRange + pRadius && lAlong >= -pRadius;
+}
+
+Bvh::Bvh() : aBuildMs(0.0), aRefitMs(0.0), aRefitCount(0)
+{
+}
+
+Bvh::~Bvh()
+{
+}
+
+void Bvh::mpSetPrimitive(size_t pPosition, const glm::vec3& pMin, const glm::vec3& pMax)
+{
+	this->aPrimMins[pPosition] = pMin;
+	this->aPrimMaxs[pPosition] = pMax;
+
+	glm::vec3 lCenter = (pMin + pMax) * 0.5f;
+	this->aSphereX[pPosition] = lCenter.x;
+	this->aSphereY[pPosition] = lCenter.y;
+	this->aSphereZ[pPosition] = lCenter.z;
+	this->aSphereRadii[pPosition] = glm::length(pMax - pMin) * 0.5f;
+}
+
+void Bvh::mpFitNode(BvhNode& pNode) const
+{
+	if (pNode.aCount == 0)
+	{
+		const BvhNode& lLeft = this->aNodes[pNode.aFirst];
+		const BvhNode& lRight = this->aNodes[pNode.aFirst + 1];
+		pNode.aMin = glm::min(lLeft.aMin, lRight.aMin);
+		pNode.aMax = glm::max(lLeft.aMax, lRight.aMax);
+		return;
+	}
+
+	pNode.aMin = glm::vec3(FLT_MAX);
+	pNode.aMax = glm::vec3(-FLT_MAX);
+	for (uint32_t i = pNode.aFirst; i < pNode.aFirst + pNode.aCount; i++)
+	{
+		pNode.aMin = glm::min(pNode.aMin, this->aPrimMins[i]);
+		pNode.aMax = glm::max(pNode.aMax, this->aPrimMaxs[i]);
+	}
+}
+
+void Bvh::mpBuild(const glm::vec3* pMins, const glm::vec3* pMaxs, size_t pCount)
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	this->aPrimitives.resize(pCount);
+	for (size_t i = 0; i < pCount; i++)
+		this->aPrimitives[i] = (uint32_t)i;
+	this->aLeafOf.assign(pCount, 0);
+	this->aPrimMins.resize(pCount);
+	this->aPrimMaxs.resize(pCount);
+	this->aSphereX.assign(pCount + 3, 0.0f);
+	this->aSphereY.assign(pCount + 3, 0.0f);
+	this->aSphereZ.assign(pCount + 3, 0.0f);
+	this->aSphereRadii.assign(pCount + 3, 0.0f);
+
+	std::vector<glm::vec3> lCentroids(pCount);
+	for (size_t i = 0; i < pCount; i++)
+		lCentroids[i] = (pMins[i] + pMaxs[i]) * 0.5f;
+
+	// Nodes are split in place, each node's primitives are a range of aPrimitives that its children divide. Children
+	// are always appended after their parent, so refitting in reverse order sees them first.
+	this->aNodes.clear();
+	this->aNodes.reserve(pCount * 2);
+	std::vector<uint32_t> lStack;
+	if (pCount > 0)
+	{
+		BvhNode lRoot;
+		lRoot.aFirst = 0;
+		lRoot.aCount = (uint32_t)pCount;
+		this->aNodes.push_back(lRoot);
+		lStack.push_back(0);
+	}
+
+	while (!lStack.empty())
+	{
+		uint32_t lNodeIndex = lStack.back();
+		lStack.pop_back();
+		uint32_t lBegin = this->aNodes[lNodeIndex].aFirst;
+		uint32_t lEnd = lBegin + this->aNodes[lNodeIndex].aCount;
+
+		glm::vec3 lMin(FLT_MAX), lMax(-FLT_MAX), lCentroidMin(FLT_MAX), lCentroidMax(-FLT_MAX);
+		for (uint32_t i = lBegin; i < lEnd; i++)
+		{
+			uint32_t lPrimitive = this->aPrimitives[i];
+			lMin = glm::min(lMin, pMins[lPrimitive]);
+			lMax = glm::max(lMax, pMaxs[lPrimitive]);
+			lCentroidMin = glm::min(lCentroidMin, lCentroids[lPrimitive]);
+			lCentroidMax = glm::max(lCentroidMax, lCentroids[lPrimitive]);
+		}
+		this->aNodes[lNodeIndex].aMin = lMin;
+		this->aNodes[lNodeIndex].aMax = lMax;
+
+		uint32_t lSize = lEnd - lBegin;
+		if (lSize <= MAX_LEAF_SIZE)
+			continue;
+
+		// Bin the centroids along every axis and take the split between bins with the smallest sum of primitive count
+		// times box area on both sides
+		float lBestCost = FLT_MAX;
+		int lBestAxis = -1;
+		unsigned int lBestBin = 0;
+		for (int lAxis = 0; lAxis < 3; lAxis++)
+		{
+			float lExtent = lCentroidMax[lAxis] - lCentroidMin[lAxis];
+			if (lExtent <= 0.0f)
+				continue;
+			float lScale = BIN_COUNT / lExtent;
+
+			unsigned int lBinCounts[BIN_COUNT] = {};
+			glm::vec3 lBinMins[BIN_COUNT], lBinMaxs[BIN_COUNT];
+			for (unsigned int b = 0; b < BIN_COUNT; b++)
+			{
+				lBinMins[b] = glm::vec3(FLT_MAX);
+				lBinMaxs[b] = glm::vec3(-FLT_MAX);
+			}
+			for (uint32_t i = lBegin; i < lEnd; i++)
+			{
+				uint32_t lPrimitive = this->aPrimitives[i];
+				unsigned int lBin = std::min(BIN_COUNT - 1, (unsigned int)((lCentroids[lPrimitive][lAxis] - lCentroidMin[lAxis]) * lScale));
+				lBinCounts[lBin]++;
+				lBinMins[lBin] = glm::min(lBinMins[lBin], pMins[lPrimitive]);
+				lBinMaxs[lBin] = glm::max(lBinMaxs[lBin], pMaxs[lPrimitive]);
+			}
+
+			// lRightCosts[b] is the cost of the bins after b
+			float lRightCosts[BIN_COUNT];
+			glm::vec3 lSideMin(FLT_MAX), lSideMax(-FLT_MAX);
+			unsigned int lSideCount = 0;
+			for (unsigned int b = BIN_COUNT - 1; b > 0; b--)
+			{
+				lSideCount += lBinCounts[b];
+				lSideMin = glm::min(lSideMin, lBinMins[b]);
+				lSideMax = glm::max(lSideMax, lBinMaxs[b]);
+				lRightCosts[b - 1] = lSideCount * mfHalfArea(lSideMin, lSideMax);
+			}
+
+			lSideMin = glm::vec3(FLT_MAX);
+			lSideMax = glm::vec3(-FLT_MAX);
+			lSideCount = 0;
+			for (unsigned int b = 0; b + 1 < BIN_COUNT; b++)
+			{
+				lSideCount += lBinCounts[b];
+				lSideMin = glm::min(lSideMin, lBinMins[b]);
+				lSideMax = glm::max(lSideMax, lBinMaxs[b]);
+				if (lSideCount == 0 || lSideCount == lSize)
+					continue;
+
+				float lCost = lSideCount * mfHalfArea(lSideMin, lSideMax) + lRightCosts[b];
+				if (lCost < lBestCost)
+				{
+					lBestCost = lCost;
+					lBestAxis = lAxis;
+					lBestBin = b;
+				}
+			}
+		}
+
+		// Primitives with identical centroids cannot be binned apart, any half of them is as good as the other
+		uint32_t lMiddle = lBegin + lSize / 2;
+		if (lBestAxis >= 0)
+		{
+			float lMinCoord = lCentroidMin[lBestAxis];
+			float lScale = BIN_COUNT / (lCentroidMax[lBestAxis] - lMinCoord);
+			lMiddle = (uint32_t)(std::partition(this->aPrimitives.begin() + lBegin, this->aPrimitives.begin() + lEnd, [&](uint32_t pPrimitive)
+			{
+				return std::min(BIN_COUNT - 1, (unsigned int)((lCentroids[pPrimitive][lBestAxis] - lMinCoord) * lScale)) <= lBestBin;
+			}) - this->aPrimitives.begin());
+		}
+
+		uint32_t lLeft = (uint32_t)this->aNodes.size();
+		BvhNode lChild;
+		lChild.aFirst = lBegin;
+		lChild.aCount = lMiddle - lBegin;
+		this->aNodes.push_back(lChild);
+		lChild.aFirst = lMiddle;
+		lChild.aCount = lEnd - lMiddle;
+		this->aNodes.push_back(lChild);
+
+		this->aNodes[lNodeIndex].aFirst = lLeft;
+		this->aNodes[lNodeIndex].aCount = 0;
+		lStack.push_back(lLeft + 1);
+		lStack.push_back(lLeft);
+	}
+
+	for (size_t i = 0; i < pCount; i++)
+		this->mpSetPrimitive(i, pMins[this->aPrimitives[i]], pMaxs[this->aPrimitives[i]]);
+	for (size_t n = 0; n < this->aNodes.size(); n++)
+	{
+		const BvhNode& lNode = this->aNodes[n];
+		for (uint32_t i = lNode.aFirst; lNode.aCount > 0 && i < lNode.aFirst + lNode.aCount; i++)
+			this->aLeafOf[this->aPrimitives[i]] = (uint32_t)n;
+	}
+
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aBuildMs = lElapsed.count();
+}
+
+void Bvh::mpRefit(const glm::vec3* pMins, const glm::vec3* pMaxs, const uint8_t* pChanged)
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	this->aDirty.assign(this->aNodes.size(), 0);
+	for (size_t i = 0; i < this->aPrimitives.size(); i++)
+	{
+		uint32_t lPrimitive = this->aPrimitives[i];
+		if (pChanged != nullptr && !pChanged[lPrimitive])
+			continue;
+		this->mpSetPrimitive(i, pMins[lPrimitive], pMaxs[lPrimitive]);
+		this->aDirty[this->aLeafOf[lPrimitive]] = 1;
+	}
+
+	// Children come after their parents, walking backwards refits them first
+	this->aRefitCount = 0;
+	for (size_t n = this->aNodes.size(); n-- > 0; )
+	{
+		BvhNode& lNode = this->aNodes[n];
+		if (lNode.aCount == 0)
+			this->aDirty[n] = this->aDirty[lNode.aFirst] | this->aDirty[lNode.aFirst + 1];
+		if (!this->aDirty[n])
+			continue;
+
+		this->mpFitNode(lNode);
+		this->aRefitCount++;
+	}
+
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aRefitMs = lElapsed.count();
+}
+
+void Bvh::mpQueryFrustum(const Frustum& pFrustum, std::vector<uint32_t>& pResult) const
+{
+	pResult.clear();
+	if (this->aNodes.empty())
+		return;
+
+	// Stack entries are node indices, the top bit marks subtrees already known to be inside
+	const uint32_t lInsideFlag = 0x80000000u;
+	std::vector<uint32_t> lStack(1, 0);
+	while (!lStack.empty())
+	{
+		uint32_t lEntry = lStack.back();
+		lStack.pop_back();
+		const BvhNode& lNode = this->aNodes[lEntry & ~lInsideFlag];
+
+		uint32_t lInside = lEntry & lInsideFlag;
+		if (!lInside)
+		{
+			FrustumTest lTest = pFrustum.mfTestBox(lNode.aMin, lNode.aMax);
+			if (lTest == FRUSTUM_OUTSIDE)
+				continue;
+			if (lTest == FRUSTUM_INSIDE)
+				lInside = lInsideFlag;
+		}
+
+		if (lNode.aCount == 0)
+		{
+			lStack.push_back((lNode.aFirst + 1) | lInside);
+			lStack.push_back(lNode.aFirst | lInside);
+			continue;
+		}
+
+		int lMask = lInside ? 0xF : pFrustum.mfTestSpheres4(&this->aSphereX[lNode.aFirst], &this->aSphereY[lNode.aFirst],
+			&this->aSphereZ[lNode.aFirst], &this->aSphereRadii[lNode.aFirst]);
+		for (uint32_t i = 0; i < lNode.aCount; i++)
+		{
+			if ((lMask >> i) & 1)
+				pResult.push_back(this->aPrimitives[lNode.aFirst + i]);
+		}
+	}
+}
+
+void Bvh::mpQueryCone(const glm::vec3& pApex, const glm::vec3& pDirection, float pCos, float pSin, float pRange, std::vector<uint32_t>& pResult) const
+{
+	pResult.clear();
+	if (this->aNodes.empty())
+		return;
+
+	// Nodes are tested through their bounding spheres
+	std::vector<uint32_t> lStack(1, 0);
+	while (!lStack.empty())
+	{
+		const BvhNode& lNode = this->aNodes[lStack.back()];
+		lStack.pop_back();
+		if (!mfConeTest((lNode.aMin + lNode.aMax) * 0.5f, glm::length(lNode.aMax - lNode.aMin) * 0.5f, pApex, pDirection, pCos, pSin, pRange))
+			continue;
+
+		if (lNode.aCount == 0)
+		{
+			lStack.push_back(lNode.aFirst + 1);
+			lStack.push_back(lNode.aFirst);
+			continue;
+		}
+
+		for (uint32_t i = lNode.aFirst; i < lNode.aFirst + lNode.aCount; i++)
+		{
+			glm::vec3 lCenter(this->aSphereX[i], this->aSphereY[i], this->aSphereZ[i]);
+			if (mfConeTest(lCenter, this->aSphereRadii[i], pApex, pDirection, pCos, pSin, pRange))
+				pResult.push_back(this->aPrimitives[i]);
+		}
+	}
+}
+
+uint32_t Bvh::mfRaycast(const glm::vec3& pOrigin, const glm::vec3& pDirection, float& pDistance) const
+{
+	pDistance = FLT_MAX;
+	uint32_t lHit = BVH_NONE;
+	float lEnter;
+	glm::vec3 lInvDirection = 1.0f / pDirection;
+	if (this->aNodes.empty() || !mfIntersectRayBoxInv(pOrigin, lInvDirection, this->aNodes[0].aMin, this->aNodes[0].aMax, FLT_MAX, lEnter))
+		return BVH_NONE;
+
+	// Nearer children are visited first, nodes entered past the closest hit so far are skipped
+	std::vector<std::pair<float, uint32_t> > lStack(1, std::make_pair(lEnter, 0u));
+	while (!lStack.empty())
+	{
+		std::pair<float, uint32_t> lEntry = lStack.back();
+		lStack.pop_back();
+		if (lEntry.first > pDistance)
+			continue;
+
+		const BvhNode& lNode = this->aNodes[lEntry.second];
+		if (lNode.aCount > 0)
+		{
+			for (uint32_t i = lNode.aFirst; i < lNode.aFirst + lNode.aCount; i++)
+			{
+				if (mfIntersectRayBoxInv(pOrigin, lInvDirection, this->aPrimMins[i], this->aPrimMaxs[i], pDistance, lEnter) && lEnter < pDistance)
+				{
+					pDistance = lEnter;
+					lHit = this->aPrimitives[i];
+				}
+			}
+			continue;
+		}
+
+		float lLeftEnter, lRightEnter;
+		bool lLeftHit = mfIntersectRayBoxInv(pOrigin, lInvDirection, this->aNodes[lNode.aFirst].aMin, this->aNodes[lNode.aFirst].aMax, pDistance, lLeftEnter);
+		bool lRightHit = mfIntersectRayBoxInv(pOrigin, lInvDirection, this->aNodes[lNode.aFirst + 1].aMin, this->aNodes[lNode.aFirst + 1].aMax, pDistance, lRightEnter);
+		if (lLeftHit && lRightHit && lLeftEnter < lRightEnter)
+		{
+			lStack.push_back(std::make_pair(lRightEnter, lNode.aFirst + 1));
+			lStack.push_back(std::make_pair(lLeftEnter, lNode.aFirst));
+			continue;
+		}
+		if (lLeftHit)
+			lStack.push_back(std::make_pair(lLeftEnter, lNode.aFirst));
+		if (lRightHit)
+			lStack.push_back(std::make_pair(lRightEnter, lNode.aFirst + 1));
+	}
+	return lHit;
+}
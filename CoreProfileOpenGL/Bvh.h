@@ -0,0 +1,91 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <vector>
+
+// GL Includes
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+// Returned by ray queries that hit nothing
+const uint32_t BVH_NONE = 0xFFFFFFFFu;
+
+// Inner nodes have aCount 0 and their children at aFirst and aFirst + 1, leaves hold the aCount primitives from
+// position aFirst on in the leaf order
+struct BvhNode
+{
+	glm::vec3 aMin;
+	uint32_t aFirst;
+	glm::vec3 aMax;
+	uint32_t aCount;
+};
+
+// Ray against axis aligned box, the slab test missing from glm/gtx/intersect.hpp. pDistance receives the distance
+// along pDirection to the entry point, 0 when the origin is inside.
+bool mfIntersectRayBox(const glm::vec3& pOrigin, const glm::vec3& pDirection, const glm::vec3& pMin, const glm::vec3& pMax, float& pDistance);
+
+// Bounding volume hierarchy over axis aligned boxes, built top down with the surface area heuristic over binned
+// centroids. Primitives that move are handled by refitting the bounds of the nodes above them while the tree stays
+// as built, which suits scenes where most objects are static or move little; rebuild when they moved far.
+// Primitives are identified by their index in the box arrays given to mpBuild.
+class Bvh
+{
+public:
+	// Time of the last mpBuild and mpRefit, and the nodes the refit recomputed
+	double aBuildMs;
+	double aRefitMs;
+	unsigned int aRefitCount;
+
+	Bvh();
+	~Bvh();
+
+	void mpBuild(const glm::vec3* pMins, const glm::vec3* pMaxs, size_t pCount);
+
+	// Takes the boxes of the primitives with a nonzero pChanged entry, of all of them when pChanged is null, and
+	// recomputes the nodes above those
+	void mpRefit(const glm::vec3* pMins, const glm::vec3* pMaxs, const uint8_t* pChanged);
+
+	// The queries replace pResult with the primitives found, in tree order
+
+	// Primitives whose box is at least partly inside the frustum. Subtrees fully inside are taken without testing,
+	// leaves that straddle a plane test the bounding spheres of their primitives at once.
+	void mpQueryFrustum(const Frustum& pFrustum, std::vector<uint32_t>& pResult) const;
+
+	// Primitives that may be lit by a spotlight at pApex shining along the unit vector pDirection, with the cosine and
+	// sine of its outer cone angle and its range
+	void mpQueryCone(const glm::vec3& pApex, const glm::vec3& pDirection, float pCos, float pSin, float pRange, std::vector<uint32_t>& pResult) const;
+
+	// Nearest primitive whose box the ray hits, BVH_NONE when there is none. pDistance receives the distance along
+	// pDirection.
+	uint32_t mfRaycast(const glm::vec3& pOrigin, const glm::vec3& pDirection, float& pDistance) const;
+
+	size_t mfSize() const { return this->aLeafOf.size(); }
+	size_t mfNodeCount() const { return this->aNodes.size(); }
+
+private:
+	static const unsigned int BIN_COUNT = 16;
+	// Leaves hold up to four primitives so their spheres are tested with one Frustum::mfTestSpheres4
+	static const unsigned int MAX_LEAF_SIZE = 4;
+
+	std::vector<BvhNode> aNodes;
+
+	// Primitive indices in leaf order, and their boxes and bounding spheres in the same order. The sphere arrays have
+	// three floats of padding so the last leaf can be read four at a time.
+	std::vector<uint32_t> aPrimitives;
+	std::vector<glm::vec3> aPrimMins;
+	std::vector<glm::vec3> aPrimMaxs;
+	std::vector<float> aSphereX;
+	std::vector<float> aSphereY;
+	std::vector<float> aSphereZ;
+	std::vector<float> aSphereRadii;
+
+	// Leaf of every primitive, by primitive index
+	std::vector<uint32_t> aLeafOf;
+	// Nodes touched by the current refit
+	std::vector<uint8_t> aDirty;
+
+	void mpSetPrimitive(size_t pPosition, const glm::vec3& pMin, const glm::vec3& pMax);
+	void mpFitNode(BvhNode& pNode) const;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+// Std. Includes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+
+// Timings of a single frame in milliseconds.
+// aCpuMs covers building and submitting the frame, aFrameMs additionally waits for the GL to finish it.
+// aGpuMs stays negative until its query result has been read back.
+struct FrameTiming
+{
+	unsigned int aFrame;
+	double aCpuMs;
+	double aFrameMs;
+	double aGpuMs;
+};
+
+// Number of GL_TIME_ELAPSED queries in flight. Results are read QUERY_RING frames later so the CPU never waits on the GPU.
+const int QUERY_RING = 4;
+
+// Measures the CPU time spent building each frame and the GPU time spent executing it
+class FrameProfiler
+{
+public:
+	std::vector<FrameTiming> aTimings;
+
+	~FrameProfiler() {}
+
+	FrameProfiler() : aInitialized(false), aFrame(0)
+	{
+		for (int i = 0; i < QUERY_RING; i++)
+			this->aPendingTiming[i] = -1;
+	}
+
+	// Needs a current GL context
+	void mpInit(unsigned int pExpectedFrames)
+	{
+		glGenQueries(QUERY_RING, this->aQueries);
+		this->aTimings.reserve(pExpectedFrames);
+		this->aInitialized = true;
+	}
+
+	// Needs the context that was current in mpInit
+	void mpDestroy()
+	{
+		if (this->aInitialized)
+			glDeleteQueries(QUERY_RING, this->aQueries);
+		this->aInitialized = false;
+	}
+
+	void mpBeginFrame()
+	{
+		int lSlot = this->aFrame % QUERY_RING;
+
+		// The query in this slot was issued QUERY_RING frames ago, collect it before reusing it
+		if (this->aPendingTiming[lSlot] >= 0)
+			this->mpResolve(lSlot);
+
+		this->aCpuStart = std::chrono::high_resolution_clock::now();
+		glBeginQuery(GL_TIME_ELAPSED, this->aQueries[lSlot]);
+	}
+
+	// Ends the frame and waits for it to complete. Software rasterizers such as llvmpipe only execute
+	// the frame on flush, so aFrameMs is the number to compare there; GL_TIME_ELAPSED is mostly meaningful on hardware.
+	void mpEndFrame()
+	{
+		int lSlot = this->aFrame % QUERY_RING;
+
+		glEndQuery(GL_TIME_ELAPSED);
+		std::chrono::duration<double, std::milli> lCpuTime = std::chrono::high_resolution_clock::now() - this->aCpuStart;
+
+		glFinish();
+		std::chrono::duration<double, std::milli> lFrameTime = std::chrono::high_resolution_clock::now() - this->aCpuStart;
+
+		FrameTiming lTiming = { this->aFrame, lCpuTime.count(), lFrameTime.count(), -1.0 };
+		this->aTimings.push_back(lTiming);
+		this->aPendingTiming[lSlot] = (int)this->aTimings.size() - 1;
+		this->aFrame++;
+	}
+
+	// Blocks until every outstanding GPU timing is available
+	void mpFinish()
+	{
+		for (int i = 0; i < QUERY_RING; i++)
+		{
+			int lSlot = (this->aFrame + i) % QUERY_RING;
+			if (this->aPendingTiming[lSlot] >= 0)
+				this->mpResolve(lSlot);
+		}
+	}
+
+	bool mfWriteCsv(const char* pPath)
+	{
+		std::ofstream lFile(pPath);
+		if (!lFile.is_open())
+			return false;
+
+		lFile << std::fixed << std::setprecision(4) << "frame,cpu_ms,frame_ms,gpu_ms\n";
+		for (size_t i = 0; i < this->aTimings.size(); i++)
+			lFile << this->aTimings[i].aFrame << "," << this->aTimings[i].aCpuMs << "," << this->aTimings[i].aFrameMs << "," << this->aTimings[i].aGpuMs << "\n";
+
+		lFile.close();
+		return !lFile.fail();
+	}
+
+	bool mfWriteJson(const char* pPath)
+	{
+		std::ofstream lFile(pPath);
+		if (!lFile.is_open())
+			return false;
+
+		lFile << std::fixed << std::setprecision(4);
+		lFile << "{\n  \"vendor\": \"" << (const char*)glGetString(GL_VENDOR) << "\",\n  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER)
+			<< "\",\n  \"version\": \"" << (const char*)glGetString(GL_VERSION) << "\",\n";
+		lFile << "  \"frames\": [\n";
+		for (size_t i = 0; i < this->aTimings.size(); i++)
+		{
+			lFile << "    { \"frame\": " << this->aTimings[i].aFrame << ", \"cpu_ms\": " << this->aTimings[i].aCpuMs << ", \"frame_ms\": " << this->aTimings[i].aFrameMs
+				<< ", \"gpu_ms\": " << this->aTimings[i].aGpuMs << " }" << (i + 1 < this->aTimings.size() ? "," : "") << "\n";
+		}
+		lFile << "  ]\n}\n";
+
+		lFile.close();
+		return !lFile.fail();
+	}
+
+	// Prints average, median and worst times. The first frame pays for shader and driver warm-up and is left out.
+	void mpPrintSummary()
+	{
+		if (this->aTimings.size() < 2)
+			return;
+
+		std::vector<double> lCpu, lFrame, lGpu;
+		for (size_t i = 1; i < this->aTimings.size(); i++)
+		{
+			lCpu.push_back(this->aTimings[i].aCpuMs);
+			lFrame.push_back(this->aTimings[i].aFrameMs);
+			lGpu.push_back(this->aTimings[i].aGpuMs);
+		}
+
+		printf("Frames: %u\n", (unsigned int)this->aTimings.size());
+		mpPrintSeries("CPU  ", lCpu);
+		mpPrintSeries("Frame", lFrame);
+		mpPrintSeries("GPU  ", lGpu);
+	}
+
+private:
+	bool aInitialized;
+	unsigned int aFrame;
+	GLuint aQueries[QUERY_RING];
+	int aPendingTiming[QUERY_RING];
+	std::chrono::high_resolution_clock::time_point aCpuStart;
+
+	void mpResolve(int pSlot)
+	{
+		GLuint64 lElapsedNs = 0;
+		glGetQueryObjectui64v(this->aQueries[pSlot], GL_QUERY_RESULT, &lElapsedNs);
+		this->aTimings[this->aPendingTiming[pSlot]].aGpuMs = lElapsedNs / 1000000.0;
+		this->aPendingTiming[pSlot] = -1;
+	}
+
+	static void mpPrintSeries(const char* pName, std::vector<double>& pValues)
+	{
+		double lSum = 0.0;
+		for (size_t i = 0; i < pValues.size(); i++)
+			lSum += pValues[i];
+
+		std::sort(pValues.begin(), pValues.end());
+		printf("%s ms: avg %.3f  median %.3f  p95 %.3f  max %.3f\n", pName,
+			lSum / pValues.size(),
+			pValues[pValues.size() / 2],
+			pValues[(pValues.size() * 95) / 100],
+			pValues.back());
+	}
+};
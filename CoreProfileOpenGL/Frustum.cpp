@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_USE_SSE2
+#endif
+
+#include "Frustum.h"
+#include "ParallelFor.h"
+
+Frustum::Frustum() : aTestedCount(0), aVisibleCount(0), aCullMs(0.0)
+{
+	for (int i = 0; i < 6; i++)
+		this->aPlanes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::~Frustum()
+{
+}
+
+void Frustum::mpSetMatrix(const glm::mat4& pViewProjection)
+{
+	// Gribb and Hartmann: a clip space point is inside when -w <= x, y, z <= w, so every plane is the last row of the
+	// matrix plus or minus one of the others. glm matrices are indexed [column][row].
+	glm::vec4 lRows[4];
+	for (int r = 0; r < 4; r++)
+		lRows[r] = glm::vec4(pViewProjection[0][r], pViewProjection[1][r], pViewProjection[2][r], pViewProjection[3][r]);
+
+	for (int i = 0; i < 3; i++)
+	{
+		this->aPlanes[i * 2] = lRows[3] + lRows[i];
+		this->aPlanes[i * 2 + 1] = lRows[3] - lRows[i];
+	}
+	for (int i = 0; i < 6; i++)
+		this->aPlanes[i] /= glm::length(glm::vec3(this->aPlanes[i]));
+}
+
+bool Frustum::mfIsSphereVisible(const glm::vec3& pCenter, float pRadius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(this->aPlanes[i]), pCenter) + this->aPlanes[i].w < -pRadius)
+			return false;
+	}
+	return true;
+}
+
+int Frustum::mfTestSpheres4(const float* pX, const float* pY, const float* pZ, const float* pRadius) const
+{
+	const glm::vec4* lPlanes = this->aPlanes;
+#ifdef FRUSTUM_USE_SSE2
+	__m128 lX = _mm_loadu_ps(pX);
+	__m128 lY = _mm_loadu_ps(pY);
+	__m128 lZ = _mm_loadu_ps(pZ);
+	__m128 lNegRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(pRadius));
+
+	__m128 lInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (int i = 0; i < 6; i++)
+	{
+		__m128 lDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lX, _mm_set1_ps(lPlanes[i].x)), _mm_mul_ps(lY, _mm_set1_ps(lPlanes[i].y))),
+			_mm_add_ps(_mm_mul_ps(lZ, _mm_set1_ps(lPlanes[i].z)), _mm_set1_ps(lPlanes[i].w)));
+		lInside = _mm_and_ps(lInside, _mm_cmpge_ps(lDistance, lNegRadius));
+	}
+	return _mm_movemask_ps(lInside);
+#else
+	int lMask = 0;
+	for (int j = 0; j < 4; j++)
+	{
+		bool lInside = true;
+		for (int i = 0; i < 6 && lInside; i++)
+			lInside = lPlanes[i].x * pX[j] + lPlanes[i].y * pY[j] + lPlanes[i].z * pZ[j] + lPlanes[i].w >= -pRadius[j];
+		if (lInside)
+			lMask |= 1 << j;
+	}
+	return lMask;
+#endif
+}
+
+FrustumTest Frustum::mfTestBox(const glm::vec3& pMin, const glm::vec3& pMax) const
+{
+	// Per plane, the box corner furthest along the normal decides whether the box is outside, the nearest one whether
+	// it is fully inside
+	FrustumTest lResult = FRUSTUM_INSIDE;
+	for (int i = 0; i < 6; i++)
+	{
+		glm::vec3 lNormal = glm::vec3(this->aPlanes[i]);
+		glm::vec3 lPositive = glm::vec3(glm::greaterThanEqual(lNormal, glm::vec3(0.0f)));
+		glm::vec3 lFar = glm::mix(pMin, pMax, lPositive);
+		glm::vec3 lNear = glm::mix(pMax, pMin, lPositive);
+		if (glm::dot(lNormal, lFar) + this->aPlanes[i].w < 0.0f)
+			return FRUSTUM_OUTSIDE;
+		if (glm::dot(lNormal, lNear) + this->aPlanes[i].w < 0.0f)
+			lResult = FRUSTUM_INTERSECTS;
+	}
+	return lResult;
+}
+
+void Frustum::mpCullSpheres(const SphereArrays& pSpheres, size_t pCount, std::vector<uint32_t>& pVisible, unsigned int pThreadCount)
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	// Room for every sphere up front. Each range writes its visible spheres from its own start on, the ranges are
+	// moved together afterwards.
+	pVisible.resize(pCount);
+	uint32_t* lOut = pVisible.empty() ? nullptr : &pVisible[0];
+
+	unsigned int lRangeCount = (unsigned int)std::max<size_t>(1, std::min<size_t>(pThreadCount, pCount / MIN_SPHERES_PER_THREAD));
+	std::vector<size_t> lBounds(lRangeCount + 1, pCount);
+	std::vector<size_t> lVisibleCounts(lRangeCount, 0);
+	for (unsigned int r = 0; r < lRangeCount; r++)
+		lBounds[r] = (pCount * r / lRangeCount) & ~(size_t)3;
+	mpParallelFor(lRangeCount, lRangeCount, [&](unsigned int pBegin, unsigned int pEnd)
+	{
+		for (unsigned int r = pBegin; r < pEnd; r++)
+			lVisibleCounts[r] = this->mfCullRange(pSpheres, lBounds[r], lBounds[r + 1], lOut + lBounds[r]);
+	});
+
+	size_t lVisible = lVisibleCounts[0];
+	for (unsigned int r = 1; r < lRangeCount; r++)
+	{
+		std::copy(lOut + lBounds[r], lOut + lBounds[r] + lVisibleCounts[r], lOut + lVisible);
+		lVisible += lVisibleCounts[r];
+	}
+	pVisible.resize(lVisible);
+
+	this->aTestedCount = (unsigned int)pCount;
+	this->aVisibleCount = (unsigned int)lVisible;
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aCullMs = lElapsed.count();
+}
+
+size_t Frustum::mfCullRange(const SphereArrays& pSpheres, size_t pBegin, size_t pEnd, uint32_t* pOut) const
+{
+	size_t lVisible = 0;
+	size_t i = pBegin;
+	for (; i + 4 <= pEnd; i += 4)
+	{
+		int lMask = this->mfTestSpheres4(pSpheres.aX + i, pSpheres.aY + i, pSpheres.aZ + i, pSpheres.aRadius + i);
+		for (int j = 0; j < 4; j++)
+		{
+			pOut[lVisible] = (uint32_t)(i + j);
+			lVisible += (lMask >> j) & 1;
+		}
+	}
+	for (; i < pEnd; i++)
+	{
+		if (this->mfIsSphereVisible(glm::vec3(pSpheres.aX[i], pSpheres.aY[i], pSpheres.aZ[i]), pSpheres.aRadius[i]))
+			pOut[lVisible++] = (uint32_t)i;
+	}
+	return lVisible;
+}
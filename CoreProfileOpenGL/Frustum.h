@@ -0,0 +1,66 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <vector>
+
+// GL Includes
+#include <glm/glm.hpp>
+
+// Bounding spheres as separate coordinate arrays, sphere i is (aX[i], aY[i], aZ[i]) with radius aRadius[i]
+struct SphereArrays
+{
+	const float* aX;
+	const float* aY;
+	const float* aZ;
+	const float* aRadius;
+};
+
+// Result of testing a volume against the frustum
+enum FrustumTest
+{
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE
+};
+
+// View frustum as six world space planes, extracted from a view projection matrix. Spheres are tested four at a time
+// against all planes with SSE2, objects whose sphere lies fully outside one plane are culled. Boxes are tested one at a
+// time, for culling whole subtrees of a Bvh.
+class Frustum
+{
+public:
+	// Spheres tested and found visible by the last mpCullSpheres and the time it took
+	unsigned int aTestedCount;
+	unsigned int aVisibleCount;
+	double aCullMs;
+
+	Frustum();
+	~Frustum();
+
+	// pViewProjection is projection * view, the planes then hold in world space
+	void mpSetMatrix(const glm::mat4& pViewProjection);
+
+	bool mfIsSphereVisible(const glm::vec3& pCenter, float pRadius) const;
+
+	// Bit i of the result is set when sphere i of the four starting at the pointers is at least partly inside
+	int mfTestSpheres4(const float* pX, const float* pY, const float* pZ, const float* pRadius) const;
+
+	// Conservative, a box near a frustum corner may be reported as intersecting although it lies outside
+	FrustumTest mfTestBox(const glm::vec3& pMin, const glm::vec3& pMax) const;
+
+	// Replaces pVisible with the indices of the spheres among the first pCount that are at least partly inside, in
+	// increasing order. Large counts are split over up to pThreadCount jobs.
+	void mpCullSpheres(const SphereArrays& pSpheres, size_t pCount, std::vector<uint32_t>& pVisible, unsigned int pThreadCount = 1);
+
+private:
+	// Fewest spheres per job for a parallel cull
+	static const unsigned int MIN_SPHERES_PER_THREAD = 16384;
+
+	// Left, right, bottom, top, near, far. A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0, the
+	// normals have unit length so the same sum is the signed distance.
+	glm::vec4 aPlanes[6];
+
+	// Writes the visible spheres of [pBegin, pEnd) to pOut and returns their count
+	size_t mfCullRange(const SphereArrays& pSpheres, size_t pBegin, size_t pEnd, uint32_t* pOut) const;
+};
@@ -0,0 +1,258 @@
+#include <cstring>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLStateCache.h"
+
+GLStateCache gGLState;
+
+// Stands for state the cache has not seen being set, never matches a real name
+static const GLuint UNKNOWN_NAME = 0xFFFFFFFFu;
+
+GLStateCache::GLStateCache()
+{
+	this->mpInvalidate();
+	this->mpResetCounters();
+}
+
+GLStateCache::~GLStateCache()
+{
+}
+
+void GLStateCache::mpInvalidate()
+{
+	this->aProgram = UNKNOWN_NAME;
+	this->aVertexArray = UNKNOWN_NAME;
+	this->aArrayBuffer = UNKNOWN_NAME;
+	this->aUniformBuffer = UNKNOWN_NAME;
+	this->aTextureBuffer = UNKNOWN_NAME;
+	for (GLuint i = 0; i < STATE_UNIFORM_BINDINGS; i++)
+		this->aUniformBindings[i].aBuffer = UNKNOWN_NAME;
+	this->aActiveUnit = UNKNOWN_NAME;
+	for (GLuint i = 0; i < STATE_TEXTURE_UNITS; i++)
+		this->aTextures2D[i] = this->aBufferTextures[i] = UNKNOWN_NAME;
+
+	this->aUniforms.clear();
+	this->aProgramUniforms = nullptr;
+}
+
+void GLStateCache::mpResetCounters()
+{
+	for (int i = 0; i < GL_STATE_CALL_COUNT; i++)
+		this->aIssued[i] = this->aElided[i] = 0;
+}
+
+bool GLStateCache::mfCount(GLStateCall pCall, bool pChanged)
+{
+	if (pChanged)
+		this->aIssued[pCall]++;
+	else
+		this->aElided[pCall]++;
+	return pChanged;
+}
+
+void GLStateCache::mpUseProgram(GLuint pProgram)
+{
+	if (!this->mfCount(GL_STATE_PROGRAM, this->aProgram != pProgram))
+		return;
+
+	glUseProgram(pProgram);
+	this->aProgram = pProgram;
+	this->aProgramUniforms = &this->aUniforms[pProgram];
+}
+
+void GLStateCache::mpBindVertexArray(GLuint pVertexArray)
+{
+	if (!this->mfCount(GL_STATE_VERTEX_ARRAY, this->aVertexArray != pVertexArray))
+		return;
+
+	glBindVertexArray(pVertexArray);
+	this->aVertexArray = pVertexArray;
+}
+
+GLuint* GLStateCache::mfGetBufferBinding(GLenum pTarget)
+{
+	switch (pTarget)
+	{
+	case GL_ARRAY_BUFFER:	return &this->aArrayBuffer;
+	case GL_UNIFORM_BUFFER:	return &this->aUniformBuffer;
+	case GL_TEXTURE_BUFFER:	return &this->aTextureBuffer;
+	default:				return nullptr;
+	}
+}
+
+void GLStateCache::mpBindBuffer(GLenum pTarget, GLuint pBuffer)
+{
+	GLuint* lBinding = this->mfGetBufferBinding(pTarget);
+	if (!this->mfCount(GL_STATE_BUFFER, lBinding == nullptr || *lBinding != pBuffer))
+		return;
+
+	glBindBuffer(pTarget, pBuffer);
+	if (lBinding != nullptr)
+		*lBinding = pBuffer;
+}
+
+void GLStateCache::mpBindBufferBase(GLenum pTarget, GLuint pIndex, GLuint pBuffer)
+{
+	bool lShadowed = pTarget == GL_UNIFORM_BUFFER && pIndex < STATE_UNIFORM_BINDINGS;
+	BufferRange* lRange = lShadowed ? &this->aUniformBindings[pIndex] : nullptr;
+	if (!this->mfCount(GL_STATE_BUFFER, lRange == nullptr || lRange->aBuffer != pBuffer || lRange->aSize != 0))
+		return;
+
+	// Also changes the generic binding of the target
+	glBindBufferBase(pTarget, pIndex, pBuffer);
+	if (lRange != nullptr)
+	{
+		lRange->aBuffer = pBuffer;
+		lRange->aOffset = lRange->aSize = 0;
+	}
+	GLuint* lBinding = this->mfGetBufferBinding(pTarget);
+	if (lBinding != nullptr)
+		*lBinding = pBuffer;
+}
+
+void GLStateCache::mpBindBufferRange(GLenum pTarget, GLuint pIndex, GLuint pBuffer, GLintptr pOffset, GLsizeiptr pSize)
+{
+	bool lShadowed = pTarget == GL_UNIFORM_BUFFER && pIndex < STATE_UNIFORM_BINDINGS;
+	BufferRange* lRange = lShadowed ? &this->aUniformBindings[pIndex] : nullptr;
+	if (!this->mfCount(GL_STATE_BUFFER, lRange == nullptr || lRange->aBuffer != pBuffer || lRange->aOffset != pOffset || lRange->aSize != pSize))
+		return;
+
+	glBindBufferRange(pTarget, pIndex, pBuffer, pOffset, pSize);
+	if (lRange != nullptr)
+	{
+		lRange->aBuffer = pBuffer;
+		lRange->aOffset = pOffset;
+		lRange->aSize = pSize;
+	}
+	GLuint* lBinding = this->mfGetBufferBinding(pTarget);
+	if (lBinding != nullptr)
+		*lBinding = pBuffer;
+}
+
+void GLStateCache::mpBindTexture(GLuint pUnit, GLenum pTarget, GLuint pTexture)
+{
+	GLuint* lBinding = nullptr;
+	if (pUnit < STATE_TEXTURE_UNITS)
+	{
+		if (pTarget == GL_TEXTURE_2D)
+			lBinding = &this->aTextures2D[pUnit];
+		else if (pTarget == GL_TEXTURE_BUFFER)
+			lBinding = &this->aBufferTextures[pUnit];
+	}
+	if (!this->mfCount(GL_STATE_TEXTURE, lBinding == nullptr || *lBinding != pTexture))
+		return;
+
+	if (this->aActiveUnit != pUnit)
+	{
+		glActiveTexture(GL_TEXTURE0 + pUnit);
+		this->aActiveUnit = pUnit;
+		this->aIssued[GL_STATE_TEXTURE]++;
+	}
+	glBindTexture(pTarget, pTexture);
+	if (lBinding != nullptr)
+		*lBinding = pTexture;
+}
+
+bool GLStateCache::mfUniformChanged(GLint pLocation, const void* pValue, GLuint pSize)
+{
+	// Setting location -1 is a no-op in the GL as well
+	if (pLocation < 0)
+		return this->mfCount(GL_STATE_UNIFORM, false);
+	if (this->aProgramUniforms == nullptr)
+		return this->mfCount(GL_STATE_UNIFORM, true);
+
+	std::vector<UniformValue>& lValues = *this->aProgramUniforms;
+	if ((size_t)pLocation >= lValues.size())
+	{
+		UniformValue lUnset;
+		lUnset.aSize = 0;
+		lValues.resize(pLocation + 1, lUnset);
+	}
+
+	UniformValue& lValue = lValues[pLocation];
+	if (lValue.aSize == pSize && memcmp(lValue.aBytes, pValue, pSize) == 0)
+		return this->mfCount(GL_STATE_UNIFORM, false);
+
+	lValue.aSize = pSize;
+	memcpy(lValue.aBytes, pValue, pSize);
+	return this->mfCount(GL_STATE_UNIFORM, true);
+}
+
+void GLStateCache::mpSetUniform(GLint pLocation, GLint pValue)
+{
+	if (this->mfUniformChanged(pLocation, &pValue, sizeof(pValue)))
+		glUniform1i(pLocation, pValue);
+}
+
+void GLStateCache::mpSetUniform(GLint pLocation, GLfloat pValue)
+{
+	if (this->mfUniformChanged(pLocation, &pValue, sizeof(pValue)))
+		glUniform1f(pLocation, pValue);
+}
+
+void GLStateCache::mpSetUniform(GLint pLocation, const glm::vec2& pValue)
+{
+	if (this->mfUniformChanged(pLocation, glm::value_ptr(pValue), sizeof(pValue)))
+		glUniform2fv(pLocation, 1, glm::value_ptr(pValue));
+}
+
+void GLStateCache::mpSetUniform(GLint pLocation, const glm::vec3& pValue)
+{
+	if (this->mfUniformChanged(pLocation, glm::value_ptr(pValue), sizeof(pValue)))
+		glUniform3fv(pLocation, 1, glm::value_ptr(pValue));
+}
+
+void GLStateCache::mpSetUniform(GLint pLocation, const glm::mat3& pValue)
+{
+	if (this->mfUniformChanged(pLocation, glm::value_ptr(pValue), sizeof(pValue)))
+		glUniformMatrix3fv(pLocation, 1, GL_FALSE, glm::value_ptr(pValue));
+}
+
+void GLStateCache::mpSetUniform(GLint pLocation, const glm::mat4& pValue)
+{
+	if (this->mfUniformChanged(pLocation, glm::value_ptr(pValue), sizeof(pValue)))
+		glUniformMatrix4fv(pLocation, 1, GL_FALSE, glm::value_ptr(pValue));
+}
+
+void GLStateCache::mpForgetProgram(GLuint pProgram)
+{
+	if (this->aProgram == pProgram)
+	{
+		this->aProgram = UNKNOWN_NAME;
+		this->aProgramUniforms = nullptr;
+	}
+	this->aUniforms.erase(pProgram);
+}
+
+void GLStateCache::mpForgetVertexArray(GLuint pVertexArray)
+{
+	if (this->aVertexArray == pVertexArray)
+		this->aVertexArray = UNKNOWN_NAME;
+}
+
+void GLStateCache::mpForgetBuffer(GLuint pBuffer)
+{
+	if (this->aArrayBuffer == pBuffer)
+		this->aArrayBuffer = UNKNOWN_NAME;
+	if (this->aUniformBuffer == pBuffer)
+		this->aUniformBuffer = UNKNOWN_NAME;
+	if (this->aTextureBuffer == pBuffer)
+		this->aTextureBuffer = UNKNOWN_NAME;
+	for (GLuint i = 0; i < STATE_UNIFORM_BINDINGS; i++)
+	{
+		if (this->aUniformBindings[i].aBuffer == pBuffer)
+			this->aUniformBindings[i].aBuffer = UNKNOWN_NAME;
+	}
+}
+
+void GLStateCache::mpForgetTexture(GLuint pTexture)
+{
+	for (GLuint i = 0; i < STATE_TEXTURE_UNITS; i++)
+	{
+		if (this->aTextures2D[i] == pTexture)
+			this->aTextures2D[i] = UNKNOWN_NAME;
+		if (this->aBufferTextures[i] == pTexture)
+			this->aBufferTextures[i] = UNKNOWN_NAME;
+	}
+}
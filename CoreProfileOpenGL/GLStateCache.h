@@ -0,0 +1,102 @@
+#pragma once
+
+// Std. Includes
+#include <unordered_map>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Kinds of calls going through the cache, for the per frame counters
+enum GLStateCall
+{
+	GL_STATE_PROGRAM,
+	GL_STATE_VERTEX_ARRAY,
+	GL_STATE_BUFFER,
+	GL_STATE_TEXTURE,
+	GL_STATE_UNIFORM,
+	GL_STATE_CALL_COUNT
+};
+
+// Binding points and texture units whose contents are shadowed, calls beyond them always reach the GL
+const GLuint STATE_UNIFORM_BINDINGS = 16;
+const GLuint STATE_TEXTURE_UNITS = 16;
+
+// Shadows the bound program, vertex array, buffers, textures and the uniform values of every program, and drops calls
+// that would not change anything. All binds and uniform updates of the renderer go through gGLState; GL calls made
+// around it must be followed by mpInvalidate. Deleted objects have to be forgotten before their names are reused.
+// The element array binding belongs to the vertex array and is not shadowed.
+class GLStateCache
+{
+public:
+	// Calls sent to the GL and calls dropped since the last mpResetCounters, per GLStateCall
+	unsigned int aIssued[GL_STATE_CALL_COUNT];
+	unsigned int aElided[GL_STATE_CALL_COUNT];
+
+	GLStateCache();
+	~GLStateCache();
+
+	// Forgets everything, the next call of each kind is sent
+	void mpInvalidate();
+	void mpResetCounters();
+
+	void mpUseProgram(GLuint pProgram);
+	void mpBindVertexArray(GLuint pVertexArray);
+	// GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER and GL_TEXTURE_BUFFER are shadowed
+	void mpBindBuffer(GLenum pTarget, GLuint pBuffer);
+	// Indexed GL_UNIFORM_BUFFER bindings
+	void mpBindBufferBase(GLenum pTarget, GLuint pIndex, GLuint pBuffer);
+	void mpBindBufferRange(GLenum pTarget, GLuint pIndex, GLuint pBuffer, GLintptr pOffset, GLsizeiptr pSize);
+	// Selects the unit only when the texture bound there changes. GL_TEXTURE_2D and GL_TEXTURE_BUFFER are shadowed.
+	void mpBindTexture(GLuint pUnit, GLenum pTarget, GLuint pTexture);
+
+	// Uniforms of the program bound with mpUseProgram. Values are remembered per program, so switching programs keeps them.
+	void mpSetUniform(GLint pLocation, GLint pValue);
+	void mpSetUniform(GLint pLocation, GLfloat pValue);
+	void mpSetUniform(GLint pLocation, const glm::vec2& pValue);
+	void mpSetUniform(GLint pLocation, const glm::vec3& pValue);
+	void mpSetUniform(GLint pLocation, const glm::mat3& pValue);
+	void mpSetUniform(GLint pLocation, const glm::mat4& pValue);
+
+	// Call before deleting the object (or when a program name now stands for another program)
+	void mpForgetProgram(GLuint pProgram);
+	void mpForgetVertexArray(GLuint pVertexArray);
+	void mpForgetBuffer(GLuint pBuffer);
+	void mpForgetTexture(GLuint pTexture);
+
+private:
+	struct BufferRange
+	{
+		GLuint aBuffer;
+		GLintptr aOffset;
+		GLsizeiptr aSize;
+	};
+
+	// Last value sent to one uniform location, aSize 0 until one was sent
+	struct UniformValue
+	{
+		GLuint aSize;
+		unsigned char aBytes[sizeof(glm::mat4)];
+	};
+
+	GLuint aProgram;
+	GLuint aVertexArray;
+	GLuint aArrayBuffer;
+	GLuint aUniformBuffer;
+	GLuint aTextureBuffer;
+	BufferRange aUniformBindings[STATE_UNIFORM_BINDINGS];
+	GLuint aActiveUnit;
+	GLuint aTextures2D[STATE_TEXTURE_UNITS];
+	GLuint aBufferTextures[STATE_TEXTURE_UNITS];
+
+	std::unordered_map<GLuint, std::vector<UniformValue>> aUniforms;
+	// Values of aProgram, null while the bound program is unknown
+	std::vector<UniformValue>* aProgramUniforms;
+
+	bool mfCount(GLStateCall pCall, bool pChanged);
+	GLuint* mfGetBufferBinding(GLenum pTarget);
+	bool mfUniformChanged(GLint pLocation, const void* pValue, GLuint pSize);
+};
+
+extern GLStateCache gGLState;
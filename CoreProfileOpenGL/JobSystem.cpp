@@ -0,0 +1,162 @@
+#include "JobSystem.h"
+
+JobSystem gJobs;
+
+// Deque of the current thread, 0 outside the pool
+static thread_local unsigned int gQueueIndex = 0;
+
+JobSystem::JobSystem() : aStolenCount(0), aQueuedCount(0), aStopping(false)
+{
+	this->aQueues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+}
+
+JobSystem::~JobSystem()
+{
+	this->mpStop();
+}
+
+void JobSystem::mpStart(unsigned int pWorkerCount)
+{
+	this->mpStop();
+
+	this->aStolenCount = 0;
+	this->aStopping = false;
+	while (this->aQueues.size() < pWorkerCount + 1)
+		this->aQueues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+	for (unsigned int i = 0; i < pWorkerCount; i++)
+		this->aWorkers.push_back(std::thread(&JobSystem::mpWorkerLoop, this, i + 1));
+}
+
+void JobSystem::mpStop()
+{
+	{
+		std::lock_guard<std::mutex> lLock(this->aWakeMutex);
+		this->aStopping = true;
+	}
+	this->aWake.notify_all();
+
+	for (size_t i = 0; i < this->aWorkers.size(); i++)
+		this->aWorkers[i].join();
+	this->aWorkers.clear();
+	this->aQueues.resize(1);
+}
+
+void JobSystem::mpRun(std::function<void()> pFunction, JobCounter* pCounter, JobCounter* pDependency)
+{
+	Job lJob;
+	lJob.aFunction = std::move(pFunction);
+	lJob.aCounter = pCounter;
+
+	if (pCounter != nullptr)
+	{
+		std::lock_guard<std::mutex> lLock(pCounter->aMutex);
+		pCounter->aPending++;
+	}
+
+	if (pDependency != nullptr)
+	{
+		std::lock_guard<std::mutex> lLock(pDependency->aMutex);
+		if (pDependency->aPending > 0)
+		{
+			pDependency->aWaiting.push_back(std::move(lJob));
+			return;
+		}
+	}
+
+	this->mpPush(lJob);
+}
+
+void JobSystem::mpWait(JobCounter& pCounter)
+{
+	while (!pCounter.mfIsDone())
+	{
+		if (!this->mfRunOneJob())
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::mpPush(const Job& pJob)
+{
+	JobQueue& lQueue = *this->aQueues[gQueueIndex < this->aQueues.size() ? gQueueIndex : 0];
+	{
+		std::lock_guard<std::mutex> lLock(lQueue.aMutex);
+		lQueue.aJobs.push_back(pJob);
+		this->aQueuedCount++;
+	}
+
+	// Taking the lock orders the push before a worker's check of aQueuedCount, so the wake up cannot be lost
+	{
+		std::lock_guard<std::mutex> lLock(this->aWakeMutex);
+	}
+	this->aWake.notify_one();
+}
+
+bool JobSystem::mfRunOneJob()
+{
+	if (this->aQueuedCount == 0)
+		return false;
+
+	// Newest job of the own deque first, then the oldest job of the others in turn
+	Job lJob;
+	bool lFound = false;
+	size_t lQueueCount = this->aQueues.size();
+	size_t lOwn = gQueueIndex < lQueueCount ? gQueueIndex : 0;
+	for (size_t i = 0; i < lQueueCount && !lFound; i++)
+	{
+		JobQueue& lQueue = *this->aQueues[(lOwn + i) % lQueueCount];
+		std::lock_guard<std::mutex> lLock(lQueue.aMutex);
+		if (lQueue.aJobs.empty())
+			continue;
+
+		if (i == 0)
+		{
+			lJob = std::move(lQueue.aJobs.back());
+			lQueue.aJobs.pop_back();
+		}
+		else
+		{
+			lJob = std::move(lQueue.aJobs.front());
+			lQueue.aJobs.pop_front();
+			this->aStolenCount++;
+		}
+		this->aQueuedCount--;
+		lFound = true;
+	}
+	if (!lFound)
+		return false;
+
+	lJob.aFunction();
+	this->mpFinishJob(lJob.aCounter);
+	return true;
+}
+
+void JobSystem::mpFinishJob(JobCounter* pCounter)
+{
+	if (pCounter == nullptr)
+		return;
+
+	// The jobs held back by the counter are taken while it is locked, a waiter may destroy it right after
+	std::vector<Job> lReleased;
+	{
+		std::lock_guard<std::mutex> lLock(pCounter->aMutex);
+		if (--pCounter->aPending == 0)
+			lReleased.swap(pCounter->aWaiting);
+	}
+	for (size_t i = 0; i < lReleased.size(); i++)
+		this->mpPush(lReleased[i]);
+}
+
+void JobSystem::mpWorkerLoop(unsigned int pQueueIndex)
+{
+	gQueueIndex = pQueueIndex;
+	while (true)
+	{
+		if (this->mfRunOneJob())
+			continue;
+
+		std::unique_lock<std::mutex> lLock(this->aWakeMutex);
+		this->aWake.wait(lLock, [this] { return this->aStopping || this->aQueuedCount > 0; });
+		if (this->aStopping && this->aQueuedCount == 0)
+			return;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// Std. Includes
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+struct Job
+{
+	std::function<void()> aFunction;
+	// Counter the job is counted in, may be null
+	JobCounter* aCounter;
+};
+
+// Counts the unfinished jobs started with it. Jobs started with a counter as their dependency are held back until it
+// reaches zero. A counter must outlive its jobs: wait for it before it goes out of scope.
+class JobCounter
+{
+public:
+	JobCounter() : aPending(0) {}
+	~JobCounter() {}
+
+	bool mfIsDone()
+	{
+		std::lock_guard<std::mutex> lLock(this->aMutex);
+		return this->aPending == 0;
+	}
+
+private:
+	friend class JobSystem;
+
+	std::mutex aMutex;
+	unsigned int aPending;
+	std::vector<Job> aWaiting;
+};
+
+// Fixed pool of worker threads with one job deque per thread. A thread pushes and pops the jobs it started at the back
+// of its own deque, so nested jobs run depth first and stay in its caches; a thread whose deque is empty steals the
+// oldest job from the front of another one. Threads outside the pool share deque 0.
+// Waiting on a counter runs jobs meanwhile, so with no workers every job runs on the thread that waits for it.
+class JobSystem
+{
+public:
+	// Jobs taken from another thread's deque since mpStart
+	std::atomic<unsigned int> aStolenCount;
+
+	JobSystem();
+	~JobSystem();
+
+	// Starts pWorkerCount threads. The thread calling mpWait works too, so one less than the threads wanted.
+	void mpStart(unsigned int pWorkerCount);
+
+	// Joins the workers once every queued job ran
+	void mpStop();
+
+	// Queues pFunction, counted in pCounter when given. With pDependency it only becomes runnable once pDependency is
+	// done.
+	void mpRun(std::function<void()> pFunction, JobCounter* pCounter, JobCounter* pDependency = nullptr);
+
+	// Runs queued jobs until pCounter is done
+	void mpWait(JobCounter& pCounter);
+
+	unsigned int mfGetWorkerCount() const { return (unsigned int)this->aWorkers.size(); }
+
+private:
+	struct JobQueue
+	{
+		std::mutex aMutex;
+		std::deque<Job> aJobs;
+	};
+
+	// Deque 0 belongs to the threads outside the pool, deque i + 1 to worker i
+	std::vector<std::unique_ptr<JobQueue> > aQueues;
+	std::vector<std::thread> aWorkers;
+
+	// Jobs sitting in any deque, workers sleep while it is zero
+	std::atomic<unsigned int> aQueuedCount;
+	std::mutex aWakeMutex;
+	std::condition_variable aWake;
+	bool aStopping;
+
+	void mpPush(const Job& pJob);
+	bool mfRunOneJob();
+	void mpFinishJob(JobCounter* pCounter);
+	void mpWorkerLoop(unsigned int pQueueIndex);
+};
+
+// Shared by everything that splits work over threads, started by main
+extern JobSystem gJobs;
@@ -0,0 +1,397 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLUSTERS_USE_SSE2
+#endif
+
+#include "LightClusters.h"
+#include "ParallelFor.h"
+#include "GLStateCache.h"
+
+// Cone against sphere test for four consecutive clusters. Bit i of the result is set when cluster i may be lit.
+// A cluster is rejected when its bounding sphere lies fully outside the cone angle, behind the apex or past the range.
+static inline int mfConeTest4(const float* pCenterX, const float* pCenterY, const float* pCenterZ, const float* pRadius,
+							  const glm::vec3& pApex, const glm::vec3& pDirection, float pCos, float pSin, float pRange)
+{
+#ifdef CLUSTERS_USE_SSE2
+	__m128 lVx = _mm_sub_ps(_mm_loadu_ps(pCenterX), _mm_set1_ps(pApex.x));
+	__m128 lVy = _mm_sub_ps(_mm_loadu_ps(pCenterY), _mm_set1_ps(pApex.y));
+	__m128 lVz = _mm_sub_ps(_mm_loadu_ps(pCenterZ), _mm_set1_ps(pApex.z));
+	__m128 lRadius = _mm_loadu_ps(pRadius);
+
+	__m128 lLenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lVx, lVx), _mm_mul_ps(lVy, lVy)), _mm_mul_ps(lVz, lVz));
+	__m128 lAlong = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lVx, _mm_set1_ps(pDirection.x)), _mm_mul_ps(lVy, _mm_set1_ps(pDirection.y))), _mm_mul_ps(lVz, _mm_set1_ps(pDirection.z)));
+	__m128 lAcross = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lLenSq, _mm_mul_ps(lAlong, lAlong)), _mm_setzero_ps()));
+	__m128 lDistance = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(pCos), lAcross), _mm_mul_ps(lAlong, _mm_set1_ps(pSin)));
+
+	__m128 lInsideAngle = _mm_cmple_ps(lDistance, lRadius);
+	__m128 lInsideRange = _mm_cmple_ps(lAlong, _mm_add_ps(_mm_set1_ps(pRange), lRadius));
+	__m128 lInFront = _mm_cmpge_ps(lAlong, _mm_sub_ps(_mm_setzero_ps(), lRadius));
+
+	return _mm_movemask_ps(_mm_and_ps(_mm_and_ps(lInsideAngle, lInsideRange), lInFront));
+#else
+	int lMask = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec3 lV = glm::vec3(pCenterX[i], pCenterY[i], pCenterZ[i]) - pApex;
+		float lAlong = glm::dot(lV, pDirection);
+		float lAcross = std::sqrt(std::max(glm::dot(lV, lV) - lAlong * lAlong, 0.0f));
+		float lDistance = pCos * lAcross - lAlong * pSin;
+
+		if (lDistance <= pRadius[i] && lAlong <= pRange + pRadius[i] && lAlong >= -pRadius[i])
+			lMask |= 1 << i;
+	}
+	return lMask;
+#endif
+}
+
+LightClusters::LightClusters() : aBinMs(0.0), aIndexCount(0), aOverflowCount(0), aThreadCount(1), aNear(0.0f), aFar(0.0f), aWidth(0), aHeight(0),
+	aLightsDirty(true), aMaxTexels(65536), aProgramID(0)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		this->aBuffers[i] = 0;
+		this->aTextures[i] = 0;
+	}
+}
+
+LightClusters::~LightClusters()
+{
+}
+
+void LightClusters::mpInit(unsigned int pThreadCount)
+{
+	this->aThreadCount = pThreadCount > 0 ? pThreadCount : 1;
+
+	this->aCenterX.resize(CLUSTER_COUNT);
+	this->aCenterY.resize(CLUSTER_COUNT);
+	this->aCenterZ.resize(CLUSTER_COUNT);
+	this->aRadius.resize(CLUSTER_COUNT);
+	this->aClusterCounts.resize(CLUSTER_COUNT);
+	this->aClusterScratch.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+	this->aClusterRanges.resize(CLUSTER_COUNT * 2);
+
+	// Lights are 5 RGBA32F texels (the SpotlightBlock layout), cluster ranges one RG32UI (offset, count), indices one R32UI
+	const GLenum lFormats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &this->aMaxTexels);
+	glGenBuffers(3, this->aBuffers);
+	glGenTextures(3, this->aTextures);
+
+	for (int i = 0; i < 3; i++)
+	{
+		gGLState.mpBindBuffer(GL_TEXTURE_BUFFER, this->aBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+
+		gGLState.mpBindTexture(0, GL_TEXTURE_BUFFER, this->aTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, lFormats[i], this->aBuffers[i]);
+	}
+}
+
+void LightClusters::mpSetProjection(const glm::mat4& pProjection, float pNear, float pFar, GLuint pWidth, GLuint pHeight)
+{
+	if (pProjection == this->aProjection && pNear == this->aNear && pFar == this->aFar && pWidth == this->aWidth && pHeight == this->aHeight)
+		return;
+
+	this->aProjection = pProjection;
+	this->aNear = pNear;
+	this->aFar = pFar;
+	this->aWidth = pWidth;
+	this->aHeight = pHeight;
+
+	// A view space point (x, y, -depth) lands on ndc x * P00 / depth, y * P11 / depth
+	float lScaleX = 1.0f / pProjection[0][0];
+	float lScaleY = 1.0f / pProjection[1][1];
+
+	for (unsigned int z = 0; z < CLUSTER_Z; z++)
+	{
+		float lNearDepth = pNear * std::pow(pFar / pNear, (float)z / CLUSTER_Z);
+		float lFarDepth = pNear * std::pow(pFar / pNear, (float)(z + 1) / CLUSTER_Z);
+
+		for (unsigned int y = 0; y < CLUSTER_Y; y++)
+		{
+			float lNdcY0 = -1.0f + 2.0f * y / CLUSTER_Y;
+			float lNdcY1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+
+			for (unsigned int x = 0; x < CLUSTER_X; x++)
+			{
+				float lNdcX0 = -1.0f + 2.0f * x / CLUSTER_X;
+				float lNdcX1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+
+				glm::vec3 lMin(std::min(lNdcX0 * lNearDepth, lNdcX0 * lFarDepth) * lScaleX,
+							   std::min(lNdcY0 * lNearDepth, lNdcY0 * lFarDepth) * lScaleY,
+							   -lFarDepth);
+				glm::vec3 lMax(std::max(lNdcX1 * lNearDepth, lNdcX1 * lFarDepth) * lScaleX,
+							   std::max(lNdcY1 * lNearDepth, lNdcY1 * lFarDepth) * lScaleY,
+							   -lNearDepth);
+
+				unsigned int lCluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+				glm::vec3 lCenter = (lMin + lMax) * 0.5f;
+				this->aCenterX[lCluster] = lCenter.x;
+				this->aCenterY[lCluster] = lCenter.y;
+				this->aCenterZ[lCluster] = lCenter.z;
+				this->aRadius[lCluster] = glm::length(lMax - lCenter);
+			}
+		}
+	}
+}
+
+unsigned int LightClusters::mfGetSlice(float pDepth) const
+{
+	if (pDepth <= this->aNear)
+		return 0;
+
+	int lSlice = (int)(std::log(pDepth / this->aNear) * CLUSTER_Z / std::log(this->aFar / this->aNear));
+	return (unsigned int)std::min(std::max(lSlice, 0), (int)CLUSTER_Z - 1);
+}
+
+void LightClusters::mpTransformLights(const std::vector<Spotlight>& pLights, const glm::mat4& pView, unsigned int pBegin, unsigned int pEnd)
+{
+	float lP00 = this->aProjection[0][0];
+	float lP11 = this->aProjection[1][1];
+
+	for (unsigned int i = pBegin; i < pEnd; i++)
+	{
+		const Spotlight& lLight = pLights[i];
+		ViewLight& lView = this->aViewLights[i];
+
+		lView.aPosition = glm::vec3(pView * glm::vec4(lLight.aPosition, 1.0f));
+		lView.aDirection = glm::normalize(glm::mat3(pView) * lLight.aDirection);
+		lView.aCosAngle = lLight.aOuterCutoff;
+		lView.aSinAngle = std::sqrt(std::max(1.0f - lLight.aOuterCutoff * lLight.aOuterCutoff, 0.0f));
+		lView.aRange = lLight.mfGetRange(LIGHT_CUTOFF_ATTENUATION);
+
+		// Bounding sphere of the cone: wide cones are bounded by their cap, narrow ones by the sphere through apex and rim
+		glm::vec3 lCenter;
+		float lRadius;
+		if (lView.aCosAngle < 0.70710678f)
+		{
+			lCenter = lView.aPosition + lView.aDirection * (lView.aRange * lView.aCosAngle);
+			lRadius = lView.aRange * lView.aSinAngle;
+		}
+		else
+		{
+			float lHalfLength = lView.aRange / (2.0f * lView.aCosAngle);
+			lCenter = lView.aPosition + lView.aDirection * lHalfLength;
+			lRadius = lHalfLength;
+		}
+
+		float lNearDepth = -lCenter.z - lRadius;
+		float lFarDepth = -lCenter.z + lRadius;
+		if (lFarDepth < this->aNear || lNearDepth > this->aFar)
+		{
+			lView.aVisible = false;
+			continue;
+		}
+		lNearDepth = std::max(lNearDepth, this->aNear);
+		lFarDepth = std::min(lFarDepth, this->aFar);
+
+		// Conservative ndc extent of the sphere's view space box: the most negative corner projects furthest out at the nearest depth
+		float lX0 = lCenter.x - lRadius, lX1 = lCenter.x + lRadius;
+		float lY0 = lCenter.y - lRadius, lY1 = lCenter.y + lRadius;
+		float lNdcX0 = (lX0 < 0.0f ? lX0 / lNearDepth : lX0 / lFarDepth) * lP00;
+		float lNdcX1 = (lX1 > 0.0f ? lX1 / lNearDepth : lX1 / lFarDepth) * lP00;
+		float lNdcY0 = (lY0 < 0.0f ? lY0 / lNearDepth : lY0 / lFarDepth) * lP11;
+		float lNdcY1 = (lY1 > 0.0f ? lY1 / lNearDepth : lY1 / lFarDepth) * lP11;
+
+		if (lNdcX1 < -1.0f || lNdcX0 > 1.0f || lNdcY1 < -1.0f || lNdcY0 > 1.0f)
+		{
+			lView.aVisible = false;
+			continue;
+		}
+
+		lView.aVisible = true;
+		lView.aMinX = (unsigned int)glm::clamp((int)((lNdcX0 * 0.5f + 0.5f) * CLUSTER_X), 0, (int)CLUSTER_X - 1);
+		lView.aMaxX = (unsigned int)glm::clamp((int)((lNdcX1 * 0.5f + 0.5f) * CLUSTER_X), 0, (int)CLUSTER_X - 1);
+		lView.aMinY = (unsigned int)glm::clamp((int)((lNdcY0 * 0.5f + 0.5f) * CLUSTER_Y), 0, (int)CLUSTER_Y - 1);
+		lView.aMaxY = (unsigned int)glm::clamp((int)((lNdcY1 * 0.5f + 0.5f) * CLUSTER_Y), 0, (int)CLUSTER_Y - 1);
+		lView.aMinZ = this->mfGetSlice(lNearDepth);
+		lView.aMaxZ = this->mfGetSlice(lFarDepth);
+	}
+}
+
+// Each call owns the depth slices [pBegin, pEnd), so workers never write the same cluster
+unsigned int LightClusters::mfBinSlices(unsigned int pBegin, unsigned int pEnd)
+{
+	unsigned int lOverflow = 0;
+
+	for (unsigned int c = pBegin * CLUSTER_X * CLUSTER_Y; c < pEnd * CLUSTER_X * CLUSTER_Y; c++)
+		this->aClusterCounts[c] = 0;
+
+	for (unsigned int i = 0; i < this->aViewLights.size(); i++)
+	{
+		const ViewLight& lLight = this->aViewLights[i];
+		if (!lLight.aVisible || lLight.aMaxZ < pBegin || lLight.aMinZ >= pEnd)
+			continue;
+
+		unsigned int lFirstZ = std::max(lLight.aMinZ, pBegin);
+		unsigned int lLastZ = std::min(lLight.aMaxZ, pEnd - 1);
+
+		for (unsigned int z = lFirstZ; z <= lLastZ; z++)
+		{
+			for (unsigned int y = lLight.aMinY; y <= lLight.aMaxY; y++)
+			{
+				unsigned int lRow = (z * CLUSTER_Y + y) * CLUSTER_X;
+
+				for (unsigned int x = lLight.aMinX & ~3u; x <= lLight.aMaxX; x += 4)
+				{
+					unsigned int lFirst = lRow + x;
+					int lMask = mfConeTest4(&this->aCenterX[lFirst], &this->aCenterY[lFirst], &this->aCenterZ[lFirst], &this->aRadius[lFirst],
+											lLight.aPosition, lLight.aDirection, lLight.aCosAngle, lLight.aSinAngle, lLight.aRange);
+
+					for (unsigned int lLane = 0; lLane < 4; lLane++)
+					{
+						if (!(lMask & (1 << lLane)) || x + lLane < lLight.aMinX || x + lLane > lLight.aMaxX)
+							continue;
+
+						unsigned int lCluster = lFirst + lLane;
+						if (this->aClusterCounts[lCluster] < MAX_LIGHTS_PER_CLUSTER)
+							this->aClusterScratch[lCluster * MAX_LIGHTS_PER_CLUSTER + this->aClusterCounts[lCluster]++] = i;
+						else
+							lOverflow++;
+					}
+				}
+			}
+		}
+	}
+
+	return lOverflow;
+}
+
+void LightClusters::mpBuild(const std::vector<Spotlight>& pLights, const glm::mat4& pView)
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	unsigned int lLightCount = (unsigned int)pLights.size();
+
+	// Light data only goes to the GPU again when some light changed
+	if (this->aLightBlocks.size() != lLightCount)
+	{
+		this->aLightBlocks.resize(lLightCount);
+		this->aLightsDirty = true;
+	}
+	for (unsigned int i = 0; i < lLightCount; i++)
+	{
+		SpotlightBlock lBlock = pLights[i].mfGetBlock();
+		if (memcmp(&lBlock, &this->aLightBlocks[i], sizeof(SpotlightBlock)) != 0)
+		{
+			this->aLightBlocks[i] = lBlock;
+			this->aLightsDirty = true;
+		}
+	}
+
+	// The light buffer only holds as many lights as fit in GL_MAX_TEXTURE_BUFFER_SIZE texels, the rest are not binned
+	unsigned int lBinnedCount = std::min(lLightCount, (unsigned int)((size_t)this->aMaxTexels * 16 / sizeof(SpotlightBlock)));
+	this->aViewLights.resize(lBinnedCount);
+	mpParallelFor(lBinnedCount, this->aThreadCount, [&](unsigned int pBegin, unsigned int pEnd)
+	{
+		this->mpTransformLights(pLights, pView, pBegin, pEnd);
+	});
+
+	std::atomic<unsigned int> lOverflow(0);
+	mpParallelFor(CLUSTER_Z, this->aThreadCount, [&](unsigned int pBegin, unsigned int pEnd)
+	{
+		lOverflow += this->mfBinSlices(pBegin, pEnd);
+	});
+	this->aOverflowCount = lOverflow;
+
+	// Compact the per-cluster scratch lists into one index list. It is a texture buffer too, once it is full the
+	// remaining clusters keep fewer lights or none, and the dropped ones count as overflow.
+	unsigned int lOffset = 0;
+	for (unsigned int c = 0; c < CLUSTER_COUNT; c++)
+	{
+		unsigned int lCount = std::min(this->aClusterCounts[c], (unsigned int)this->aMaxTexels - lOffset);
+		this->aOverflowCount += this->aClusterCounts[c] - lCount;
+		this->aClusterCounts[c] = lCount;
+		this->aClusterRanges[c * 2] = lOffset;
+		this->aClusterRanges[c * 2 + 1] = this->aClusterCounts[c];
+		lOffset += this->aClusterCounts[c];
+	}
+
+	this->aLightIndices.resize(lOffset);
+	for (unsigned int c = 0; c < CLUSTER_COUNT; c++)
+	{
+		if (this->aClusterCounts[c] > 0)
+			memcpy(&this->aLightIndices[this->aClusterRanges[c * 2]], &this->aClusterScratch[c * MAX_LIGHTS_PER_CLUSTER], this->aClusterCounts[c] * sizeof(GLuint));
+	}
+	this->aIndexCount = lOffset;
+
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aBinMs = lElapsed.count();
+}
+
+void LightClusters::mpUpload()
+{
+	// Texture buffers are limited to GL_MAX_TEXTURE_BUFFER_SIZE texels. mpBuild keeps the index list within that and
+	// never bins lights past it, so the tail of the light data that does not fit is never fetched.
+	if (this->aLightsDirty && !this->aLightBlocks.empty())
+	{
+		size_t lLightBytes = std::min(this->aLightBlocks.size() * sizeof(SpotlightBlock), (size_t)this->aMaxTexels * 16);
+		gGLState.mpBindBuffer(GL_TEXTURE_BUFFER, this->aBuffers[0]);
+		glBufferData(GL_TEXTURE_BUFFER, lLightBytes, &this->aLightBlocks[0], GL_STATIC_DRAW);
+		this->aLightsDirty = false;
+	}
+
+	gGLState.mpBindBuffer(GL_TEXTURE_BUFFER, this->aBuffers[1]);
+	glBufferData(GL_TEXTURE_BUFFER, this->aClusterRanges.size() * sizeof(GLuint), &this->aClusterRanges[0], GL_STREAM_DRAW);
+
+	if (!this->aLightIndices.empty())
+	{
+		gGLState.mpBindBuffer(GL_TEXTURE_BUFFER, this->aBuffers[2]);
+		glBufferData(GL_TEXTURE_BUFFER, this->aLightIndices.size() * sizeof(GLuint), &this->aLightIndices[0], GL_STREAM_DRAW);
+	}
+}
+
+void LightClusters::mpBind(GLuint pProgramID, GLuint pFirstUnit)
+{
+	if (pProgramID != this->aProgramID)
+	{
+		this->aProgramID = pProgramID;
+		this->aSamplerLocs[0] = glGetUniformLocation(pProgramID, "lightData");
+		this->aSamplerLocs[1] = glGetUniformLocation(pProgramID, "clusterRanges");
+		this->aSamplerLocs[2] = glGetUniformLocation(pProgramID, "lightIndices");
+		this->aTileScaleLoc = glGetUniformLocation(pProgramID, "tileScale");
+		this->aSliceScaleLoc = glGetUniformLocation(pProgramID, "sliceScale");
+		this->aSliceBiasLoc = glGetUniformLocation(pProgramID, "sliceBias");
+		this->aNearLoc = glGetUniformLocation(pProgramID, "zNear");
+		this->aFarLoc = glGetUniformLocation(pProgramID, "zFar");
+	}
+
+	for (GLuint i = 0; i < 3; i++)
+	{
+		gGLState.mpBindTexture(pFirstUnit + i, GL_TEXTURE_BUFFER, this->aTextures[i]);
+		gGLState.mpSetUniform(this->aSamplerLocs[i], (GLint)(pFirstUnit + i));
+	}
+
+	// slice = log(depth) * sliceScale + sliceBias, the inverse of the slice depths in mpSetProjection
+	float lLogRatio = std::log(this->aFar / this->aNear);
+	gGLState.mpSetUniform(this->aTileScaleLoc, glm::vec2((float)CLUSTER_X / this->aWidth, (float)CLUSTER_Y / this->aHeight));
+	gGLState.mpSetUniform(this->aSliceScaleLoc, CLUSTER_Z / lLogRatio);
+	gGLState.mpSetUniform(this->aSliceBiasLoc, -(float)CLUSTER_Z * std::log(this->aNear) / lLogRatio);
+	gGLState.mpSetUniform(this->aNearLoc, this->aNear);
+	gGLState.mpSetUniform(this->aFarLoc, this->aFar);
+}
+
+void LightClusters::mpDestroy()
+{
+	if (this->aBuffers[0] != 0)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			gGLState.mpForgetTexture(this->aTextures[i]);
+			gGLState.mpForgetBuffer(this->aBuffers[i]);
+		}
+		glDeleteTextures(3, this->aTextures);
+		glDeleteBuffers(3, this->aBuffers);
+		for (int i = 0; i < 3; i++)
+			this->aBuffers[i] = this->aTextures[i] = 0;
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Spotlight.h"
+
+// Froxel grid: CLUSTER_X * CLUSTER_Y screen tiles, CLUSTER_Z exponential depth slices between the near and far plane.
+// Must match the constants in lighting_clustered.fs. CLUSTER_X is kept a multiple of 4 for the SIMD cone test.
+const unsigned int CLUSTER_X = 16;
+const unsigned int CLUSTER_Y = 9;
+const unsigned int CLUSTER_Z = 24;
+const unsigned int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+// Lights past this many in a single cluster are dropped and counted in aOverflowCount
+const unsigned int MAX_LIGHTS_PER_CLUSTER = 256;
+
+// Attenuation below which a spotlight no longer contributes, this defines its range
+const float LIGHT_CUTOFF_ATTENUATION = 1.0f / 256.0f;
+
+// Clustered forward shading. Every frame the spotlight cones are binned into the froxel grid on the CPU,
+// lighting_clustered.fs then only shades the lights listed for the cluster its fragment falls in.
+// Lights, per-cluster (offset, count) pairs and the light index list are handed to the shader as texture buffers.
+class LightClusters
+{
+public:
+	// Statistics of the last mpBuild
+	double aBinMs;
+	unsigned int aIndexCount;
+	// Cluster entries dropped because the cluster was full or the index buffer was
+	unsigned int aOverflowCount;
+
+	LightClusters();
+	~LightClusters();
+
+	// Creates the texture buffers. pThreadCount workers are used for binning.
+	void mpInit(unsigned int pThreadCount);
+
+	// Recomputes the cluster bounds when the projection or viewport differs from the previous call
+	void mpSetProjection(const glm::mat4& pProjection, float pNear, float pFar, GLuint pWidth, GLuint pHeight);
+
+	// Bins every spotlight into the clusters it can light
+	void mpBuild(const std::vector<Spotlight>& pLights, const glm::mat4& pView);
+
+	// Uploads the cluster lists, and the lights when they changed
+	void mpUpload();
+
+	// Binds the texture buffers to pFirstUnit .. pFirstUnit + 2 and sets the cluster uniforms of the program,
+	// which has to be in use. Called for every lighting program a frame draws with.
+	void mpBind(GLuint pProgramID, GLuint pFirstUnit);
+
+	void mpDestroy();
+
+private:
+	// A spotlight transformed to view space together with the clusters its bounding sphere touches
+	struct ViewLight
+	{
+		glm::vec3 aPosition;
+		glm::vec3 aDirection;
+		float aCosAngle;
+		float aSinAngle;
+		float aRange;
+		bool aVisible;
+		unsigned int aMinX, aMaxX, aMinY, aMaxY, aMinZ, aMaxZ;
+	};
+
+	unsigned int aThreadCount;
+
+	glm::mat4 aProjection;
+	float aNear;
+	float aFar;
+	GLuint aWidth;
+	GLuint aHeight;
+
+	// Bounding sphere of every cluster in view space, structure of arrays so four clusters load as one SSE register
+	std::vector<float> aCenterX;
+	std::vector<float> aCenterY;
+	std::vector<float> aCenterZ;
+	std::vector<float> aRadius;
+
+	std::vector<ViewLight> aViewLights;
+	std::vector<unsigned int> aClusterCounts;
+	std::vector<unsigned int> aClusterScratch;
+
+	std::vector<SpotlightBlock> aLightBlocks;
+	std::vector<GLuint> aClusterRanges;
+	std::vector<GLuint> aLightIndices;
+	bool aLightsDirty;
+	GLint aMaxTexels;
+
+	GLuint aBuffers[3];
+	GLuint aTextures[3];
+
+	// Uniform locations of the program last passed to mpBind
+	GLuint aProgramID;
+	GLint aSamplerLocs[3];
+	GLint aTileScaleLoc;
+	GLint aSliceScaleLoc;
+	GLint aSliceBiasLoc;
+	GLint aNearLoc;
+	GLint aFarLoc;
+
+	void mpTransformLights(const std::vector<Spotlight>& pLights, const glm::mat4& pView, unsigned int pBegin, unsigned int pEnd);
+	unsigned int mfBinSlices(unsigned int pBegin, unsigned int pEnd);
+	unsigned int mfGetSlice(float pDepth) const;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "UniformBuffer.h"
+#include "NormalMatrix.h"
+#include "GLStateCache.h"
+
+// One permutation of the lighting shader and the locations of the uniforms that are set per frame and per draw.
+// Draws that resolve to the same defines share the program, LoadShaderVariantAsync hands out one handle per variant.
+class LightingProgram
+{
+public:
+	ShaderProgramHandle aHandle;
+	GLuint aProgramID;
+
+	GLint aLightCountLoc;
+	GLint aViewPosLoc;
+	GLint aModelMatrixLoc;
+	GLint aNormalMatrixLoc;
+	GLint aViewMatrixLoc;
+	GLint aProjectionMatrixLoc;
+	GLint aAmbientKeyColorLoc;
+
+	~LightingProgram() {}
+
+	LightingProgram(ShaderProgramHandle pHandle) : aHandle(pHandle), aProgramID(0), aLightCountLoc(-1), aViewPosLoc(-1), aModelMatrixLoc(-1), aNormalMatrixLoc(-1),
+		aViewMatrixLoc(-1), aProjectionMatrixLoc(-1), aAmbientKeyColorLoc(-1)
+	{
+	}
+
+	// Picks up the program once it is linked, and again after a hot reload replaced it. False while there is none.
+	bool mfRefresh()
+	{
+		GLuint lProgramID = GetShaderProgram(this->aHandle);
+		if (lProgramID == 0)
+			return false;
+
+		if (lProgramID != this->aProgramID)
+		{
+			// The previous program is deleted after a reload and its name may come back for another one
+			if (this->aProgramID != 0)
+				gGLState.mpForgetProgram(this->aProgramID);
+			gGLState.mpForgetProgram(lProgramID);
+			this->aProgramID = lProgramID;
+
+			// Spotlights and materials live in uniform buffers. The spotlights fill the lights array of the Lights block,
+			// every material gets its own aligned slot so switching material is a single glBindBufferRange.
+			mfBindUniformBlock(lProgramID, "Lights", LIGHTS_BINDING);
+			mfBindUniformBlock(lProgramID, "MaterialBlock", MATERIAL_BINDING);
+
+			this->aLightCountLoc = glGetUniformLocation(lProgramID, "lightCount");
+			this->aViewPosLoc = glGetUniformLocation(lProgramID, "viewPos");
+			this->aModelMatrixLoc = glGetUniformLocation(lProgramID, "model");
+			this->aNormalMatrixLoc = glGetUniformLocation(lProgramID, "normalMatrix");
+			this->aViewMatrixLoc = glGetUniformLocation(lProgramID, "view");
+			this->aProjectionMatrixLoc = glGetUniformLocation(lProgramID, "projection");
+			this->aAmbientKeyColorLoc = glGetUniformLocation(lProgramID, "ambientKeyColor");
+		}
+		return true;
+	}
+
+	// Makes the program current and sets the uniforms shared by every draw of the frame. Values the program already has
+	// are skipped by gGLState, only variants without a compile time LIGHT_COUNT read lightCount.
+	void mpUse(const glm::mat4& pView, const glm::mat4& pProjection, const glm::vec3& pViewPos, const glm::vec3& pAmbientKeyColor, GLint pLightCount)
+	{
+		gGLState.mpUseProgram(this->aProgramID);
+		gGLState.mpSetUniform(this->aLightCountLoc, pLightCount);
+		gGLState.mpSetUniform(this->aAmbientKeyColorLoc, pAmbientKeyColor);
+		gGLState.mpSetUniform(this->aViewPosLoc, pViewPos);
+		gGLState.mpSetUniform(this->aViewMatrixLoc, pView);
+		gGLState.mpSetUniform(this->aProjectionMatrixLoc, pProjection);
+	}
+
+	void mpSetModel(const glm::mat4& pModel)
+	{
+		gGLState.mpSetUniform(this->aModelMatrixLoc, pModel);
+		gGLState.mpSetUniform(this->aNormalMatrixLoc, mfGetNormalMatrix(pModel));
+	}
+};
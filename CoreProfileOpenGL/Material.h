@@ -1,6 +1,17 @@
 #pragma once
 #include <glm/glm.hpp>
 
+// std140 mirror of the Material struct in lighting.fs
+struct MaterialBlock
+{
+	glm::vec3 aDiffuse;
+	float aShininess;
+	glm::vec3 aSpecular;
+	float aPadding;
+};
+
+static_assert(sizeof(MaterialBlock) == 32, "MaterialBlock must match the std140 layout of Material");
+
 class Material
 {
 public:
@@ -17,4 +28,20 @@ public:
 		this->aSpecular = glm::vec3(0.3f);
 		this->aShininess = pShininess;
 	}
+
+	// Materials without a highlight are drawn with a shader variant that skips the specular term
+	bool mfHasSpecular() const
+	{
+		return this->aShininess > 0.0f && this->aSpecular != glm::vec3(0.0f);
+	}
+
+	MaterialBlock mfGetBlock() const
+	{
+		MaterialBlock lBlock;
+		lBlock.aDiffuse = this->aDiffuse;
+		lBlock.aShininess = this->aShininess;
+		lBlock.aSpecular = this->aSpecular;
+		lBlock.aPadding = 0.0f;
+		return lBlock;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unordered_map>
+
+#include <glm/gtc/packing.hpp>
+
+#include "Mesh.h"
+#include "GLStateCache.h"
+
+namespace
+{
+	// 12 bytes: half float position padded to 8 bytes so the normal stays 4 byte aligned
+	struct PackedVertex
+	{
+		glm::uint16 aPosition[4];
+		glm::uint32 aNormal;
+	};
+
+	// 16 bytes when texture coordinates are kept
+	struct PackedVertexUV
+	{
+		glm::uint16 aPosition[4];
+		glm::uint32 aNormal;
+		glm::uint16 aTexCoords[2];
+	};
+
+	static_assert(sizeof(PackedVertex) == 12, "PackedVertex must stay tightly packed");
+	static_assert(sizeof(PackedVertexUV) == 16, "PackedVertexUV must stay tightly packed");
+
+	// FNV-1a over the packed bytes, vertices are welded when their packed representation is identical
+	struct PackedHash
+	{
+		size_t operator()(const PackedVertexUV& pVertex) const
+		{
+			const unsigned char* lBytes = (const unsigned char*)&pVertex;
+			size_t lHash = 2166136261u;
+			for (size_t i = 0; i < sizeof(pVertex); i++)
+				lHash = (lHash ^ lBytes[i]) * 16777619u;
+			return lHash;
+		}
+	};
+
+	struct PackedEqual
+	{
+		bool operator()(const PackedVertexUV& pA, const PackedVertexUV& pB) const
+		{
+			return memcmp(&pA, &pB, sizeof(pA)) == 0;
+		}
+	};
+}
+
+Mesh::Mesh() : aSourceVertexCount(0), aSourceBytesPerVertex(0), aVertexCount(0), aBytesPerVertex(0), aIndexCount(0), aBytesPerIndex(0),
+	aVertexInvocations(0), aVAO(0), aVBO(0), aEBO(0), aIndexType(GL_UNSIGNED_SHORT), aHasTexCoords(false)
+{
+}
+
+Mesh::~Mesh()
+{
+}
+
+void Mesh::mpBuild(const GLfloat* pData, unsigned int pVertexCount, unsigned int pStride, bool pKeepTexCoords)
+{
+	std::vector<MeshVertex> lVertices(pVertexCount);
+	for (unsigned int i = 0; i < pVertexCount; i++)
+	{
+		const GLfloat* lSrc = pData + i * pStride;
+		lVertices[i].aPosition = glm::vec3(lSrc[0], lSrc[1], lSrc[2]);
+		lVertices[i].aNormal = glm::vec3(lSrc[3], lSrc[4], lSrc[5]);
+		lVertices[i].aTexCoords = pStride >= 8 ? glm::vec2(lSrc[6], lSrc[7]) : glm::vec2(0.0f);
+	}
+	mpBuild(lVertices, pKeepTexCoords && pStride >= 8, pStride * sizeof(GLfloat));
+}
+
+void Mesh::mpBuild(const std::vector<MeshVertex>& pVertices, bool pKeepTexCoords, unsigned int pSourceBytesPerVertex)
+{
+	mpDestroy();
+
+	// Pack every vertex and weld the duplicates, the texture coordinates stay zero when they are dropped
+	std::vector<PackedVertexUV> lUnique;
+	std::vector<GLuint> lIndices;
+	std::unordered_map<PackedVertexUV, GLuint, PackedHash, PackedEqual> lLookup;
+	lIndices.reserve(pVertices.size());
+
+	for (size_t i = 0; i < pVertices.size(); i++)
+	{
+		PackedVertexUV lPacked;
+		memset(&lPacked, 0, sizeof(lPacked));
+		for (int c = 0; c < 3; c++)
+			lPacked.aPosition[c] = glm::packHalf1x16(pVertices[i].aPosition[c]);
+		lPacked.aPosition[3] = glm::packHalf1x16(1.0f);
+		lPacked.aNormal = glm::packSnorm3x10_1x2(glm::vec4(glm::normalize(pVertices[i].aNormal), 0.0f));
+		if (pKeepTexCoords)
+		{
+			lPacked.aTexCoords[0] = glm::packHalf1x16(pVertices[i].aTexCoords.x);
+			lPacked.aTexCoords[1] = glm::packHalf1x16(pVertices[i].aTexCoords.y);
+		}
+
+		std::pair<std::unordered_map<PackedVertexUV, GLuint, PackedHash, PackedEqual>::iterator, bool> lInserted =
+			lLookup.insert(std::make_pair(lPacked, (GLuint)lUnique.size()));
+		if (lInserted.second)
+			lUnique.push_back(lPacked);
+		lIndices.push_back(lInserted.first->second);
+	}
+
+	this->aSourceVertexCount = (unsigned int)pVertices.size();
+	this->aSourceBytesPerVertex = pSourceBytesPerVertex;
+	this->aVertexCount = (unsigned int)lUnique.size();
+	this->aBytesPerVertex = pKeepTexCoords ? sizeof(PackedVertexUV) : sizeof(PackedVertex);
+	this->aIndexCount = (unsigned int)lIndices.size();
+	this->aVertexInvocations = mfSimulateVertexCache(lIndices);
+
+	// Vertex data in the final layout
+	std::vector<unsigned char> lVertexData(lUnique.size() * this->aBytesPerVertex);
+	for (size_t i = 0; i < lUnique.size(); i++)
+		memcpy(&lVertexData[i * this->aBytesPerVertex], &lUnique[i], this->aBytesPerVertex);
+
+	this->aHasTexCoords = pKeepTexCoords;
+
+	glGenBuffers(1, &this->aVBO);
+	gGLState.mpBindBuffer(GL_ARRAY_BUFFER, this->aVBO);
+	if (!lVertexData.empty())
+		glBufferData(GL_ARRAY_BUFFER, lVertexData.size(), &lVertexData[0], GL_STATIC_DRAW);
+
+	// The smallest index type every driver handles well. The element buffer binding belongs to the bound vertex array.
+	gGLState.mpBindVertexArray(0);
+	glGenBuffers(1, &this->aEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->aEBO);
+	if (this->aVertexCount <= 65536)
+	{
+		std::vector<GLushort> lShortIndices(lIndices.begin(), lIndices.end());
+		this->aIndexType = GL_UNSIGNED_SHORT;
+		this->aBytesPerIndex = sizeof(GLushort);
+		if (!lShortIndices.empty())
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, lShortIndices.size() * sizeof(GLushort), &lShortIndices[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		this->aIndexType = GL_UNSIGNED_INT;
+		this->aBytesPerIndex = sizeof(GLuint);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, lIndices.size() * sizeof(GLuint), &lIndices[0], GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	this->aVAO = mfCreateVertexArray();
+}
+
+GLuint Mesh::mfCreateVertexArray() const
+{
+	GLuint lVAO;
+	glGenVertexArrays(1, &lVAO);
+	gGLState.mpBindVertexArray(lVAO);
+
+	gGLState.mpBindBuffer(GL_ARRAY_BUFFER, this->aVBO);
+	glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, this->aBytesPerVertex, (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, this->aBytesPerVertex, (GLvoid*)offsetof(PackedVertexUV, aNormal));
+	glEnableVertexAttribArray(1);
+
+	if (this->aHasTexCoords)
+	{
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, this->aBytesPerVertex, (GLvoid*)offsetof(PackedVertexUV, aTexCoords));
+		glEnableVertexAttribArray(2);
+	}
+
+	// The element buffer binding is part of the vertex array
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->aEBO);
+	return lVAO;
+}
+
+unsigned int Mesh::mfSimulateVertexCache(const std::vector<GLuint>& pIndices) const
+{
+	GLuint lCache[POST_TRANSFORM_CACHE];
+	unsigned int lCached = 0, lNext = 0, lMisses = 0;
+
+	for (size_t i = 0; i < pIndices.size(); i++)
+	{
+		bool lHit = false;
+		for (unsigned int c = 0; c < lCached && !lHit; c++)
+			lHit = lCache[c] == pIndices[i];
+		if (lHit)
+			continue;
+
+		lMisses++;
+		lCache[lNext] = pIndices[i];
+		lNext = (lNext + 1) % POST_TRANSFORM_CACHE;
+		if (lCached < POST_TRANSFORM_CACHE)
+			lCached++;
+	}
+	return lMisses;
+}
+
+void Mesh::mpDraw() const
+{
+	gGLState.mpBindVertexArray(this->aVAO);
+	glDrawElements(GL_TRIANGLES, this->aIndexCount, this->aIndexType, (GLvoid*)0);
+}
+
+void Mesh::mpDrawInstances(GLsizei pInstanceCount) const
+{
+	glDrawElementsInstanced(GL_TRIANGLES, this->aIndexCount, this->aIndexType, (GLvoid*)0, pInstanceCount);
+}
+
+void Mesh::mpPrintStats(const char* pName) const
+{
+	unsigned int lSourceBytes = this->aSourceVertexCount * this->aSourceBytesPerVertex;
+	unsigned int lBytes = this->aVertexCount * this->aBytesPerVertex + this->aIndexCount * this->aBytesPerIndex;
+	printf("Mesh %s: %u -> %u vertices, %u -> %u bytes per vertex, %u -> %u bytes (incl. %u byte indices), vertex shader invocations per draw %u -> %u\n",
+		pName, this->aSourceVertexCount, this->aVertexCount, this->aSourceBytesPerVertex, this->aBytesPerVertex,
+		lSourceBytes, lBytes, this->aBytesPerIndex, this->aSourceVertexCount, this->aVertexInvocations);
+}
+
+void Mesh::mpDestroy()
+{
+	if (this->aVAO != 0)
+	{
+		gGLState.mpForgetVertexArray(this->aVAO);
+		gGLState.mpForgetBuffer(this->aVBO);
+		glDeleteVertexArrays(1, &this->aVAO);
+		glDeleteBuffers(1, &this->aVBO);
+		glDeleteBuffers(1, &this->aEBO);
+		this->aVAO = this->aVBO = this->aEBO = 0;
+	}
+}
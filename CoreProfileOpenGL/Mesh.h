@@ -0,0 +1,68 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Vertex as the mesh builder receives it
+struct MeshVertex
+{
+	glm::vec3 aPosition;
+	glm::vec3 aNormal;
+	glm::vec2 aTexCoords;
+};
+
+// Indexed triangle mesh in a compact vertex format. Vertices that are identical after packing are welded into one,
+// positions are stored as half floats and normals as GL_INT_2_10_10_10_REV. Texture coordinates (half floats)
+// are only kept when the shaders drawing the mesh read them. Attribute locations match lighting.vs:
+// 0 position, 1 normal, 2 texture coordinates.
+class Mesh
+{
+public:
+	// Statistics of the last mpBuild, "source" is the unindexed float layout that was passed in
+	unsigned int aSourceVertexCount;
+	unsigned int aSourceBytesPerVertex;
+	unsigned int aVertexCount;
+	unsigned int aBytesPerVertex;
+	unsigned int aIndexCount;
+	unsigned int aBytesPerIndex;
+	// Vertex shader invocations of one draw, estimated with a FIFO post-transform cache of POST_TRANSFORM_CACHE entries
+	unsigned int aVertexInvocations;
+
+	Mesh();
+	~Mesh();
+
+	// pVertices is a triangle list. pSourceBytesPerVertex is only used for the statistics.
+	void mpBuild(const std::vector<MeshVertex>& pVertices, bool pKeepTexCoords, unsigned int pSourceBytesPerVertex);
+
+	// Builds from interleaved floats: position (3), normal (3) and, when pStride is 8, texture coordinates (2)
+	void mpBuild(const GLfloat* pData, unsigned int pVertexCount, unsigned int pStride, bool pKeepTexCoords);
+
+	void mpDraw() const;
+
+	// Draws pInstanceCount instances with the currently bound vertex array, see MeshInstances
+	void mpDrawInstances(GLsizei pInstanceCount) const;
+
+	// Creates another vertex array over the mesh buffers and leaves it bound, so per-instance attributes can be added
+	GLuint mfCreateVertexArray() const;
+
+	GLuint mfGetVertexArray() const { return this->aVAO; }
+
+	void mpPrintStats(const char* pName) const;
+
+	void mpDestroy();
+
+private:
+	static const unsigned int POST_TRANSFORM_CACHE = 16;
+
+	GLuint aVAO;
+	GLuint aVBO;
+	GLuint aEBO;
+	GLenum aIndexType;
+	bool aHasTexCoords;
+
+	unsigned int mfSimulateVertexCache(const std::vector<GLuint>& pIndices) const;
+};
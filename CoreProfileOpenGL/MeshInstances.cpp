@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <stddef.h>
+
+#include "MeshInstances.h"
+#include "GLStateCache.h"
+
+MeshInstances::MeshInstances() : aMesh(nullptr), aVAO(0), aTransformVBO(0), aMaterialVBO(0), aTransformCount(0), aMaterialCount(0)
+{
+}
+
+MeshInstances::~MeshInstances()
+{
+}
+
+void MeshInstances::mpInit(const Mesh& pMesh)
+{
+	this->aMesh = &pMesh;
+	this->aVAO = pMesh.mfCreateVertexArray();
+
+	glGenBuffers(1, &this->aTransformVBO);
+	glGenBuffers(1, &this->aMaterialVBO);
+
+	// Matrix attributes take one location per column
+	gGLState.mpBindBuffer(GL_ARRAY_BUFFER, this->aTransformVBO);
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (GLvoid*)(offsetof(InstanceTransform, aModel) + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(3 + i, 1);
+		glEnableVertexAttribArray(3 + i);
+	}
+	for (GLuint i = 0; i < 3; i++)
+	{
+		glVertexAttribPointer(9 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (GLvoid*)(offsetof(InstanceTransform, aNormalMatrix) + i * sizeof(glm::vec3)));
+		glVertexAttribDivisor(9 + i, 1);
+		glEnableVertexAttribArray(9 + i);
+	}
+
+	// The instance materials use the std140 MaterialBlock layout of the uniform buffer path
+	gGLState.mpBindBuffer(GL_ARRAY_BUFFER, this->aMaterialVBO);
+	glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(MaterialBlock), (GLvoid*)offsetof(MaterialBlock, aDiffuse));
+	glVertexAttribDivisor(7, 1);
+	glEnableVertexAttribArray(7);
+	glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(MaterialBlock), (GLvoid*)offsetof(MaterialBlock, aSpecular));
+	glVertexAttribDivisor(8, 1);
+	glEnableVertexAttribArray(8);
+}
+
+void MeshInstances::mpSetMaterials(const std::vector<MaterialBlock>& pMaterials)
+{
+	this->aMaterials = pMaterials;
+	this->aMaterialIndices.clear();
+	this->aMaterialCount = 0;
+}
+
+void MeshInstances::mpSetTransforms(const glm::mat4* pTransforms, const uint32_t* pIndices, size_t pCount)
+{
+	// Instances without a material are not drawn
+	size_t lCount = 0;
+	while (lCount < pCount && pIndices[lCount] < this->aMaterials.size())
+		lCount++;
+
+	this->aTransforms.resize(lCount);
+	for (size_t i = 0; i < lCount; i++)
+	{
+		const glm::mat4& lModel = pTransforms[pIndices[i]];
+		this->aTransforms[i].aModel = lModel;
+		this->aTransforms[i].aNormalMatrix = mfGetNormalMatrix(lModel);
+	}
+
+	// Orphan the previous storage so the upload does not wait for draws still reading it
+	size_t lBytes = this->aTransforms.size() * sizeof(InstanceTransform);
+	this->aTransformCount = (GLsizei)this->aTransforms.size();
+	gGLState.mpBindBuffer(GL_ARRAY_BUFFER, this->aTransformVBO);
+	glBufferData(GL_ARRAY_BUFFER, lBytes, nullptr, GL_STREAM_DRAW);
+	if (lBytes > 0)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, lBytes, &this->aTransforms[0]);
+
+	// The materials follow the instances, they only need to be gathered again when other instances are drawn
+	if (this->aMaterialIndices.size() == lCount && std::equal(pIndices, pIndices + lCount, this->aMaterialIndices.begin()))
+		return;
+
+	this->aMaterialIndices.assign(pIndices, pIndices + lCount);
+	this->aDrawnMaterials.resize(lCount);
+	for (size_t i = 0; i < lCount; i++)
+		this->aDrawnMaterials[i] = this->aMaterials[pIndices[i]];
+
+	this->aMaterialCount = (GLsizei)lCount;
+	gGLState.mpBindBuffer(GL_ARRAY_BUFFER, this->aMaterialVBO);
+	glBufferData(GL_ARRAY_BUFFER, lCount * sizeof(MaterialBlock), lCount == 0 ? nullptr : &this->aDrawnMaterials[0], GL_DYNAMIC_DRAW);
+}
+
+void MeshInstances::mpDraw() const
+{
+	GLsizei lCount = std::min(this->aTransformCount, this->aMaterialCount);
+	if (lCount == 0)
+		return;
+
+	gGLState.mpBindVertexArray(this->aVAO);
+	this->aMesh->mpDrawInstances(lCount);
+}
+
+void MeshInstances::mpDestroy()
+{
+	if (this->aVAO != 0)
+	{
+		gGLState.mpForgetVertexArray(this->aVAO);
+		gGLState.mpForgetBuffer(this->aTransformVBO);
+		gGLState.mpForgetBuffer(this->aMaterialVBO);
+		glDeleteVertexArrays(1, &this->aVAO);
+		glDeleteBuffers(1, &this->aTransformVBO);
+		glDeleteBuffers(1, &this->aMaterialVBO);
+		this->aVAO = this->aTransformVBO = this->aMaterialVBO = 0;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Material.h"
+#include "NormalMatrix.h"
+
+// Layout of the streamed per-instance transform, the normal matrix is derived from the model matrix on upload
+struct InstanceTransform
+{
+	glm::mat4 aModel;
+	glm::mat3 aNormalMatrix;
+};
+
+// Draws many copies of a mesh with one glDrawElementsInstanced. Every instance has its own model matrix and material,
+// read by lighting.vs (INSTANCED variant) as attributes 3-6 (model), 7 (diffuse, shininess), 8 (specular)
+// and 9-11 (normal matrix).
+// Only the instances listed in mpSetTransforms are drawn. Transforms are streamed every frame, materials are gathered
+// again only after they were set or when the list of drawn instances changed.
+class MeshInstances
+{
+public:
+	MeshInstances();
+	~MeshInstances();
+
+	void mpInit(const Mesh& pMesh);
+
+	void mpSetMaterials(const std::vector<MaterialBlock>& pMaterials);
+
+	// Instance i of the draw uses pTransforms[pIndices[i]] and material pIndices[i]
+	void mpSetTransforms(const glm::mat4* pTransforms, const uint32_t* pIndices, size_t pCount);
+
+	// Draws the instances of the last mpSetTransforms
+	void mpDraw() const;
+
+	GLuint mfGetVertexArray() const { return this->aVAO; }
+
+	void mpDestroy();
+
+private:
+	const Mesh* aMesh;
+	GLuint aVAO;
+	GLuint aTransformVBO;
+	GLuint aMaterialVBO;
+	GLsizei aTransformCount;
+	GLsizei aMaterialCount;
+	std::vector<InstanceTransform> aTransforms;
+	std::vector<MaterialBlock> aMaterials;
+	// Materials in the instance buffer, gathered for these indices
+	std::vector<MaterialBlock> aDrawnMaterials;
+	std::vector<uint32_t> aMaterialIndices;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+// Std. Includes
+#include <cmath>
+
+// GL Includes
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+// Transforms normals by the inverse transpose of the model matrix. Computed once per object (or instance) here instead of
+// for every vertex in lighting.vs. When the upper 3x3 is a rotation times a uniform scale s, its inverse transpose is the
+// matrix itself divided by s*s, so the inverse is only taken for non-uniform scales and shears.
+inline glm::mat3 mfGetNormalMatrix(const glm::mat4& pModel)
+{
+	glm::mat3 lLinear(pModel);
+
+	float lScale2 = glm::dot(lLinear[0], lLinear[0]);
+	float lTolerance = 1e-5f * lScale2;
+	bool lUniform = std::abs(glm::dot(lLinear[1], lLinear[1]) - lScale2) <= lTolerance
+		&& std::abs(glm::dot(lLinear[2], lLinear[2]) - lScale2) <= lTolerance
+		&& std::abs(glm::dot(lLinear[0], lLinear[1])) <= lTolerance
+		&& std::abs(glm::dot(lLinear[0], lLinear[2])) <= lTolerance
+		&& std::abs(glm::dot(lLinear[1], lLinear[2])) <= lTolerance;
+
+	if (!lUniform || lScale2 == 0.0f)
+		return glm::inverseTranspose(lLinear);
+
+	// Rotation and translation only, nothing to do
+	if (std::abs(lScale2 - 1.0f) <= 1e-5f)
+		return lLinear;
+
+	return lLinear * (1.0f / lScale2);
+}
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_USE_SSE2
+#endif
+
+#include "OcclusionCuller.h"
+
+// Clip space w below which a vertex counts as behind the camera
+static const float MIN_CLIP_W = 1e-5f;
+
+OcclusionCuller::OcclusionCuller() : aOccluderCount(0), aTestedCount(0), aOccludedCount(0), aRasterMs(0.0), aTestMs(0.0), aWaitMs(0.0),
+	aWidth(0), aHeight(0), aModels(nullptr), aMins(nullptr), aMaxs(nullptr), aRunning(false)
+{
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	gJobs.mpWait(this->aJob);
+}
+
+void OcclusionCuller::mpInit(unsigned int pWidth, unsigned int pHeight)
+{
+	this->aWidth = std::max(4u, (pWidth + 3) & ~3u);
+	this->aHeight = std::max(1u, pHeight);
+
+	this->aLevels.clear();
+	this->aLevelSizes.clear();
+	glm::uvec2 lSize(this->aWidth, this->aHeight);
+	while (true)
+	{
+		this->aLevels.push_back(std::vector<float>(lSize.x * lSize.y, 1.0f));
+		this->aLevelSizes.push_back(lSize);
+		if (lSize.x == 1 && lSize.y == 1)
+			break;
+		lSize = (lSize + 1u) / 2u;
+	}
+}
+
+void OcclusionCuller::mpSetOccluderMesh(const std::vector<glm::vec3>& pPositions, const std::vector<uint32_t>& pIndices)
+{
+	this->aMeshPositions = pPositions;
+	this->aMeshIndices = pIndices;
+	this->aClipPositions.resize(pPositions.size());
+}
+
+void OcclusionCuller::mpBeginCull(const glm::mat4& pViewProjection, const glm::mat4* pModels, const glm::vec3* pMins, const glm::vec3* pMaxs,
+	const std::vector<uint32_t>& pCandidates)
+{
+	gJobs.mpWait(this->aJob);
+
+	this->aViewProjection = pViewProjection;
+	this->aModels = pModels;
+	this->aMins = pMins;
+	this->aMaxs = pMaxs;
+	this->aCandidates = pCandidates;
+	this->aRunning = true;
+	gJobs.mpRun([this]() { this->mpRun(); }, &this->aJob);
+}
+
+void OcclusionCuller::mpFinishCull(std::vector<uint32_t>& pVisible)
+{
+	if (!this->aRunning)
+		return;
+
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+	gJobs.mpWait(this->aJob);
+	this->aRunning = false;
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aWaitMs = lElapsed.count();
+
+	pVisible.clear();
+	for (size_t i = 0; i < this->aCandidates.size(); i++)
+	{
+		if (!this->aOccluded[i])
+			pVisible.push_back(this->aCandidates[i]);
+	}
+}
+
+void OcclusionCuller::mpRun()
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+	size_t lCount = this->aCandidates.size();
+	this->aOccluded.assign(lCount, 0);
+
+	// The candidates whose bounding sphere looks largest from the camera occlude the most
+	std::vector<std::pair<float, uint32_t> > lSizes(lCount);
+	for (size_t i = 0; i < lCount; i++)
+	{
+		uint32_t lCandidate = this->aCandidates[i];
+		glm::vec3 lCenter = (this->aMins[lCandidate] + this->aMaxs[lCandidate]) * 0.5f;
+		float lRadius = glm::length(this->aMaxs[lCandidate] - this->aMins[lCandidate]) * 0.5f;
+		float lW = (this->aViewProjection * glm::vec4(lCenter, 1.0f)).w;
+		lSizes[i] = std::make_pair(lRadius / std::max(lW, MIN_CLIP_W), (uint32_t)i);
+	}
+	size_t lOccluderCount = std::min((size_t)MAX_OCCLUDERS, lCount);
+	std::nth_element(lSizes.begin(), lSizes.begin() + lOccluderCount, lSizes.end(), std::greater<std::pair<float, uint32_t> >());
+
+	std::vector<float>& lDepth = this->aLevels[0];
+	std::fill(lDepth.begin(), lDepth.end(), 1.0f);
+	for (size_t o = 0; o < lOccluderCount; o++)
+	{
+		glm::mat4 lModelViewProjection = this->aViewProjection * this->aModels[this->aCandidates[lSizes[o].second]];
+		for (size_t v = 0; v < this->aMeshPositions.size(); v++)
+			this->aClipPositions[v] = lModelViewProjection * glm::vec4(this->aMeshPositions[v], 1.0f);
+		for (size_t q = 0; q + 3 < this->aMeshIndices.size(); q += 4)
+		{
+			glm::vec4 lCorners[4];
+			for (int i = 0; i < 4; i++)
+				lCorners[i] = this->aClipPositions[this->aMeshIndices[q + i]];
+			this->mpRasterizeQuad(lCorners);
+		}
+	}
+	this->mpBuildPyramid();
+
+	std::chrono::high_resolution_clock::time_point lTestStart = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double, std::milli> lElapsed = lTestStart - lStart;
+	this->aRasterMs = lElapsed.count();
+
+	// Occluders are tested as well, a pixel they cover holds a depth no nearer than their own box, so only other
+	// occluders can hide them
+	unsigned int lOccluded = 0;
+	for (size_t i = 0; i < lCount; i++)
+	{
+		uint32_t lCandidate = this->aCandidates[i];
+		if (this->mfIsBoxOccluded(this->aMins[lCandidate], this->aMaxs[lCandidate]))
+		{
+			this->aOccluded[i] = 1;
+			lOccluded++;
+		}
+	}
+
+	this->aOccluderCount = (unsigned int)lOccluderCount;
+	this->aTestedCount = (unsigned int)lCount;
+	this->aOccludedCount = lOccluded;
+	lElapsed = std::chrono::high_resolution_clock::now() - lTestStart;
+	this->aTestMs = lElapsed.count();
+}
+
+void OcclusionCuller::mpRasterizeQuad(const glm::vec4* pCorners)
+{
+	// Quads reaching past the near plane are skipped rather than clipped, they only ever occlude less
+	glm::vec3 lViewport((float)this->aWidth, (float)this->aHeight, 1.0f);
+	glm::vec3 lPoints[5];
+	for (int i = 0; i < 4; i++)
+	{
+		const glm::vec4& lClip = pCorners[i];
+		if (lClip.w < MIN_CLIP_W || lClip.z < -lClip.w)
+			return;
+		lPoints[i] = (glm::vec3(lClip) / lClip.w * 0.5f + 0.5f) * lViewport;
+	}
+
+	// Counter clockwise from here on, so inside points have all edge functions positive
+	float lArea = 0.0f;
+	for (int i = 0; i < 4; i++)
+		lArea += lPoints[i].x * lPoints[(i + 1) & 3].y - lPoints[(i + 1) & 3].x * lPoints[i].y;
+	if (std::abs(lArea) < 1e-6f)
+		return;
+	if (lArea < 0.0f)
+		std::swap(lPoints[1], lPoints[3]);
+	lPoints[4] = lPoints[0];
+
+	glm::vec2 lMin(FLT_MAX), lMax(-FLT_MAX);
+	for (int i = 0; i < 4; i++)
+	{
+		lMin = glm::min(lMin, glm::vec2(lPoints[i]));
+		lMax = glm::max(lMax, glm::vec2(lPoints[i]));
+	}
+	int lX0 = std::max(0, (int)std::floor(lMin.x));
+	int lX1 = std::min((int)this->aWidth - 1, (int)std::floor(lMax.x));
+	int lY0 = std::max(0, (int)std::floor(lMin.y));
+	int lY1 = std::min((int)this->aHeight - 1, (int)std::floor(lMax.y));
+	if (lX0 > lX1 || lY0 > lY1)
+		return;
+	lX0 &= ~3;
+
+	// Edge i is E(x, y) = lEdgeA[i] * x + lEdgeB[i] * y + lEdgeC[i]. A pixel is fully covered when E at its center is at
+	// least half the edge's step across the pixel, lThresholds, for all four edges. A repeated corner makes an edge of
+	// length 0 that accepts every pixel.
+	float lEdgeA[4], lEdgeB[4], lEdgeC[4], lThresholds[4];
+	for (int i = 0; i < 4; i++)
+	{
+		const glm::vec3& lP0 = lPoints[i];
+		const glm::vec3& lP1 = lPoints[i + 1];
+		lEdgeA[i] = lP0.y - lP1.y;
+		lEdgeB[i] = lP1.x - lP0.x;
+		lEdgeC[i] = -lEdgeA[i] * lP0.x - lEdgeB[i] * lP0.y;
+		lThresholds[i] = (std::abs(lEdgeA[i]) + std::abs(lEdgeB[i])) * 0.5f;
+	}
+
+	// Depth is affine in window space, the plane is fitted to the larger of the two triangles the quad splits into.
+	// Each pixel stores the farthest depth the quad has inside it.
+	const glm::vec3& lA = lPoints[0];
+	float lAreaB = (lPoints[1].x - lA.x) * (lPoints[2].y - lA.y) - (lPoints[1].y - lA.y) * (lPoints[2].x - lA.x);
+	float lAreaD = (lPoints[2].x - lA.x) * (lPoints[3].y - lA.y) - (lPoints[2].y - lA.y) * (lPoints[3].x - lA.x);
+	const glm::vec3& lB = std::abs(lAreaB) >= std::abs(lAreaD) ? lPoints[1] : lPoints[2];
+	const glm::vec3& lC = std::abs(lAreaB) >= std::abs(lAreaD) ? lPoints[2] : lPoints[3];
+	float lPlaneArea = std::abs(lAreaB) >= std::abs(lAreaD) ? lAreaB : lAreaD;
+	float lDzDx = ((lB.z - lA.z) * (lC.y - lA.y) - (lC.z - lA.z) * (lB.y - lA.y)) / lPlaneArea;
+	float lDzDy = ((lC.z - lA.z) * (lB.x - lA.x) - (lB.z - lA.z) * (lC.x - lA.x)) / lPlaneArea;
+	float lDepthC = lA.z - lDzDx * lA.x - lDzDy * lA.y + (std::abs(lDzDx) + std::abs(lDzDy)) * 0.5f;
+
+	float* lDepth = &this->aLevels[0][0];
+	for (int y = lY0; y <= lY1; y++)
+	{
+		float lCenterY = y + 0.5f;
+		float* lRow = lDepth + y * this->aWidth;
+#ifdef OCCLUSION_USE_SSE2
+		__m128 lCenterX = _mm_add_ps(_mm_set1_ps(lX0 + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+		__m128 lStep = _mm_set1_ps(4.0f);
+		__m128 lRowC[4];
+		for (int i = 0; i < 4; i++)
+			lRowC[i] = _mm_set1_ps(lEdgeB[i] * lCenterY + lEdgeC[i] - lThresholds[i]);
+		__m128 lRowDepth = _mm_set1_ps(lDzDy * lCenterY + lDepthC);
+
+		for (int x = lX0; x <= lX1; x += 4)
+		{
+			__m128 lInside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(lEdgeA[0]), lCenterX), lRowC[0]), _mm_setzero_ps());
+			for (int i = 1; i < 4; i++)
+				lInside = _mm_and_ps(lInside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(lEdgeA[i]), lCenterX), lRowC[i]), _mm_setzero_ps()));
+			if (_mm_movemask_ps(lInside) != 0)
+			{
+				__m128 lOld = _mm_loadu_ps(lRow + x);
+				__m128 lNew = _mm_min_ps(lOld, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(lDzDx), lCenterX), lRowDepth));
+				_mm_storeu_ps(lRow + x, _mm_or_ps(_mm_and_ps(lInside, lNew), _mm_andnot_ps(lInside, lOld)));
+			}
+			lCenterX = _mm_add_ps(lCenterX, lStep);
+		}
+#else
+		for (int x = lX0; x <= lX1; x++)
+		{
+			float lCenterX = x + 0.5f;
+			bool lInside = true;
+			for (int i = 0; i < 4 && lInside; i++)
+				lInside = lEdgeA[i] * lCenterX + lEdgeB[i] * lCenterY + lEdgeC[i] >= lThresholds[i];
+			if (lInside)
+				lRow[x] = std::min(lRow[x], lDzDx * lCenterX + lDzDy * lCenterY + lDepthC);
+		}
+#endif
+	}
+}
+
+void OcclusionCuller::mpBuildPyramid()
+{
+	for (size_t l = 1; l < this->aLevels.size(); l++)
+	{
+		const std::vector<float>& lBelow = this->aLevels[l - 1];
+		std::vector<float>& lLevel = this->aLevels[l];
+		glm::uvec2 lBelowSize = this->aLevelSizes[l - 1];
+		glm::uvec2 lSize = this->aLevelSizes[l];
+		for (unsigned int y = 0; y < lSize.y; y++)
+		{
+			// Odd sizes repeat the last row or column of the level below
+			unsigned int lY0 = y * 2, lY1 = std::min(y * 2 + 1, lBelowSize.y - 1);
+			for (unsigned int x = 0; x < lSize.x; x++)
+			{
+				unsigned int lX0 = x * 2, lX1 = std::min(x * 2 + 1, lBelowSize.x - 1);
+				lLevel[y * lSize.x + x] = std::max(std::max(lBelow[lY0 * lBelowSize.x + lX0], lBelow[lY0 * lBelowSize.x + lX1]),
+					std::max(lBelow[lY1 * lBelowSize.x + lX0], lBelow[lY1 * lBelowSize.x + lX1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::mfIsBoxOccluded(const glm::vec3& pMin, const glm::vec3& pMax) const
+{
+	// Screen rectangle and nearest depth of the box, boxes reaching behind the camera are never occluded
+	glm::vec2 lRectMin(FLT_MAX), lRectMax(-FLT_MAX);
+	float lNearest = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 lCorner((i & 1) ? pMax.x : pMin.x, (i & 2) ? pMax.y : pMin.y, (i & 4) ? pMax.z : pMin.z);
+		glm::vec4 lClip = this->aViewProjection * glm::vec4(lCorner, 1.0f);
+		if (lClip.w < MIN_CLIP_W)
+			return false;
+
+		glm::vec3 lWindow = glm::vec3(lClip) / lClip.w * 0.5f + 0.5f;
+		lRectMin = glm::min(lRectMin, glm::vec2(lWindow));
+		lRectMax = glm::max(lRectMax, glm::vec2(lWindow));
+		lNearest = std::min(lNearest, lWindow.z);
+	}
+	if (lNearest <= 0.0f)
+		return false;
+
+	lRectMin *= glm::vec2((float)this->aWidth, (float)this->aHeight);
+	lRectMax *= glm::vec2((float)this->aWidth, (float)this->aHeight);
+	if (lRectMax.x < 0.0f || lRectMax.y < 0.0f || lRectMin.x >= this->aWidth || lRectMin.y >= this->aHeight)
+		return false;
+	int lX0 = std::max(0, (int)lRectMin.x);
+	int lY0 = std::max(0, (int)lRectMin.y);
+	int lX1 = std::min((int)this->aWidth - 1, (int)lRectMax.x);
+	int lY1 = std::min((int)this->aHeight - 1, (int)lRectMax.y);
+
+	// The finest level where the rectangle spans at most 4x4 texels
+	size_t lLevel = 0;
+	while (lLevel + 1 < this->aLevels.size() && ((lX1 >> lLevel) - (lX0 >> lLevel) > 3 || (lY1 >> lLevel) - (lY0 >> lLevel) > 3))
+		lLevel++;
+
+	const std::vector<float>& lDepth = this->aLevels[lLevel];
+	unsigned int lWidth = this->aLevelSizes[lLevel].x;
+	for (int y = lY0 >> lLevel; y <= lY1 >> lLevel; y++)
+	{
+		for (int x = lX0 >> lLevel; x <= lX1 >> lLevel; x++)
+		{
+			if (lDepth[y * lWidth + x] >= lNearest)
+				return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <vector>
+
+// GL Includes
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+
+// Software occlusion culling. The candidates that cover the most screen space are rasterized as occluders into a small
+// depth buffer, a pyramid of its farthest depths is built, and every candidate whose box lies behind the farthest
+// occluder depth over its screen rectangle is culled. Rasterization is conservative: only pixels an occluder covers
+// completely are written, with the farthest depth it has inside them, so nothing that is visible in the full
+// resolution image gets culled.
+// The work runs as a job on gJobs between mpBeginCull and mpFinishCull, the caller does other work meanwhile.
+class OcclusionCuller
+{
+public:
+	// Counters of the last cull, and the time the job took and the caller waited for it
+	unsigned int aOccluderCount;
+	unsigned int aTestedCount;
+	unsigned int aOccludedCount;
+	double aRasterMs;
+	double aTestMs;
+	double aWaitMs;
+
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	// Depth buffer size, the width is rounded up to a multiple of 4
+	void mpInit(unsigned int pWidth, unsigned int pHeight);
+
+	// Planar convex quads in local space, four indices each, the shape drawn for every occluder. A triangle repeats its
+	// last index. Quads rather than triangles because a pixel on the diagonal of a face is covered by neither of its
+	// triangles alone. Candidates' boxes must enclose the shape.
+	void mpSetOccluderMesh(const std::vector<glm::vec3>& pPositions, const std::vector<uint32_t>& pIndices);
+
+	// Starts culling the candidates, indices into pModels and the world box arrays. The arrays must stay unchanged
+	// until mpFinishCull.
+	void mpBeginCull(const glm::mat4& pViewProjection, const glm::mat4* pModels, const glm::vec3* pMins, const glm::vec3* pMaxs,
+		const std::vector<uint32_t>& pCandidates);
+
+	// Waits for the job and replaces pVisible with the candidates that are not occluded, in their original order
+	void mpFinishCull(std::vector<uint32_t>& pVisible);
+
+private:
+	// Candidates rasterized as occluders per cull
+	static const unsigned int MAX_OCCLUDERS = 32;
+
+	unsigned int aWidth;
+	unsigned int aHeight;
+	std::vector<glm::vec3> aMeshPositions;
+	std::vector<uint32_t> aMeshIndices;
+
+	// Level 0 is the rasterized depth buffer, every further level holds the farthest depth of 2x2 texels of the one
+	// below. Window space depth, 1 is the far plane.
+	std::vector<std::vector<float> > aLevels;
+	std::vector<glm::uvec2> aLevelSizes;
+
+	// Input and output of the running cull
+	glm::mat4 aViewProjection;
+	const glm::mat4* aModels;
+	const glm::vec3* aMins;
+	const glm::vec3* aMaxs;
+	std::vector<uint32_t> aCandidates;
+	std::vector<uint8_t> aOccluded;
+	std::vector<glm::vec4> aClipPositions;
+	JobCounter aJob;
+	bool aRunning;
+
+	void mpRun();
+	void mpRasterizeQuad(const glm::vec4* pCorners);
+	void mpBuildPyramid();
+	bool mfIsBoxOccluded(const glm::vec3& pMin, const glm::vec3& pMax) const;
+};
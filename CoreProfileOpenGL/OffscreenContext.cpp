@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <fstream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "OffscreenContext.h"
+
+OffscreenContext::OffscreenContext() : aDisplay(nullptr), aContext(nullptr), aWindow(nullptr), aWidth(0), aHeight(0), aFramebuffer(0), aColorBuffer(0), aDepthBuffer(0)
+{
+}
+
+OffscreenContext::~OffscreenContext()
+{
+	mpDestroy();
+}
+
+#ifndef _WIN32
+
+bool OffscreenContext::mfCreateContext()
+{
+	// Prefer the surfaceless platform so no X11/Wayland connection is needed at all
+	EGLDisplay lDisplay = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC lGetPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (lGetPlatformDisplay != nullptr)
+		lDisplay = lGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (lDisplay == EGL_NO_DISPLAY)
+		lDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint lMajor, lMinor;
+	if (lDisplay == EGL_NO_DISPLAY || !eglInitialize(lDisplay, &lMajor, &lMinor))
+	{
+		printf("Failed to initialize EGL\n");
+		return false;
+	}
+	this->aDisplay = lDisplay;
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		printf("EGL implementation does not support desktop OpenGL\n");
+		return false;
+	}
+
+	// The surfaceless platform may expose no configs at all, in which case EGL_KHR_no_config_context is used
+	const EGLint lConfigAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig lConfig = EGL_NO_CONFIG_KHR;
+	EGLint lConfigCount = 0;
+	if (!eglChooseConfig(lDisplay, lConfigAttribs, &lConfig, 1, &lConfigCount) || lConfigCount == 0)
+		lConfig = EGL_NO_CONFIG_KHR;
+
+	const EGLint lContextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext lContext = eglCreateContext(lDisplay, lConfig, EGL_NO_CONTEXT, lContextAttribs);
+	if (lContext == EGL_NO_CONTEXT)
+	{
+		printf("Failed to create an OpenGL 3.3 core EGL context (0x%x)\n", eglGetError());
+		return false;
+	}
+	this->aContext = lContext;
+
+	if (!eglMakeCurrent(lDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, lContext))
+	{
+		printf("Failed to make the EGL context current (0x%x)\n", eglGetError());
+		return false;
+	}
+
+	return true;
+}
+
+#else
+
+bool OffscreenContext::mfCreateContext()
+{
+	if (!glfwInit())
+		return false;
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+	this->aWindow = glfwCreateWindow(1, 1, "Headless", nullptr, nullptr);
+	if (this->aWindow == nullptr)
+	{
+		printf("Failed to create hidden GLFW window\n");
+		glfwTerminate();
+		return false;
+	}
+
+	glfwMakeContextCurrent(this->aWindow);
+	return true;
+}
+
+#endif
+
+bool OffscreenContext::mfCreateFramebuffer(GLuint pWidth, GLuint pHeight)
+{
+	this->aWidth = pWidth;
+	this->aHeight = pHeight;
+
+	glGenRenderbuffers(1, &this->aColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->aColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, pWidth, pHeight);
+
+	glGenRenderbuffers(1, &this->aDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->aDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, pWidth, pHeight);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &this->aFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->aFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->aColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->aDepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Offscreen framebuffer is incomplete\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool OffscreenContext::mfWritePpm(const char* pPath)
+{
+	std::vector<unsigned char> lPixels(this->aWidth * this->aHeight * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, this->aWidth, this->aHeight, GL_RGB, GL_UNSIGNED_BYTE, &lPixels[0]);
+
+	std::ofstream lFile(pPath, std::ios::out | std::ios::binary);
+	if (!lFile.is_open())
+		return false;
+
+	// GL rows start at the bottom, PPM rows at the top
+	lFile << "P6\n" << this->aWidth << " " << this->aHeight << "\n255\n";
+	for (GLuint y = 0; y < this->aHeight; y++)
+		lFile.write((const char*)&lPixels[(this->aHeight - 1 - y) * this->aWidth * 3], this->aWidth * 3);
+
+	lFile.close();
+	return !lFile.fail();
+}
+
+void OffscreenContext::mpDestroy()
+{
+	if (this->aFramebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &this->aFramebuffer);
+		glDeleteRenderbuffers(1, &this->aColorBuffer);
+		glDeleteRenderbuffers(1, &this->aDepthBuffer);
+		this->aFramebuffer = this->aColorBuffer = this->aDepthBuffer = 0;
+	}
+
+#ifndef _WIN32
+	if (this->aDisplay != nullptr)
+	{
+		eglMakeCurrent(this->aDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (this->aContext != nullptr)
+			eglDestroyContext(this->aDisplay, this->aContext);
+		eglTerminate(this->aDisplay);
+		this->aDisplay = this->aContext = nullptr;
+	}
+#else
+	if (this->aWindow != nullptr)
+	{
+		glfwDestroyWindow(this->aWindow);
+		glfwTerminate();
+		this->aWindow = nullptr;
+	}
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GL/glew.h>
+
+struct GLFWwindow;
+
+// A GL 3.3 core context that does not need a display, plus the framebuffer the scene is rendered into.
+// On Linux the context comes from EGL on the surfaceless platform, which Mesa's llvmpipe supports
+// on machines without a GPU or X server. Elsewhere a hidden GLFW window provides the context.
+class OffscreenContext
+{
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	// Creates the context and makes it current. Call before glewInit.
+	bool mfCreateContext();
+
+	// Creates the color + depth framebuffer and leaves it bound. Needs GLEW to be initialized.
+	bool mfCreateFramebuffer(GLuint pWidth, GLuint pHeight);
+
+	// Reads back the framebuffer and stores it as a binary PPM, used to compare headless runs
+	bool mfWritePpm(const char* pPath);
+
+	void mpDestroy();
+
+private:
+	void* aDisplay;
+	void* aContext;
+	GLFWwindow* aWindow;
+
+	GLuint aWidth;
+	GLuint aHeight;
+	GLuint aFramebuffer;
+	GLuint aColorBuffer;
+	GLuint aDepthBuffer;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// Std. Includes
+#include <thread>
+
+#include "JobSystem.h"
+
+// Splits [0, pCount) into pThreadCount contiguous ranges and calls pFunction(begin, end) for each of them as jobs on
+// gJobs. The last range runs on the calling thread, which then helps with the others and returns once every range is
+// done.
+template <typename Function>
+void mpParallelFor(unsigned int pCount, unsigned int pThreadCount, Function pFunction)
+{
+	if (pThreadCount > pCount)
+		pThreadCount = pCount;
+	if (pThreadCount <= 1)
+	{
+		if (pCount > 0)
+			pFunction(0u, pCount);
+		return;
+	}
+
+	JobCounter lCounter;
+	unsigned int lBegin = 0;
+	for (unsigned int i = 0; i < pThreadCount - 1; i++)
+	{
+		unsigned int lEnd = (unsigned int)(((unsigned long long)pCount * (i + 1)) / pThreadCount);
+		gJobs.mpRun([&pFunction, lBegin, lEnd]() { pFunction(lBegin, lEnd); }, &lCounter);
+		lBegin = lEnd;
+	}
+
+	pFunction(lBegin, pCount);
+	gJobs.mpWait(lCounter);
+}
+
+// Number of worker threads to use when the user did not ask for a specific count
+inline unsigned int mfGetDefaultThreadCount()
+{
+	unsigned int lCount = std::thread::hardware_concurrency();
+	return lCount > 0 ? lCount : 1;
+}
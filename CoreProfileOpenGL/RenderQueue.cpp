@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "RenderQueue.h"
+
+RenderQueue::RenderQueue() : aSortMs(0.0), aLaneCount(0), aHistograms(MAX_DIGITS << RADIX_BITS)
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+uint64_t RenderQueue::mfMakeKey(unsigned int pPass, size_t pProgram, unsigned int pMaterial, GLuint pVertexArray, float pDepth, float pFarPlane)
+{
+	const uint64_t lDepthMax = (1ull << KEY_DEPTH_BITS) - 1;
+	float lDepth = glm::clamp(pDepth / pFarPlane, 0.0f, 1.0f);
+
+	uint64_t lKey = pPass & ((1u << KEY_PASS_BITS) - 1);
+	lKey = (lKey << KEY_PROGRAM_BITS) | (pProgram & ((1u << KEY_PROGRAM_BITS) - 1));
+	lKey = (lKey << KEY_MATERIAL_BITS) | (pMaterial & ((1u << KEY_MATERIAL_BITS) - 1));
+	lKey = (lKey << KEY_VERTEX_ARRAY_BITS) | (pVertexArray & ((1u << KEY_VERTEX_ARRAY_BITS) - 1));
+	lKey = (lKey << KEY_DEPTH_BITS) | (uint64_t)(lDepth * lDepthMax);
+	return lKey;
+}
+
+void RenderQueue::mpClear(unsigned int pLaneCount)
+{
+	// Lanes beyond the count are kept for their capacity
+	this->aLaneCount = std::max(1u, pLaneCount);
+	if (this->aLanes.size() < this->aLaneCount)
+		this->aLanes.resize(this->aLaneCount);
+	for (size_t i = 0; i < this->aLanes.size(); i++)
+	{
+		this->aLanes[i].aKeys.clear();
+		this->aLanes[i].aItems.clear();
+	}
+
+	this->aItems.clear();
+	this->aEntries.clear();
+	this->aOrder.clear();
+}
+
+void RenderQueue::mpSubmit(unsigned int pLane, uint64_t pKey, const RenderItem& pItem)
+{
+	Lane& lLane = this->aLanes[pLane];
+	lLane.aKeys.push_back(pKey);
+	lLane.aItems.push_back(pItem);
+}
+
+// One LSD pass per digit over values whose digit d is (pKeyOf(value) >> pShifts[d]) & mask, counted beforehand into
+// pHistograms. Ping-pongs between the two arrays and returns the one holding the result.
+template <typename T, typename KeyOf>
+static T* mfRadixPasses(T* pValues, T* pScratch, size_t pCount, const unsigned int* pShifts, unsigned int pDigitCount,
+	unsigned int pRadixBits, uint32_t* pHistograms, KeyOf pKeyOf)
+{
+	const uint64_t lDigitMask = (1u << pRadixBits) - 1;
+	for (unsigned int d = 0; d < pDigitCount; d++)
+	{
+		uint32_t* lHistogram = pHistograms + (d << pRadixBits);
+		uint32_t lOffset = 0;
+		for (uint32_t i = 0; i <= lDigitMask; i++)
+		{
+			uint32_t lBucket = lHistogram[i];
+			lHistogram[i] = lOffset;
+			lOffset += lBucket;
+		}
+
+		unsigned int lShift = pShifts[d];
+		for (size_t i = 0; i < pCount; i++)
+			pScratch[lHistogram[(pKeyOf(pValues[i]) >> lShift) & lDigitMask]++] = pValues[i];
+
+		T* lSwap = pValues;
+		pValues = pScratch;
+		pScratch = lSwap;
+	}
+	return pValues;
+}
+
+// Builds the compact key of every entry from the varying bit runs and counts its DIGITS digits. The compact key is
+// packed above the item index into pPacked, or replaces the entry's key when pPacked is null. The digit count is a
+// template argument so the counting loop is unrolled.
+template <unsigned int DIGITS>
+static void mpGatherKeys(RenderQueue::SortEntry* pEntries, uint64_t* pPacked, size_t pCount, const unsigned int* pRunShifts,
+	const uint64_t* pRunMasks, const unsigned int* pRunPositions, unsigned int pIndexBits, uint32_t* pHistograms)
+{
+	const unsigned int lRadixBits = RenderQueue::RADIX_BITS;
+	const uint64_t lDigitMask = (1u << lRadixBits) - 1;
+	for (size_t i = 0; i < pCount; i++)
+	{
+		uint64_t lKey = pEntries[i].aKey;
+		uint64_t lCompact = 0;
+		for (unsigned int r = 0; r < RenderQueue::MAX_RUNS; r++)
+			lCompact |= ((lKey >> pRunShifts[r]) & pRunMasks[r]) << pRunPositions[r];
+		for (unsigned int d = 0; d < DIGITS; d++)
+			pHistograms[(d << lRadixBits) + ((lCompact >> (d * lRadixBits)) & lDigitMask)]++;
+
+		if (pPacked != nullptr)
+			pPacked[i] = (lCompact << pIndexBits) | pEntries[i].aItem;
+		else
+			pEntries[i].aKey = lCompact;
+	}
+}
+
+// LSD radix sort on the bits that differ between the keys of the frame. Those bits are gathered into a compact key
+// first, so unused fields, a single program or a single mesh cost no pass at all. When the compact key and the item
+// index fit in 64 bits they are packed into one word, halving the memory every pass moves. Stable, equal keys keep
+// their submission order.
+void RenderQueue::mpSort()
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	// Merge the lanes, in lane order so equal keys keep the order they would have had recorded by one thread
+	size_t lCount = 0;
+	for (unsigned int l = 0; l < this->aLaneCount; l++)
+		lCount += this->aLanes[l].aKeys.size();
+	this->aEntries.resize(lCount);
+	this->aItems.resize(lCount);
+	size_t lOffset = 0;
+	for (unsigned int l = 0; l < this->aLaneCount; l++)
+	{
+		const Lane& lLane = this->aLanes[l];
+		for (size_t i = 0; i < lLane.aKeys.size(); i++)
+		{
+			this->aEntries[lOffset + i].aKey = lLane.aKeys[i];
+			this->aEntries[lOffset + i].aItem = (uint32_t)(lOffset + i);
+		}
+		if (!lLane.aItems.empty())
+			memcpy(&this->aItems[lOffset], &lLane.aItems[0], lLane.aItems.size() * sizeof(RenderItem));
+		lOffset += lLane.aKeys.size();
+	}
+	this->aOrder.resize(lCount);
+
+	uint64_t lAllSet = ~0ull, lAnySet = 0;
+	for (size_t i = 0; i < lCount; i++)
+	{
+		lAllSet &= this->aEntries[i].aKey;
+		lAnySet |= this->aEntries[i].aKey;
+	}
+	uint64_t lVarying = lAnySet & ~lAllSet;
+
+	// Runs of consecutive varying bits, usually one per key field that changes. Past MAX_RUNS the closest runs are
+	// merged, the constant bits between them only widen the compact key.
+	unsigned int lRunShifts[64];
+	unsigned int lRunWidths[64];
+	unsigned int lRunCount = 0;
+	for (unsigned int lBit = 0; lBit < 64 && (lVarying >> lBit) != 0; )
+	{
+		while (((lVarying >> lBit) & 1) == 0)
+			lBit++;
+		unsigned int lWidth = 0;
+		while (lBit + lWidth < 64 && ((lVarying >> (lBit + lWidth)) & 1) != 0)
+			lWidth++;
+
+		lRunShifts[lRunCount] = lBit;
+		lRunWidths[lRunCount] = lWidth;
+		lRunCount++;
+		lBit += lWidth;
+	}
+	while (lRunCount > MAX_RUNS)
+	{
+		unsigned int lClosest = 0;
+		for (unsigned int r = 1; r + 1 < lRunCount; r++)
+		{
+			if (lRunShifts[r + 1] - lRunShifts[r] - lRunWidths[r] < lRunShifts[lClosest + 1] - lRunShifts[lClosest] - lRunWidths[lClosest])
+				lClosest = r;
+		}
+		lRunWidths[lClosest] = lRunShifts[lClosest + 1] + lRunWidths[lClosest + 1] - lRunShifts[lClosest];
+		for (unsigned int r = lClosest + 1; r + 1 < lRunCount; r++)
+		{
+			lRunShifts[r] = lRunShifts[r + 1];
+			lRunWidths[r] = lRunWidths[r + 1];
+		}
+		lRunCount--;
+	}
+
+	// Unused runs extract nothing
+	uint64_t lRunMasks[MAX_RUNS];
+	unsigned int lRunPositions[MAX_RUNS];
+	unsigned int lCompactBits = 0;
+	for (unsigned int r = 0; r < MAX_RUNS; r++)
+	{
+		if (r >= lRunCount)
+			lRunShifts[r] = lRunWidths[r] = 0;
+		lRunMasks[r] = lRunWidths[r] == 64 ? ~0ull : (1ull << lRunWidths[r]) - 1;
+		lRunPositions[r] = lCompactBits;
+		lCompactBits += lRunWidths[r];
+	}
+
+	unsigned int lIndexBits = 1;
+	while (lIndexBits < 32 && (1ull << lIndexBits) < lCount)
+		lIndexBits++;
+
+	bool lPacked = lCompactBits + lIndexBits <= 64;
+	unsigned int lKeyShift = lPacked ? lIndexBits : 0;
+	unsigned int lDigitCount = (lCompactBits + RADIX_BITS - 1) / RADIX_BITS;
+	unsigned int lShifts[MAX_DIGITS];
+	for (unsigned int d = 0; d < lDigitCount; d++)
+		lShifts[d] = lKeyShift + d * RADIX_BITS;
+
+	uint32_t* lHistograms = &this->aHistograms[0];
+	memset(lHistograms, 0, (lDigitCount << RADIX_BITS) * sizeof(uint32_t));
+
+	// Gather the compact keys and count every digit in the same sweep
+	this->aPacked.resize(lPacked ? lCount : 0);
+	SortEntry* lEntries = lCount > 0 ? &this->aEntries[0] : nullptr;
+	uint64_t* lPackedKeys = lPacked && lCount > 0 ? &this->aPacked[0] : nullptr;
+	switch (lDigitCount)
+	{
+	case 0:	break;
+	case 1:	mpGatherKeys<1>(lEntries, lPackedKeys, lCount, lRunShifts, lRunMasks, lRunPositions, lIndexBits, lHistograms); break;
+	case 2:	mpGatherKeys<2>(lEntries, lPackedKeys, lCount, lRunShifts, lRunMasks, lRunPositions, lIndexBits, lHistograms); break;
+	case 3:	mpGatherKeys<3>(lEntries, lPackedKeys, lCount, lRunShifts, lRunMasks, lRunPositions, lIndexBits, lHistograms); break;
+	case 4:	mpGatherKeys<4>(lEntries, lPackedKeys, lCount, lRunShifts, lRunMasks, lRunPositions, lIndexBits, lHistograms); break;
+	case 5:	mpGatherKeys<5>(lEntries, lPackedKeys, lCount, lRunShifts, lRunMasks, lRunPositions, lIndexBits, lHistograms); break;
+	default: mpGatherKeys<6>(lEntries, lPackedKeys, lCount, lRunShifts, lRunMasks, lRunPositions, lIndexBits, lHistograms); break;
+	}
+
+	if (lCount > 0 && lPacked)
+	{
+		this->aPackedScratch.resize(lCount);
+		uint64_t* lSorted = mfRadixPasses(&this->aPacked[0], &this->aPackedScratch[0], lCount, lShifts, lDigitCount, RADIX_BITS, lHistograms,
+			[](uint64_t pValue) { return pValue; });
+
+		const uint64_t lIndexMask = (1ull << lIndexBits) - 1;
+		for (size_t i = 0; i < lCount; i++)
+			this->aOrder[i] = (uint32_t)(lSorted[i] & lIndexMask);
+	}
+	else if (lCount > 0)
+	{
+		this->aScratch.resize(lCount);
+		SortEntry* lSorted = mfRadixPasses(&this->aEntries[0], &this->aScratch[0], lCount, lShifts, lDigitCount, RADIX_BITS, lHistograms,
+			[](const SortEntry& pEntry) { return pEntry.aKey; });
+
+		for (size_t i = 0; i < lCount; i++)
+			this->aOrder[i] = lSorted[i].aItem;
+	}
+
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aSortMs = lElapsed.count();
+}
+
+size_t RenderQueue::mfSize() const
+{
+	return this->aEntries.size();
+}
+
+const RenderItem& RenderQueue::mfGet(size_t pIndex) const
+{
+	return this->aItems[this->aOrder[pIndex]];
+}
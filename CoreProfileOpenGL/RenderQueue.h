@@ -0,0 +1,99 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MeshInstances.h"
+
+// Passes are drawn in order. Only opaque geometry exists so far, drawn front to back.
+const unsigned int RENDER_PASS_OPAQUE = 0;
+
+// Sort key fields from the most significant bit down, draws are ordered by pass, then by program, material and
+// vertex array so state changes are grouped, and front to back inside a state for early depth rejection. Depth only
+// needs to be roughly ordered, 16 bits are plenty and keep the sort short.
+const unsigned int KEY_PASS_BITS = 4;
+const unsigned int KEY_PROGRAM_BITS = 10;
+const unsigned int KEY_MATERIAL_BITS = 12;
+const unsigned int KEY_VERTEX_ARRAY_BITS = 12;
+const unsigned int KEY_DEPTH_BITS = 16;
+
+// One submitted draw. Either a single mesh with its model matrix and material slot, or a set of instances. The model
+// matrix is not copied, it has to stay in place until the queue is drawn.
+struct RenderItem
+{
+	size_t aProgram;
+	unsigned int aMaterial;
+	const Mesh* aMesh;
+	const MeshInstances* aInstances;
+	const glm::mat4* aModel;
+};
+
+// Collects the draws of a frame and sorts them by a packed 64 bit key with an LSD radix sort. Draws are recorded into
+// lanes, one per thread, that need no locking; mpSort merges the lanes in lane order, so the draw order does not
+// depend on which thread was faster, and only the thread owning the GL context draws the result. The lane, item, key
+// and histogram arrays keep their capacity between frames, so once the scene stopped growing recording and sorting
+// allocate nothing.
+class RenderQueue
+{
+public:
+	// Time spent in the last mpSort
+	double aSortMs;
+
+	RenderQueue();
+	~RenderQueue();
+
+	// Depth is the view space distance of a draw, normalized by pFarPlane into the key
+	static uint64_t mfMakeKey(unsigned int pPass, size_t pProgram, unsigned int pMaterial, GLuint pVertexArray, float pDepth, float pFarPlane);
+
+	// Empties the queue and sets up pLaneCount lanes to record into
+	void mpClear(unsigned int pLaneCount = 1);
+	void mpSubmit(uint64_t pKey, const RenderItem& pItem) { this->mpSubmit(0, pKey, pItem); }
+	// Only one thread may record into a lane at a time, different lanes may be recorded concurrently
+	void mpSubmit(unsigned int pLane, uint64_t pKey, const RenderItem& pItem);
+	void mpSort();
+
+	// Draws in the queue, valid after mpSort
+	size_t mfSize() const;
+	// The i-th draw in key order, valid after mpSort
+	const RenderItem& mfGet(size_t pIndex) const;
+
+	// Sort internals, public for the helpers in RenderQueue.cpp
+	// 11 bit digits, six of them cover a whole key
+	static const unsigned int RADIX_BITS = 11;
+	static const unsigned int MAX_DIGITS = 6;
+	// Runs of varying key bits gathered into the compact key
+	static const unsigned int MAX_RUNS = 4;
+
+	struct SortEntry
+	{
+		uint64_t aKey;
+		uint32_t aItem;
+	};
+
+private:
+	struct Lane
+	{
+		std::vector<uint64_t> aKeys;
+		std::vector<RenderItem> aItems;
+		// Keeps lanes recorded by different threads off each other's cache lines
+		char aPadding[64];
+	};
+
+	std::vector<Lane> aLanes;
+	unsigned int aLaneCount;
+
+	std::vector<RenderItem> aItems;
+	std::vector<SortEntry> aEntries;
+	std::vector<SortEntry> aScratch;
+	std::vector<uint64_t> aPacked;
+	std::vector<uint64_t> aPackedScratch;
+	std::vector<uint32_t> aHistograms;
+	// Item indices in key order
+	std::vector<uint32_t> aOrder;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+// Std. Includes
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Command line options. Without arguments the application opens its usual interactive window.
+class RunOptions
+{
+public:
+	// Render offscreen for a fixed number of frames instead of opening a window
+	bool aHeadless;
+	unsigned int aFrameCount;
+
+	// Total number of spotlights, the ones past the two default lights are placed randomly
+	unsigned int aLightCount;
+
+	// Bin the spotlights into a froxel grid and only shade the ones reaching each fragment's cluster
+	bool aClustered;
+
+	// Number of rotating cubes, more than one are laid out in a grid above the floor
+	unsigned int aCubeCount;
+
+	// Draw all cubes with one instanced draw call instead of one draw per cube
+	bool aInstanced;
+
+	// Quads along each edge of a cube face, raises the vertex count for vertex shader benchmarks
+	unsigned int aCubeDetail;
+
+	// Cull through a bounding volume hierarchy over the scene instead of testing every object
+	bool aBvh;
+
+	// Skip cubes hidden behind the nearest ones, found by a software depth buffer
+	bool aOcclusion;
+
+	// Textures loaded in the background while the scene is drawn, 0 loads none
+	unsigned int aStreamTextureCount;
+
+	// Write the scene's textures, mipmapped and DXT compressed, into this container file and exit
+	std::string aBakeTexturesPath;
+
+	// Map this texture container and create its textures at startup, empty to skip
+	std::string aTextureContainerPath;
+
+	// Worker threads for parallel CPU work, 0 picks one per hardware thread
+	unsigned int aThreadCount;
+
+	// After a headless run, time a synthetic scene update and cull with 1 up to aThreadCount threads
+	bool aBenchJobs;
+
+	// Directory of the program binary cache, empty disables it
+	std::string aShaderCachePath;
+
+	// Where to write the per-frame timings, empty to skip
+	std::string aCsvPath;
+	std::string aJsonPath;
+
+	// Where to store the last headless frame as a PPM image, empty to skip
+	std::string aScreenshotPath;
+
+	~RunOptions() {}
+
+	RunOptions() : aHeadless(false), aFrameCount(300), aLightCount(2), aClustered(false), aCubeCount(1), aInstanced(false), aCubeDetail(1), aBvh(true), aOcclusion(false), aStreamTextureCount(0), aThreadCount(0), aBenchJobs(false), aShaderCachePath("shader_cache")
+	{
+	}
+
+	// Fills the options from argv. Returns false (after printing the usage) on an unknown or incomplete flag.
+	bool mfParse(int pArgc, char* pArgv[])
+	{
+		for (int i = 1; i < pArgc; i++)
+		{
+			const char* lArg = pArgv[i];
+			bool lHasValue = i + 1 < pArgc;
+
+			if (strcmp(lArg, "--headless") == 0)
+				this->aHeadless = true;
+			else if (strcmp(lArg, "--frames") == 0 && lHasValue)
+				this->aFrameCount = (unsigned int)strtoul(pArgv[++i], nullptr, 10);
+			else if (strcmp(lArg, "--lights") == 0 && lHasValue)
+				this->aLightCount = (unsigned int)strtoul(pArgv[++i], nullptr, 10);
+			else if (strcmp(lArg, "--clustered") == 0)
+				this->aClustered = true;
+			else if (strcmp(lArg, "--cubes") == 0 && lHasValue)
+				this->aCubeCount = (unsigned int)strtoul(pArgv[++i], nullptr, 10);
+			else if (strcmp(lArg, "--instanced") == 0)
+				this->aInstanced = true;
+			else if (strcmp(lArg, "--cube-detail") == 0 && lHasValue)
+				this->aCubeDetail = (unsigned int)strtoul(pArgv[++i], nullptr, 10);
+			else if (strcmp(lArg, "--no-bvh") == 0)
+				this->aBvh = false;
+			else if (strcmp(lArg, "--occlusion") == 0)
+				this->aOcclusion = true;
+			else if (strcmp(lArg, "--stream-textures") == 0 && lHasValue)
+				this->aStreamTextureCount = (unsigned int)strtoul(pArgv[++i], nullptr, 10);
+			else if (strcmp(lArg, "--bake-textures") == 0 && lHasValue)
+				this->aBakeTexturesPath = pArgv[++i];
+			else if (strcmp(lArg, "--texture-container") == 0 && lHasValue)
+				this->aTextureContainerPath = pArgv[++i];
+			else if (strcmp(lArg, "--threads") == 0 && lHasValue)
+				this->aThreadCount = (unsigned int)strtoul(pArgv[++i], nullptr, 10);
+			else if (strcmp(lArg, "--bench-jobs") == 0)
+				this->aBenchJobs = true;
+			else if (strcmp(lArg, "--shader-cache") == 0 && lHasValue)
+				this->aShaderCachePath = pArgv[++i];
+			else if (strcmp(lArg, "--no-shader-cache") == 0)
+				this->aShaderCachePath.clear();
+			else if (strcmp(lArg, "--csv") == 0 && lHasValue)
+				this->aCsvPath = pArgv[++i];
+			else if (strcmp(lArg, "--json") == 0 && lHasValue)
+				this->aJsonPath = pArgv[++i];
+			else if (strcmp(lArg, "--screenshot") == 0 && lHasValue)
+				this->aScreenshotPath = pArgv[++i];
+			else
+			{
+				this->mpPrintUsage(pArgv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void mpPrintUsage(const char* pProgram)
+	{
+		printf("Usage: %s [options]\n", pProgram);
+		printf("  --headless      Render offscreen (EGL surfaceless on Linux) without a window\n");
+		printf("  --frames N      Number of frames to render in headless mode (default 300)\n");
+		printf("  --lights N      Number of spotlights in the scene (default 2)\n");
+		printf("  --clustered     Use clustered forward shading (no limit on the number of lights)\n");
+		printf("  --cubes N       Number of cubes in the scene (default 1)\n");
+		printf("  --instanced     Draw the cubes with a single instanced draw call\n");
+		printf("  --cube-detail N Split each cube face into NxN quads (default 1)\n");
+		printf("  --no-bvh        Frustum cull every object instead of walking the bounding volume hierarchy\n");
+		printf("  --occlusion     Cull cubes hidden behind others with a CPU rasterized depth buffer\n");
+		printf("  --stream-textures N  Load N textures in the background while drawing (default 0)\n");
+		printf("  --bake-textures PATH      Bake the textures into a DXT compressed container and exit\n");
+		printf("  --texture-container PATH  Load the textures of a baked container at startup\n");
+		printf("  --threads N     Worker threads for CPU work (default: hardware threads)\n");
+		printf("  --bench-jobs    Time a synthetic scene update and cull with 1 up to --threads threads after a headless run\n");
+		printf("  --shader-cache DIR  Where linked program binaries are cached (default shader_cache)\n");
+		printf("  --no-shader-cache   Always compile shaders from source\n");
+		printf("  --csv PATH      Write per-frame CPU/GPU timings as CSV\n");
+		printf("  --json PATH     Write per-frame CPU/GPU timings as JSON\n");
+		printf("  --screenshot P  Save the last headless frame as a PPM image\n");
+	}
+};
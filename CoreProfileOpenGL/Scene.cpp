@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "Scene.h"
+#include "ParallelFor.h"
+
+Scene::Scene() : aUpdatedCount(0), aUpdateMs(0.0), aSplitsDirty(true)
+{
+}
+
+Scene::~Scene()
+{
+}
+
+uint32_t Scene::mfAddNode(uint32_t pParent)
+{
+	uint32_t lNode = (uint32_t)this->aParents.size();
+	this->aTranslations.push_back(glm::vec3(0.0f));
+	this->aRotations.push_back(glm::quat());
+	this->aScales.push_back(glm::vec3(1.0f));
+	this->aParents.push_back(pParent < lNode ? pParent : SCENE_NO_PARENT);
+	this->aWorlds.push_back(glm::mat4());
+	this->aLocalBoxMins.push_back(glm::vec3(0.0f));
+	this->aLocalBoxMaxs.push_back(glm::vec3(0.0f));
+	this->aBoxMins.push_back(glm::vec3(0.0f));
+	this->aBoxMaxs.push_back(glm::vec3(0.0f));
+	this->aSphereX.push_back(0.0f);
+	this->aSphereY.push_back(0.0f);
+	this->aSphereZ.push_back(0.0f);
+	this->aSphereRadii.push_back(0.0f);
+	this->aLocalDirty.push_back(1);
+	this->aWorldChanged.push_back(0);
+	this->aSplitsDirty = true;
+	return lNode;
+}
+
+void Scene::mpSetTranslation(uint32_t pNode, const glm::vec3& pTranslation)
+{
+	this->aTranslations[pNode] = pTranslation;
+	this->aLocalDirty[pNode] = 1;
+}
+
+void Scene::mpSetRotation(uint32_t pNode, const glm::quat& pRotation)
+{
+	this->aRotations[pNode] = pRotation;
+	this->aLocalDirty[pNode] = 1;
+}
+
+void Scene::mpSetScale(uint32_t pNode, const glm::vec3& pScale)
+{
+	this->aScales[pNode] = pScale;
+	this->aLocalDirty[pNode] = 1;
+}
+
+void Scene::mpSetBoundingBox(uint32_t pNode, const glm::vec3& pMin, const glm::vec3& pMax)
+{
+	this->aLocalBoxMins[pNode] = pMin;
+	this->aLocalBoxMaxs[pNode] = pMax;
+	this->aLocalDirty[pNode] = 1;
+}
+
+SphereArrays Scene::mfGetWorldSpheres(uint32_t pFirstNode) const
+{
+	SphereArrays lSpheres;
+	lSpheres.aX = this->aSphereX.data() + pFirstNode;
+	lSpheres.aY = this->aSphereY.data() + pFirstNode;
+	lSpheres.aZ = this->aSphereZ.data() + pFirstNode;
+	lSpheres.aRadius = this->aSphereRadii.data() + pFirstNode;
+	return lSpheres;
+}
+
+void Scene::mpFindSplits()
+{
+	// Walking backwards, lMinParent is the smallest parent index of all nodes from i on
+	this->aSplits.clear();
+	uint32_t lMinParent = SCENE_NO_PARENT;
+	for (size_t i = this->aParents.size(); i-- > 0; )
+	{
+		lMinParent = std::min(lMinParent, this->aParents[i]);
+		if (lMinParent >= i)
+			this->aSplits.push_back((uint32_t)i);
+	}
+	std::reverse(this->aSplits.begin(), this->aSplits.end());
+	this->aSplitsDirty = false;
+}
+
+unsigned int Scene::mfUpdateRange(uint32_t pBegin, uint32_t pEnd)
+{
+	unsigned int lUpdated = 0;
+	for (uint32_t i = pBegin; i < pEnd; i++)
+	{
+		uint32_t lParent = this->aParents[i];
+		bool lParentChanged = lParent != SCENE_NO_PARENT && this->aWorldChanged[lParent];
+		if (!this->aLocalDirty[i] && !lParentChanged)
+		{
+			this->aWorldChanged[i] = 0;
+			continue;
+		}
+
+		// Translation * rotation * scale, written out instead of multiplying three matrices
+		glm::mat4 lLocal = glm::mat4_cast(this->aRotations[i]);
+		lLocal[0] *= this->aScales[i].x;
+		lLocal[1] *= this->aScales[i].y;
+		lLocal[2] *= this->aScales[i].z;
+		lLocal[3] = glm::vec4(this->aTranslations[i], 1.0f);
+
+		this->aWorlds[i] = lParent == SCENE_NO_PARENT ? lLocal : this->aWorlds[lParent] * lLocal;
+		const glm::mat4& lWorld = this->aWorlds[i];
+
+		// The world box of the local box's center and half extents is the transformed center plus the half extents
+		// projected on every axis. The sphere around the same center grows with the largest axis scale.
+		glm::vec3 lCenter = glm::vec3(lWorld * glm::vec4((this->aLocalBoxMins[i] + this->aLocalBoxMaxs[i]) * 0.5f, 1.0f));
+		glm::vec3 lHalf = (this->aLocalBoxMaxs[i] - this->aLocalBoxMins[i]) * 0.5f;
+		glm::vec3 lWorldHalf = glm::abs(glm::vec3(lWorld[0])) * lHalf.x + glm::abs(glm::vec3(lWorld[1])) * lHalf.y + glm::abs(glm::vec3(lWorld[2])) * lHalf.z;
+		this->aBoxMins[i] = lCenter - lWorldHalf;
+		this->aBoxMaxs[i] = lCenter + lWorldHalf;
+
+		float lScaleSq = std::max(std::max(glm::dot(lWorld[0], lWorld[0]), glm::dot(lWorld[1], lWorld[1])), glm::dot(lWorld[2], lWorld[2]));
+		this->aSphereX[i] = lCenter.x;
+		this->aSphereY[i] = lCenter.y;
+		this->aSphereZ[i] = lCenter.z;
+		this->aSphereRadii[i] = glm::length(lHalf) * std::sqrt(lScaleSq);
+		this->aLocalDirty[i] = 0;
+		this->aWorldChanged[i] = 1;
+		lUpdated++;
+	}
+	return lUpdated;
+}
+
+void Scene::mpUpdate(unsigned int pThreadCount)
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	if (this->aSplitsDirty)
+		this->mpFindSplits();
+
+	uint32_t lCount = (uint32_t)this->aParents.size();
+	unsigned int lThreadCount = std::max(1u, std::min(pThreadCount, lCount / MIN_NODES_PER_THREAD));
+
+	// Cut the nodes into about equal ranges at the nearest split past each even share
+	std::vector<uint32_t> lBounds(1, 0);
+	for (unsigned int t = 1; t < lThreadCount; t++)
+	{
+		uint32_t lTarget = (uint32_t)(((uint64_t)lCount * t) / lThreadCount);
+		std::vector<uint32_t>::const_iterator lSplit = std::lower_bound(this->aSplits.begin(), this->aSplits.end(), std::max(lTarget, lBounds.back() + 1));
+		if (lSplit == this->aSplits.end())
+			break;
+		lBounds.push_back(*lSplit);
+	}
+	lBounds.push_back(lCount);
+
+	std::vector<unsigned int> lUpdated(lBounds.size() - 1, 0);
+	mpParallelFor((unsigned int)lUpdated.size(), (unsigned int)lUpdated.size(), [&](unsigned int pBegin, unsigned int pEnd)
+	{
+		for (unsigned int r = pBegin; r < pEnd; r++)
+			lUpdated[r] = this->mfUpdateRange(lBounds[r], lBounds[r + 1]);
+	});
+
+	this->aUpdatedCount = 0;
+	for (size_t r = 0; r < lUpdated.size(); r++)
+		this->aUpdatedCount += lUpdated[r];
+
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aUpdateMs = lElapsed.count();
+}
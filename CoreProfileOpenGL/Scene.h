@@ -0,0 +1,87 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <vector>
+
+// GL Includes
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Frustum.h"
+
+// Parent index of root nodes
+const uint32_t SCENE_NO_PARENT = 0xFFFFFFFFu;
+
+// Transform hierarchy stored as structure of arrays: local translation, rotation and scale, parent index, world
+// matrix and world bounds of node i live at index i of their arrays. A node's parent is always created before it, so one pass in index
+// order sees every parent's world matrix before its children. Only nodes whose local transform was set, or whose
+// parent moved, are recomputed; static subtrees cost a flag test per node.
+class Scene
+{
+public:
+	// Nodes recomputed by the last mpUpdate and the time it took
+	unsigned int aUpdatedCount;
+	double aUpdateMs;
+
+	Scene();
+	~Scene();
+
+	// Identity transform, pParent must already exist. Returns the node index.
+	uint32_t mfAddNode(uint32_t pParent);
+
+	void mpSetTranslation(uint32_t pNode, const glm::vec3& pTranslation);
+	void mpSetRotation(uint32_t pNode, const glm::quat& pRotation);
+	void mpSetScale(uint32_t pNode, const glm::vec3& pScale);
+	// Box enclosing the node's geometry in local space, a point at the origin until set
+	void mpSetBoundingBox(uint32_t pNode, const glm::vec3& pMin, const glm::vec3& pMax);
+
+	// Recomputes the world matrices of moved nodes. Independent subtrees are split over up to pThreadCount threads once
+	// there are enough nodes to pay for starting them.
+	void mpUpdate(unsigned int pThreadCount);
+
+	size_t mfSize() const { return this->aParents.size(); }
+
+	const glm::mat4& mfGetWorld(uint32_t pNode) const { return this->aWorlds[pNode]; }
+
+	// World matrices of consecutive nodes, for uploading a run of them at once
+	const glm::mat4* mfGetWorlds(uint32_t pFirstNode) const { return this->aWorlds.data() + pFirstNode; }
+
+	// World bounding spheres and axis aligned boxes of consecutive nodes, updated together with the world matrices
+	SphereArrays mfGetWorldSpheres(uint32_t pFirstNode) const;
+	const glm::vec3* mfGetWorldBoxMins(uint32_t pFirstNode) const { return this->aBoxMins.data() + pFirstNode; }
+	const glm::vec3* mfGetWorldBoxMaxs(uint32_t pFirstNode) const { return this->aBoxMaxs.data() + pFirstNode; }
+
+	// Nonzero for the nodes whose world matrix changed in the last mpUpdate
+	const uint8_t* mfGetWorldChanged(uint32_t pFirstNode) const { return this->aWorldChanged.data() + pFirstNode; }
+
+private:
+	// Fewest nodes per thread for a parallel update
+	static const unsigned int MIN_NODES_PER_THREAD = 16384;
+
+	std::vector<glm::vec3> aTranslations;
+	std::vector<glm::quat> aRotations;
+	std::vector<glm::vec3> aScales;
+	std::vector<uint32_t> aParents;
+	std::vector<glm::mat4> aWorlds;
+	std::vector<glm::vec3> aLocalBoxMins;
+	std::vector<glm::vec3> aLocalBoxMaxs;
+	std::vector<glm::vec3> aBoxMins;
+	std::vector<glm::vec3> aBoxMaxs;
+	std::vector<float> aSphereX;
+	std::vector<float> aSphereY;
+	std::vector<float> aSphereZ;
+	std::vector<float> aSphereRadii;
+
+	// Local transform changed since the last update / world matrix changed in the last update
+	std::vector<uint8_t> aLocalDirty;
+	std::vector<uint8_t> aWorldChanged;
+
+	// Indices where the node array can be cut into independent ranges: no node at or after a split has its parent
+	// before it. Rebuilt after nodes were added.
+	std::vector<uint32_t> aSplits;
+	bool aSplitsDirty;
+
+	void mpFindSplits();
+	unsigned int mfUpdateRange(uint32_t pBegin, uint32_t pEnd);
+};
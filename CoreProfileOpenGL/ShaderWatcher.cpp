@@ -0,0 +1,132 @@
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "ShaderWatcher.h"
+
+static bool mfIsShaderFile(const char* pName)
+{
+	size_t lLength = strlen(pName);
+	return (lLength > 3 && (strcmp(pName + lLength - 3, ".vs") == 0 || strcmp(pName + lLength - 3, ".fs") == 0)) ||
+		(lLength > 5 && strcmp(pName + lLength - 5, ".glsl") == 0);
+}
+
+ShaderWatcher::ShaderWatcher() : aNotifyFd(-1), aWatchFd(-1)
+{
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	mpDestroy();
+}
+
+#ifndef _WIN32
+
+bool ShaderWatcher::mfInit(const char* pDirectory)
+{
+	this->aDirectory = pDirectory;
+	this->aNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->aNotifyFd < 0)
+		return false;
+
+	// Editors either rewrite the file in place or write a temporary file and rename it over the original
+	this->aWatchFd = inotify_add_watch(this->aNotifyFd, pDirectory, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (this->aWatchFd < 0)
+	{
+		mpDestroy();
+		return false;
+	}
+	return true;
+}
+
+void ShaderWatcher::mpPoll(std::vector<std::string>& pChangedFiles)
+{
+	if (this->aNotifyFd < 0)
+		return;
+
+	alignas(struct inotify_event) char lBuffer[4096];
+	for (;;)
+	{
+		ssize_t lLength = read(this->aNotifyFd, lBuffer, sizeof(lBuffer));
+		if (lLength <= 0)
+			break;
+
+		for (char* lPtr = lBuffer; lPtr < lBuffer + lLength; )
+		{
+			struct inotify_event* lEvent = (struct inotify_event*)lPtr;
+			if (lEvent->len > 0 && mfIsShaderFile(lEvent->name) &&
+				std::find(pChangedFiles.begin(), pChangedFiles.end(), lEvent->name) == pChangedFiles.end())
+			{
+				pChangedFiles.push_back(lEvent->name);
+			}
+			lPtr += sizeof(struct inotify_event) + lEvent->len;
+		}
+	}
+}
+
+void ShaderWatcher::mpDestroy()
+{
+	if (this->aNotifyFd >= 0)
+	{
+		close(this->aNotifyFd);
+		this->aNotifyFd = -1;
+		this->aWatchFd = -1;
+	}
+}
+
+#else
+
+bool ShaderWatcher::mfInit(const char* pDirectory)
+{
+	this->aDirectory = pDirectory;
+	mpScanModifiedTimes(nullptr);
+	return true;
+}
+
+void ShaderWatcher::mpPoll(std::vector<std::string>& pChangedFiles)
+{
+	mpScanModifiedTimes(&pChangedFiles);
+}
+
+void ShaderWatcher::mpDestroy()
+{
+	this->aModifiedTimes.clear();
+}
+
+void ShaderWatcher::mpScanModifiedTimes(std::vector<std::string>* pChangedFiles)
+{
+	WIN32_FIND_DATAA lData;
+	HANDLE lFind = FindFirstFileA((this->aDirectory + "\\*").c_str(), &lData);
+	if (lFind == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		if (!mfIsShaderFile(lData.cFileName))
+			continue;
+
+		long long lTime = ((long long)lData.ftLastWriteTime.dwHighDateTime << 32) | lData.ftLastWriteTime.dwLowDateTime;
+		std::map<std::string, long long>::iterator lIt = this->aModifiedTimes.find(lData.cFileName);
+		if (lIt == this->aModifiedTimes.end())
+		{
+			this->aModifiedTimes[lData.cFileName] = lTime;
+		}
+		else if (lIt->second != lTime)
+		{
+			lIt->second = lTime;
+			if (pChangedFiles != nullptr)
+				pChangedFiles->push_back(lData.cFileName);
+		}
+	} while (FindNextFileA(lFind, &lData));
+
+	FindClose(lFind);
+}
+
+#endif
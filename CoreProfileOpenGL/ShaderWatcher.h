@@ -0,0 +1,35 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+
+// Reports .vs/.fs/.glsl files in a directory that were written since the last poll, so changed shaders can be
+// rebuilt while the application keeps running. On Linux an inotify descriptor is read without blocking,
+// elsewhere the modification times of the shader files are compared.
+class ShaderWatcher
+{
+public:
+	ShaderWatcher();
+	~ShaderWatcher();
+
+	bool mfInit(const char* pDirectory);
+
+	// Appends the names of the shader files changed since the previous call, every file at most once
+	void mpPoll(std::vector<std::string>& pChangedFiles);
+
+	void mpDestroy();
+
+private:
+	std::string aDirectory;
+	int aNotifyFd;
+	int aWatchFd;
+
+#ifdef _WIN32
+	// Last seen modification time of every shader file
+	std::map<std::string, long long> aModifiedTimes;
+
+	void mpScanModifiedTimes(std::vector<std::string>* pChangedFiles);
+#endif
+};
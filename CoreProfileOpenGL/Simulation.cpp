@@ -0,0 +1,152 @@
+#include <algorithm>
+
+#include "Simulation.h"
+
+// Seconds per tick, every tick advances the simulation by exactly this much
+static const float TICK_SECONDS = 1.0f / Simulation::TICK_RATE;
+
+// Ticks run at once to catch up after a stall, beyond that the simulation skips ahead
+static const unsigned int MAX_CATCH_UP_TICKS = 5;
+
+Simulation::Simulation(const Camera& pCamera) : aTickCount(0), aCamera(pCamera), aRotationAngle(0.0f), aMouseMovement(0.0f), aScroll(0.0f), aRunning(false)
+{
+	for (int i = 0; i < 4; i++)
+		this->aMoving[i] = false;
+
+	this->aCurrent.aCameraPosition = this->aCamera.Position;
+	this->aCurrent.aCameraFront = this->aCamera.Front;
+	this->aCurrent.aCameraUp = this->aCamera.Up;
+	this->aCurrent.aCameraZoom = this->aCamera.Zoom;
+	this->aCurrent.aRotationAngle = this->aRotationAngle;
+	this->aCurrent.aTime = std::chrono::steady_clock::now();
+	this->aPrevious = this->aCurrent;
+}
+
+Simulation::~Simulation()
+{
+	this->mpStop();
+}
+
+void Simulation::mpStart()
+{
+	if (this->aRunning)
+		return;
+	this->aRunning = true;
+	this->aThread = std::thread(&Simulation::mpRunLoop, this);
+}
+
+void Simulation::mpStop()
+{
+	this->aRunning = false;
+	if (this->aThread.joinable())
+		this->aThread.join();
+}
+
+void Simulation::mpStep()
+{
+	this->mpTick(std::chrono::steady_clock::now());
+}
+
+SimulationState Simulation::mfGetState()
+{
+	std::lock_guard<std::mutex> lLock(this->aStateMutex);
+	if (!this->aRunning)
+		return this->aCurrent;
+
+	// The snapshot of a tick is shown in full by the time the next one is due
+	std::chrono::duration<float> lSinceTick = std::chrono::steady_clock::now() - this->aCurrent.aTime;
+	float lAlpha = std::min(std::max(lSinceTick.count() / TICK_SECONDS, 0.0f), 1.0f);
+	if (lAlpha >= 1.0f)
+		return this->aCurrent;
+
+	const SimulationState& lFrom = this->aPrevious;
+	const SimulationState& lTo = this->aCurrent;
+	SimulationState lState;
+	lState.aCameraPosition = glm::mix(lFrom.aCameraPosition, lTo.aCameraPosition, lAlpha);
+	lState.aCameraFront = glm::normalize(glm::mix(lFrom.aCameraFront, lTo.aCameraFront, lAlpha));
+	lState.aCameraUp = glm::normalize(glm::mix(lFrom.aCameraUp, lTo.aCameraUp, lAlpha));
+	lState.aCameraZoom = glm::mix(lFrom.aCameraZoom, lTo.aCameraZoom, lAlpha);
+	lState.aRotationAngle = glm::mix(lFrom.aRotationAngle, lTo.aRotationAngle, lAlpha);
+	lState.aTime = lTo.aTime;
+	return lState;
+}
+
+void Simulation::mpSetMoving(Camera_Movement pDirection, bool pMoving)
+{
+	std::lock_guard<std::mutex> lLock(this->aInputMutex);
+	this->aMoving[pDirection] = pMoving;
+}
+
+void Simulation::mpAddMouseMovement(float pDeltaX, float pDeltaY)
+{
+	std::lock_guard<std::mutex> lLock(this->aInputMutex);
+	this->aMouseMovement += glm::vec2(pDeltaX, pDeltaY);
+}
+
+void Simulation::mpAddScroll(float pDelta)
+{
+	std::lock_guard<std::mutex> lLock(this->aInputMutex);
+	this->aScroll += pDelta;
+}
+
+void Simulation::mpTick(std::chrono::steady_clock::time_point pTime)
+{
+	bool lMoving[4];
+	glm::vec2 lMouseMovement;
+	float lScroll;
+	{
+		std::lock_guard<std::mutex> lLock(this->aInputMutex);
+		for (int i = 0; i < 4; i++)
+			lMoving[i] = this->aMoving[i];
+		lMouseMovement = this->aMouseMovement;
+		lScroll = this->aScroll;
+		this->aMouseMovement = glm::vec2(0.0f);
+		this->aScroll = 0.0f;
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (lMoving[i])
+			this->aCamera.ProcessKeyboard((Camera_Movement)i, TICK_SECONDS);
+	}
+	if (lMouseMovement != glm::vec2(0.0f))
+		this->aCamera.ProcessMouseMovement(lMouseMovement.x, lMouseMovement.y);
+	if (lScroll != 0.0f)
+		this->aCamera.ProcessMouseScroll(lScroll);
+
+	this->aRotationAngle += 50.0f * TICK_SECONDS;
+
+	SimulationState lState;
+	lState.aCameraPosition = this->aCamera.Position;
+	lState.aCameraFront = this->aCamera.Front;
+	lState.aCameraUp = this->aCamera.Up;
+	lState.aCameraZoom = this->aCamera.Zoom;
+	lState.aRotationAngle = this->aRotationAngle;
+	lState.aTime = pTime;
+	{
+		std::lock_guard<std::mutex> lLock(this->aStateMutex);
+		this->aPrevious = this->aCurrent;
+		this->aCurrent = lState;
+	}
+	this->aTickCount++;
+}
+
+void Simulation::mpRunLoop()
+{
+	std::chrono::steady_clock::duration lTick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / TICK_RATE));
+	std::chrono::steady_clock::time_point lNextTick = std::chrono::steady_clock::now();
+	while (this->aRunning)
+	{
+		std::this_thread::sleep_until(lNextTick);
+
+		// Ticks carry the time they were due rather than when they ran, so a late tick does not show as a jump
+		std::chrono::steady_clock::time_point lNow = std::chrono::steady_clock::now();
+		if (lNow - lNextTick > lTick * MAX_CATCH_UP_TICKS)
+			lNextTick = lNow;
+		while (lNextTick <= lNow && this->aRunning)
+		{
+			this->mpTick(lNextTick);
+			lNextTick += lTick;
+		}
+	}
+}
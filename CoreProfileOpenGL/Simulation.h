@@ -0,0 +1,76 @@
+#pragma once
+
+// Std. Includes
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// GL Includes
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+// What the renderer needs from one simulation tick
+struct SimulationState
+{
+	glm::vec3 aCameraPosition;
+	glm::vec3 aCameraFront;
+	glm::vec3 aCameraUp;
+	float aCameraZoom;
+	// Degrees the cubes have turned about the y axis
+	float aRotationAngle;
+	std::chrono::steady_clock::time_point aTime;
+
+	glm::mat4 mfGetViewMatrix() const { return glm::lookAt(this->aCameraPosition, this->aCameraPosition + this->aCameraFront, this->aCameraUp); }
+};
+
+// Camera movement and animation advanced in fixed ticks on a thread of their own, so neither depends on the frame
+// rate. Input is handed over from the window callbacks at any time and applied at the next tick. Every tick publishes
+// a snapshot; the renderer reads the last two and interpolates between them, one tick behind.
+class Simulation
+{
+public:
+	static const unsigned int TICK_RATE = 60;
+
+	// Ticks run since construction
+	std::atomic<unsigned int> aTickCount;
+
+	Simulation(const Camera& pCamera);
+	~Simulation();
+
+	// Ticks TICK_RATE times per second on its own thread until mpStop
+	void mpStart();
+	void mpStop();
+
+	// Runs one tick on the calling thread, for runs that have to animate the same every time. Not while started.
+	void mpStep();
+
+	// Without the thread running, the state of the last tick
+	SimulationState mfGetState();
+
+	void mpSetMoving(Camera_Movement pDirection, bool pMoving);
+	void mpAddMouseMovement(float pDeltaX, float pDeltaY);
+	void mpAddScroll(float pDelta);
+
+private:
+	Camera aCamera;
+	float aRotationAngle;
+
+	// Input since the last tick
+	std::mutex aInputMutex;
+	bool aMoving[4];
+	glm::vec2 aMouseMovement;
+	float aScroll;
+
+	// The two latest snapshots, aPrevious is one tick older than aCurrent
+	std::mutex aStateMutex;
+	SimulationState aPrevious;
+	SimulationState aCurrent;
+
+	std::thread aThread;
+	std::atomic<bool> aRunning;
+
+	void mpTick(std::chrono::steady_clock::time_point pTime);
+	void mpRunLoop();
+};
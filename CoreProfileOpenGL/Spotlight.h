@@ -1,6 +1,27 @@
 #pragma once
+#include <cfloat>
 #include <glm/glm.hpp>
 
+// std140 mirror of the Light struct in lighting.fs. Every vec3 is followed by a float so each pair fills one 16 byte slot.
+struct SpotlightBlock
+{
+	glm::vec3 aPosition;
+	float aCutoff;
+	glm::vec3 aDirection;
+	float aOuterCutoff;
+	glm::vec3 aAmbient;
+	float aConstant;
+	glm::vec3 aDiffuse;
+	float aLinear;
+	glm::vec3 aSpecular;
+	float aQuadratic;
+};
+
+static_assert(sizeof(SpotlightBlock) == 80, "SpotlightBlock must match the std140 layout of Light");
+
+// Size of the lights array in lighting.fs (MAX_LIGHTS). 128 lights keep the block within the 16KB every GL 3.3 driver supports.
+const unsigned int MAX_SPOTLIGHTS = 128;
+
 class Spotlight
 {
 public:
@@ -48,4 +69,37 @@ public:
 		this->aAmbient = this->aDiffuse * glm::vec3(0.25f); // Low influence
 		this->aSpecular = glm::vec3(1.0f);
 	}
+
+	// Distance at which the attenuation drops to pAttenuation, i.e. solves constant + linear * d + quadratic * d^2 = 1 / pAttenuation
+	float mfGetRange(float pAttenuation) const
+	{
+		float lC = this->aConstant - 1.0f / pAttenuation;
+		if (this->aQuadratic > 0.0f)
+			return (-this->aLinear + glm::sqrt(this->aLinear * this->aLinear - 4.0f * this->aQuadratic * lC)) / (2.0f * this->aQuadratic);
+		if (this->aLinear > 0.0f)
+			return -lC / this->aLinear;
+		return FLT_MAX;
+	}
+
+	// A light whose inner and outer cone match has a hard border, the SOFT_EDGES shader variant is not needed for it
+	bool mfHasSoftEdges() const
+	{
+		return this->aOuterCutoff != this->aCutoff;
+	}
+
+	SpotlightBlock mfGetBlock() const
+	{
+		SpotlightBlock lBlock;
+		lBlock.aPosition = this->aPosition;
+		lBlock.aCutoff = this->aCutoff;
+		lBlock.aDirection = this->aDirection;
+		lBlock.aOuterCutoff = this->aOuterCutoff;
+		lBlock.aAmbient = this->aAmbient;
+		lBlock.aConstant = this->aConstant;
+		lBlock.aDiffuse = this->aDiffuse;
+		lBlock.aLinear = this->aLinear;
+		lBlock.aSpecular = this->aSpecular;
+		lBlock.aQuadratic = this->aQuadratic;
+		return lBlock;
+	}
 };
\ No newline at end of file
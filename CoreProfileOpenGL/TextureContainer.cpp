@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <soil/image_DXT.h>
+#include <soil/image_helper.h>
+#include <soil/stb_image_aug.h>
+
+#include "GLStateCache.h"
+#include "ParallelFor.h"
+#include "TextureContainer.h"
+
+static const char TEXTURE_CONTAINER_MAGIC[8] = { 'C', 'P', 'G', 'L', 'T', 'E', 'X', '1' };
+
+// Fewest block rows of a level one thread compresses while baking
+static const unsigned int MIN_BLOCK_ROWS_PER_THREAD = 32;
+
+static uint64_t mfAlign(uint64_t pOffset, uint64_t pAlignment)
+{
+	return (pOffset + pAlignment - 1) / pAlignment * pAlignment;
+}
+
+static size_t mfGetBlockBytes(uint32_t pFormat)
+{
+	return pFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+static size_t mfGetLevelSize(uint32_t pFormat, uint32_t pWidth, uint32_t pHeight)
+{
+	return (size_t)((pWidth + 3) / 4) * ((pHeight + 3) / 4) * mfGetBlockBytes(pFormat);
+}
+
+TextureContainer::TextureContainer() : aData(nullptr), aSize(0), aTextureCount(0), aTextures(nullptr), aLevels(nullptr)
+#ifdef _WIN32
+	, aFile(INVALID_HANDLE_VALUE), aMapping(nullptr)
+#endif
+{
+}
+
+TextureContainer::~TextureContainer()
+{
+	this->mpClose();
+}
+
+bool TextureContainer::mfBake(const std::vector<std::string>& pSources, const std::string& pPath)
+{
+	struct BakedTexture
+	{
+		TextureEntry aEntry;
+		std::vector<LevelEntry> aLevels;
+		std::vector<std::vector<unsigned char> > aBlocks;
+	};
+	std::vector<BakedTexture> lTextures(pSources.size());
+	uint32_t lLevelCount = 0;
+	unsigned int lThreadCount = gJobs.mfGetWorkerCount() + 1;
+
+	for (size_t t = 0; t < pSources.size(); t++)
+	{
+		int lWidth = 0, lHeight = 0, lChannels = 0;
+		unsigned char* lDecoded = stbi_load(pSources[t].c_str(), &lWidth, &lHeight, &lChannels, 4);
+		if (lDecoded == nullptr)
+		{
+			printf("Impossible to bake %s: %s\n", pSources[t].c_str(), stbi_failure_reason());
+			return false;
+		}
+
+		BakedTexture& lTexture = lTextures[t];
+		lTexture.aEntry.aFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		for (size_t i = 3; i < (size_t)lWidth * lHeight * 4; i += 4)
+		{
+			if (lDecoded[i] != 255)
+			{
+				lTexture.aEntry.aFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+				break;
+			}
+		}
+		lTexture.aEntry.aFirstLevel = lLevelCount;
+		lTexture.aEntry.aPadding = 0;
+
+		// The full chain down to 1x1, in RGBA8 first, levels back to back as mipmap_image_chain writes them
+		std::vector<size_t> lPixelOffsets;
+		LevelEntry lLevel = { 0, 0, (uint32_t)lWidth, (uint32_t)lHeight, 0 };
+		size_t lPixelSize = 0;
+		while (true)
+		{
+			lTexture.aLevels.push_back(lLevel);
+			lPixelOffsets.push_back(lPixelSize);
+			lPixelSize += (size_t)lLevel.aWidth * lLevel.aHeight * 4;
+			if (lLevel.aWidth == 1 && lLevel.aHeight == 1)
+				break;
+			lLevel.aWidth = std::max(1u, lLevel.aWidth / 2);
+			lLevel.aHeight = std::max(1u, lLevel.aHeight / 2);
+		}
+		std::vector<unsigned char> lPixels(lPixelSize);
+		memcpy(&lPixels[0], lDecoded, (size_t)lWidth * lHeight * 4);
+		stbi_image_free(lDecoded);
+		if (lTexture.aLevels.size() > 1)
+			mipmap_image_chain(&lPixels[0], lWidth, lHeight, 4, &lPixels[lPixelOffsets[1]]);
+
+		lTexture.aEntry.aLevelCount = (uint32_t)lTexture.aLevels.size();
+		lLevelCount += lTexture.aEntry.aLevelCount;
+		lTexture.aBlocks.resize(lTexture.aLevels.size());
+		for (size_t l = 0; l < lTexture.aLevels.size(); l++)
+		{
+			LevelEntry& lEntry = lTexture.aLevels[l];
+			uint32_t lFormat = lTexture.aEntry.aFormat;
+			lEntry.aSize = (uint32_t)mfGetLevelSize(lFormat, lEntry.aWidth, lEntry.aHeight);
+			std::vector<unsigned char>& lBlocks = lTexture.aBlocks[l];
+			lBlocks.resize(lEntry.aSize);
+
+			const unsigned char* lSource = &lPixels[lPixelOffsets[l]];
+			unsigned int lBlockRows = (lEntry.aHeight + 3) / 4;
+			mpParallelFor(lBlockRows, std::max(1u, std::min(lThreadCount, lBlockRows / MIN_BLOCK_ROWS_PER_THREAD)), [&](unsigned int pBegin, unsigned int pEnd)
+			{
+				if (lFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+					compress_image_to_DXT1_rows(lSource, lEntry.aWidth, lEntry.aHeight, 4, &lBlocks[0], pBegin, pEnd - pBegin, 0);
+				else
+					compress_image_to_DXT5_rows(lSource, lEntry.aWidth, lEntry.aHeight, 4, &lBlocks[0], pBegin, pEnd - pBegin, 0);
+			});
+		}
+	}
+
+	// Tables first, then the levels in upload order
+	Header lHeader;
+	memcpy(lHeader.aMagic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC));
+	lHeader.aTextureCount = (uint32_t)lTextures.size();
+	lHeader.aLevelCount = lLevelCount;
+	uint64_t lOffset = sizeof(Header) + lTextures.size() * sizeof(TextureEntry) + lLevelCount * sizeof(LevelEntry);
+	for (size_t t = 0; t < lTextures.size(); t++)
+	{
+		for (size_t l = 0; l < lTextures[t].aLevels.size(); l++)
+		{
+			lOffset = mfAlign(lOffset, LEVEL_ALIGNMENT);
+			lTextures[t].aLevels[l].aOffset = lOffset;
+			lOffset += lTextures[t].aLevels[l].aSize;
+		}
+	}
+
+	std::ofstream lFile(pPath, std::ios::out | std::ios::binary);
+	if (!lFile.is_open())
+	{
+		printf("Impossible to write texture container %s\n", pPath.c_str());
+		return false;
+	}
+	lFile.write((const char*)&lHeader, sizeof(lHeader));
+	for (size_t t = 0; t < lTextures.size(); t++)
+		lFile.write((const char*)&lTextures[t].aEntry, sizeof(TextureEntry));
+	for (size_t t = 0; t < lTextures.size(); t++)
+		lFile.write((const char*)&lTextures[t].aLevels[0], sizeof(LevelEntry) * lTextures[t].aLevels.size());
+	static const char PADDING[LEVEL_ALIGNMENT] = { 0 };
+	for (size_t t = 0; t < lTextures.size(); t++)
+	{
+		for (size_t l = 0; l < lTextures[t].aLevels.size(); l++)
+		{
+			const LevelEntry& lLevel = lTextures[t].aLevels[l];
+			// tellp is 64-bit where ftell's long is not, containers may pass 2 GB
+			uint64_t lPosition = (uint64_t)lFile.tellp();
+			lFile.write(PADDING, (std::streamsize)(lLevel.aOffset - lPosition));
+			lFile.write((const char*)&lTextures[t].aBlocks[l][0], lLevel.aSize);
+		}
+	}
+	lFile.close();
+	if (lFile.fail())
+	{
+		printf("Impossible to write texture container %s\n", pPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+void TextureContainer::mpDropFromFileCache(const std::string& pPath)
+{
+#ifndef _WIN32
+	int lFile = open(pPath.c_str(), O_RDONLY);
+	if (lFile < 0)
+		return;
+	posix_fadvise(lFile, 0, 0, POSIX_FADV_DONTNEED);
+	close(lFile);
+#else
+	(void)pPath;
+#endif
+}
+
+bool TextureContainer::mfIsSupported()
+{
+	GLint lCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &lCount);
+	for (GLint i = 0; i < lCount; i++)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0)
+			return true;
+	}
+	return false;
+}
+
+bool TextureContainer::mfOpen(const std::string& pPath)
+{
+	this->mpClose();
+
+#ifdef _WIN32
+	this->aFile = CreateFileA(pPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER lSize;
+	if (this->aFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->aFile, &lSize) || lSize.QuadPart == 0)
+	{
+		printf("Impossible to open texture container %s\n", pPath.c_str());
+		this->mpClose();
+		return false;
+	}
+	this->aMapping = CreateFileMappingA(this->aFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (this->aMapping != nullptr)
+		this->aData = (const unsigned char*)MapViewOfFile(this->aMapping, FILE_MAP_READ, 0, 0, 0);
+	this->aSize = (size_t)lSize.QuadPart;
+#else
+	int lFile = open(pPath.c_str(), O_RDONLY);
+	if (lFile < 0)
+	{
+		printf("Impossible to open texture container %s\n", pPath.c_str());
+		return false;
+	}
+	struct stat lStat;
+	if (fstat(lFile, &lStat) == 0 && lStat.st_size > 0)
+	{
+		void* lMapped = mmap(nullptr, (size_t)lStat.st_size, PROT_READ, MAP_PRIVATE, lFile, 0);
+		if (lMapped != MAP_FAILED)
+		{
+			this->aData = (const unsigned char*)lMapped;
+			this->aSize = (size_t)lStat.st_size;
+		}
+	}
+	// The mapping keeps the file alive
+	close(lFile);
+#endif
+
+	if (this->aData == nullptr || !this->mfReadTables())
+	{
+		printf("Impossible to read texture container %s\n", pPath.c_str());
+		this->mpClose();
+		return false;
+	}
+	return true;
+}
+
+void TextureContainer::mpClose()
+{
+#ifdef _WIN32
+	if (this->aData != nullptr)
+		UnmapViewOfFile(this->aData);
+	if (this->aMapping != nullptr)
+		CloseHandle(this->aMapping);
+	if (this->aFile != INVALID_HANDLE_VALUE)
+		CloseHandle(this->aFile);
+	this->aMapping = nullptr;
+	this->aFile = INVALID_HANDLE_VALUE;
+#else
+	if (this->aData != nullptr)
+		munmap((void*)this->aData, this->aSize);
+#endif
+	this->aData = nullptr;
+	this->aSize = 0;
+	this->aTextureCount = 0;
+	this->aTextures = nullptr;
+	this->aLevels = nullptr;
+}
+
+bool TextureContainer::mfReadTables()
+{
+	if (this->aSize < sizeof(Header))
+		return false;
+	const Header* lHeader = (const Header*)this->aData;
+	if (memcmp(lHeader->aMagic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC)) != 0)
+		return false;
+	size_t lTablesSize = sizeof(Header) + (size_t)lHeader->aTextureCount * sizeof(TextureEntry) + (size_t)lHeader->aLevelCount * sizeof(LevelEntry);
+	if (lTablesSize > this->aSize)
+		return false;
+
+	this->aTextureCount = lHeader->aTextureCount;
+	this->aTextures = (const TextureEntry*)(this->aData + sizeof(Header));
+	this->aLevels = (const LevelEntry*)(this->aData + sizeof(Header) + this->aTextureCount * sizeof(TextureEntry));
+
+	// Every level has to lie inside the file and hold exactly the blocks of its size
+	for (size_t t = 0; t < this->aTextureCount; t++)
+	{
+		const TextureEntry& lTexture = this->aTextures[t];
+		if (lTexture.aFormat != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && lTexture.aFormat != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			return false;
+		if (lTexture.aLevelCount == 0 || lTexture.aFirstLevel > lHeader->aLevelCount || lTexture.aLevelCount > lHeader->aLevelCount - lTexture.aFirstLevel)
+			return false;
+		for (uint32_t l = 0; l < lTexture.aLevelCount; l++)
+		{
+			const LevelEntry& lLevel = this->aLevels[lTexture.aFirstLevel + l];
+			if (lLevel.aSize != mfGetLevelSize(lTexture.aFormat, lLevel.aWidth, lLevel.aHeight) ||
+				lLevel.aOffset < lTablesSize || lLevel.aOffset > this->aSize || lLevel.aSize > this->aSize - lLevel.aOffset)
+				return false;
+		}
+	}
+	return true;
+}
+
+GLuint TextureContainer::mfCreateTexture(size_t pIndex) const
+{
+	const TextureEntry& lTexture = this->aTextures[pIndex];
+	GLuint lId = 0;
+	glGenTextures(1, &lId);
+	gGLState.mpBindTexture(0, GL_TEXTURE_2D, lId);
+	// The levels are read from the mapping, not from an unpack buffer
+	gGLState.mpBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	for (uint32_t l = 0; l < lTexture.aLevelCount; l++)
+	{
+		const LevelEntry& lLevel = this->aLevels[lTexture.aFirstLevel + l];
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, lTexture.aFormat, lLevel.aWidth, lLevel.aHeight, 0, lLevel.aSize, this->aData + lLevel.aOffset);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)lTexture.aLevelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return lId;
+}
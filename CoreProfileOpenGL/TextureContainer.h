@@ -0,0 +1,82 @@
+#pragma once
+
+// Std. Includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+
+// Textures baked offline into one file: a header, a table of textures and mip levels, then the DXT1/DXT5 blocks of
+// every level in upload order. At run time the file is mapped and the levels are handed to glCompressedTexImage2D
+// straight from the mapping, so there is no decoding, no mipmap generation and no copy on the application side.
+class TextureContainer
+{
+public:
+	TextureContainer();
+	~TextureContainer();
+
+	// Decodes the images, builds their mipmaps and compresses them into a container at pPath. Images without alpha
+	// become DXT1, the others DXT5. The compression of a level is split over gJobs.
+	static bool mfBake(const std::vector<std::string>& pSources, const std::string& pPath);
+
+	// Evicts the file from the OS file cache, so the next mfOpen reads it from the disk. Only on Linux.
+	static void mpDropFromFileCache(const std::string& pPath);
+
+	// Whether the context takes DXT compressed textures
+	static bool mfIsSupported();
+
+	// Maps the file and checks its tables, false for a missing, truncated or foreign file
+	bool mfOpen(const std::string& pPath);
+	void mpClose();
+
+	size_t mfGetTextureCount() const { return this->aTextureCount; }
+	size_t mfGetSize() const { return this->aSize; }
+
+	// Creates texture pIndex with all its levels, only call on the GL thread
+	GLuint mfCreateTexture(size_t pIndex) const;
+
+private:
+	struct Header
+	{
+		char aMagic[8];
+		uint32_t aTextureCount;
+		uint32_t aLevelCount;
+	};
+
+	struct TextureEntry
+	{
+		uint32_t aFormat;
+		uint32_t aFirstLevel;
+		uint32_t aLevelCount;
+		uint32_t aPadding;
+	};
+
+	struct LevelEntry
+	{
+		uint64_t aOffset;
+		uint32_t aSize;
+		uint32_t aWidth;
+		uint32_t aHeight;
+		uint32_t aPadding;
+	};
+
+	// Level data starts at multiples of this
+	static const size_t LEVEL_ALIGNMENT = 16;
+
+	const unsigned char* aData;
+	size_t aSize;
+	size_t aTextureCount;
+	const TextureEntry* aTextures;
+	const LevelEntry* aLevels;
+
+#ifdef _WIN32
+	// File and mapping handles, the view stays valid until both are closed
+	void* aFile;
+	void* aMapping;
+#endif
+
+	// Points the tables into the mapping after checking that they and every level lie inside it
+	bool mfReadTables();
+};
@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <soil/image_helper.h>
+#include <soil/stb_image_aug.h>
+
+#include "GLStateCache.h"
+#include "ParallelFor.h"
+#include "TextureStreamer.h"
+
+TextureStreamer::TextureStreamer() : aResidentCount(0), aFailedCount(0), aUploadedBytes(0), aUpdateMs(0.0), aPlaceholder(0), aBytesPerFrame(0),
+	aDecodedBytes(0), aDecodeMs(0.0), aStopping(false), aNextBuffer(0)
+{
+	for (unsigned int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+	{
+		this->aPixelBuffers[i] = 0;
+		this->aFences[i] = 0;
+	}
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// An early return may skip mpDestroy, joinable threads would terminate the program. The GL objects are left to
+	// the context, which may already be gone here.
+	this->mpStopLoaders();
+}
+
+void TextureStreamer::mpInit(unsigned int pLoaderCount, size_t pBytesPerFrame)
+{
+	this->aBytesPerFrame = pBytesPerFrame;
+
+	const unsigned char lGrey[4] = { 128, 128, 128, 255 };
+	glGenTextures(1, &this->aPlaceholder);
+	gGLState.mpBindTexture(0, GL_TEXTURE_2D, this->aPlaceholder);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, lGrey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenBuffers(PIXEL_BUFFER_COUNT, this->aPixelBuffers);
+	for (unsigned int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+	{
+		gGLState.mpBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->aPixelBuffers[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, PIXEL_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+	}
+	gGLState.mpBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	this->aStopping = false;
+	for (unsigned int i = 0; i < std::max(1u, pLoaderCount); i++)
+		this->aLoaders.push_back(std::thread(&TextureStreamer::mpLoaderLoop, this));
+}
+
+void TextureStreamer::mpStopLoaders()
+{
+	{
+		std::lock_guard<std::mutex> lLock(this->aMutex);
+		this->aStopping = true;
+	}
+	this->aLoadWake.notify_all();
+	for (size_t i = 0; i < this->aLoaders.size(); i++)
+		this->aLoaders[i].join();
+	this->aLoaders.clear();
+}
+
+void TextureStreamer::mpDestroy()
+{
+	this->mpStopLoaders();
+
+	for (size_t i = 0; i < this->aTextures.size(); i++)
+	{
+		StreamedTexture& lTexture = *this->aTextures[i];
+		if (lTexture.aTexture != 0)
+		{
+			gGLState.mpForgetTexture(lTexture.aTexture);
+			glDeleteTextures(1, &lTexture.aTexture);
+		}
+	}
+	this->aTextures.clear();
+	this->aToDecode.clear();
+	this->aDecoded.clear();
+	this->aUploads.clear();
+	this->aDecodedBytes = 0;
+
+	for (unsigned int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+	{
+		if (this->aFences[i] != 0)
+			glDeleteSync(this->aFences[i]);
+		this->aFences[i] = 0;
+		if (this->aPixelBuffers[i] != 0)
+		{
+			gGLState.mpForgetBuffer(this->aPixelBuffers[i]);
+			glDeleteBuffers(1, &this->aPixelBuffers[i]);
+		}
+		this->aPixelBuffers[i] = 0;
+	}
+	if (this->aPlaceholder != 0)
+	{
+		gGLState.mpForgetTexture(this->aPlaceholder);
+		glDeleteTextures(1, &this->aPlaceholder);
+		this->aPlaceholder = 0;
+	}
+}
+
+unsigned int TextureStreamer::mfRequest(const std::string& pPath)
+{
+	StreamedTexture* lTexture = new StreamedTexture();
+	lTexture->aPath = pPath;
+	lTexture->aTexture = 0;
+	lTexture->aResident = false;
+	lTexture->aUploadLevel = 0;
+	lTexture->aUploadedRows = 0;
+	this->aTextures.push_back(std::unique_ptr<StreamedTexture>(lTexture));
+
+	{
+		std::lock_guard<std::mutex> lLock(this->aMutex);
+		this->aToDecode.push_back(lTexture);
+	}
+	this->aLoadWake.notify_one();
+	return (unsigned int)(this->aTextures.size() - 1);
+}
+
+GLuint TextureStreamer::mfGetTexture(unsigned int pId) const
+{
+	const StreamedTexture& lTexture = *this->aTextures[pId];
+	return lTexture.aResident ? lTexture.aTexture : this->aPlaceholder;
+}
+
+bool TextureStreamer::mfIsResident(unsigned int pId) const
+{
+	return this->aTextures[pId]->aResident;
+}
+
+double TextureStreamer::mfGetDecodeMs()
+{
+	std::lock_guard<std::mutex> lLock(this->aMutex);
+	return this->aDecodeMs;
+}
+
+void TextureStreamer::mpUpdate()
+{
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lLock(this->aMutex);
+		this->aUploads.insert(this->aUploads.end(), this->aDecoded.begin(), this->aDecoded.end());
+		this->aDecoded.clear();
+	}
+
+	this->aUploadedBytes = 0;
+	while (!this->aUploads.empty() && this->aUploadedBytes < this->aBytesPerFrame)
+	{
+		StreamedTexture& lTexture = *this->aUploads.front();
+		if (lTexture.aLevels.empty())
+		{
+			// Decoding failed, the placeholder stays
+			this->aFailedCount++;
+			this->aUploads.pop_front();
+			continue;
+		}
+
+		size_t lUploaded = this->mfUploadRows(lTexture, this->aBytesPerFrame - this->aUploadedBytes);
+		if (lUploaded == 0)
+			break;
+		this->aUploadedBytes += lUploaded;
+
+		if (lTexture.aUploadedRows == lTexture.aLevels[lTexture.aUploadLevel].aHeight)
+		{
+			lTexture.aUploadLevel++;
+			lTexture.aUploadedRows = 0;
+		}
+		if (lTexture.aUploadLevel == lTexture.aLevels.size())
+		{
+			this->mpFinish(lTexture);
+			this->aUploads.pop_front();
+		}
+	}
+
+	std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+	this->aUpdateMs = lElapsed.count();
+}
+
+size_t TextureStreamer::mfUploadRows(StreamedTexture& pTexture, size_t pBudget)
+{
+	GLsync& lFence = this->aFences[this->aNextBuffer];
+	if (lFence != 0)
+	{
+		if (glClientWaitSync(lFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			return 0;
+		glDeleteSync(lFence);
+		lFence = 0;
+	}
+
+	// Storage for all levels is allocated with the first rows
+	if (pTexture.aTexture == 0)
+	{
+		glGenTextures(1, &pTexture.aTexture);
+		gGLState.mpBindTexture(0, GL_TEXTURE_2D, pTexture.aTexture);
+		for (size_t l = 0; l < pTexture.aLevels.size(); l++)
+			glTexImage2D(GL_TEXTURE_2D, (GLint)l, GL_RGBA8, pTexture.aLevels[l].aWidth, pTexture.aLevels[l].aHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)pTexture.aLevels.size() - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// Whole rows of one level only, at least one even when it is over the budget
+	const TextureLevel& lLevel = pTexture.aLevels[pTexture.aUploadLevel];
+	size_t lRowBytes = (size_t)lLevel.aWidth * 4;
+	size_t lMaxRows = std::max<size_t>(1, std::min(pBudget, (size_t)PIXEL_BUFFER_SIZE) / lRowBytes);
+	int lRows = (int)std::min<size_t>(lMaxRows, lLevel.aHeight - pTexture.aUploadedRows);
+	size_t lBytes = lRows * lRowBytes;
+
+	gGLState.mpBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->aPixelBuffers[this->aNextBuffer]);
+	void* lMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, lBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (lMapped != nullptr)
+	{
+		memcpy(lMapped, &pTexture.aPixels[lLevel.aOffset + pTexture.aUploadedRows * lRowBytes], lBytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		gGLState.mpBindTexture(0, GL_TEXTURE_2D, pTexture.aTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, pTexture.aUploadLevel, 0, pTexture.aUploadedRows, lLevel.aWidth, lRows, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	// Texture calls elsewhere would read from the bound unpack buffer
+	gGLState.mpBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (lMapped == nullptr)
+		return 0;
+
+	lFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	this->aNextBuffer = (this->aNextBuffer + 1) % PIXEL_BUFFER_COUNT;
+
+	pTexture.aUploadedRows += lRows;
+	return lBytes;
+}
+
+void TextureStreamer::mpFinish(StreamedTexture& pTexture)
+{
+	pTexture.aResident = true;
+	this->aResidentCount++;
+
+	size_t lBytes = pTexture.aPixels.size();
+	std::vector<unsigned char>().swap(pTexture.aPixels);
+	{
+		std::lock_guard<std::mutex> lLock(this->aMutex);
+		this->aDecodedBytes -= lBytes;
+	}
+	this->aLoadWake.notify_all();
+}
+
+void TextureStreamer::mpLoaderLoop()
+{
+	while (true)
+	{
+		StreamedTexture* lTexture;
+		{
+			std::unique_lock<std::mutex> lLock(this->aMutex);
+			this->aLoadWake.wait(lLock, [this] { return this->aStopping || (!this->aToDecode.empty() && this->aDecodedBytes < MAX_DECODED_BYTES); });
+			if (this->aStopping)
+				return;
+			lTexture = this->aToDecode.front();
+			this->aToDecode.pop_front();
+		}
+
+		std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+		std::ifstream lFile(lTexture->aPath.c_str(), std::ios::binary);
+		std::vector<unsigned char> lBytes((std::istreambuf_iterator<char>(lFile)), std::istreambuf_iterator<char>());
+		int lWidth = 0, lHeight = 0, lChannels = 0;
+		unsigned char* lDecoded = lBytes.empty() ? nullptr : stbi_load_from_memory(&lBytes[0], (int)lBytes.size(), &lWidth, &lHeight, &lChannels, 4);
+
+		// The whole chain down to 1x1 is built here with 2x2 boxes, generating it on the GL thread would cost the frame.
+		// A row has to fit into one pixel buffer.
+		std::vector<unsigned char> lPixels;
+		std::vector<TextureLevel> lLevels;
+		if (lDecoded != nullptr && (size_t)lWidth * 4 <= PIXEL_BUFFER_SIZE)
+		{
+			TextureLevel lLevel = { 0, lWidth, lHeight };
+			size_t lSize = 0;
+			while (true)
+			{
+				lLevel.aOffset = lSize;
+				lLevels.push_back(lLevel);
+				lSize += (size_t)lLevel.aWidth * lLevel.aHeight * 4;
+				if (lLevel.aWidth == 1 && lLevel.aHeight == 1)
+					break;
+				lLevel.aWidth = std::max(1, lLevel.aWidth / 2);
+				lLevel.aHeight = std::max(1, lLevel.aHeight / 2);
+			}
+
+			lPixels.resize(lSize);
+			memcpy(&lPixels[0], lDecoded, (size_t)lWidth * lHeight * 4);
+			if (lLevels.size() > 1)
+			{
+				// The first level below the image is most of the work; for large images its rows are split over gJobs.
+				// The smaller levels follow in one pass while their rows are in the cache.
+				const TextureLevel& lFirst = lLevels[1];
+				unsigned int lThreadCount = std::min(gJobs.mfGetWorkerCount() + 1, (unsigned int)lFirst.aHeight / MIN_MIPMAP_ROWS_PER_THREAD);
+				if (lThreadCount > 1)
+				{
+					unsigned char* lSource = &lPixels[0];
+					unsigned char* lTarget = &lPixels[lFirst.aOffset];
+					mpParallelFor((unsigned int)lFirst.aHeight, lThreadCount, [&](unsigned int pBegin, unsigned int pEnd)
+					{
+						mipmap_image_rows(lSource, lWidth, lHeight, 4, lTarget, (int)pBegin, (int)(pEnd - pBegin));
+					});
+					if (lLevels.size() > 2)
+						mipmap_image_chain(lTarget, lFirst.aWidth, lFirst.aHeight, 4, &lPixels[lLevels[2].aOffset]);
+				}
+				else
+					mipmap_image_chain(&lPixels[0], lWidth, lHeight, 4, &lPixels[lFirst.aOffset]);
+			}
+		}
+		stbi_image_free(lDecoded);
+		std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+
+		std::lock_guard<std::mutex> lLock(this->aMutex);
+		this->aDecodedBytes += lPixels.size();
+		this->aDecodeMs += lElapsed.count();
+		lTexture->aPixels.swap(lPixels);
+		lTexture->aLevels.swap(lLevels);
+		this->aDecoded.push_back(lTexture);
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// Std. Includes
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+
+// Loads textures in the background. Loader threads read and decode the files and build the mipmaps, and mpUpdate,
+// called once per frame on the GL thread, copies rows of the levels into a ring of pixel unpack buffers and uploads
+// them with glTexSubImage2D, no more than a set number of bytes per frame. Until a texture is complete mfGetTexture
+// returns a grey placeholder, so a scene can be drawn right away while hundreds of textures come in.
+class TextureStreamer
+{
+public:
+	// Textures complete so far, and the bytes uploaded and time spent by the last mpUpdate
+	unsigned int aResidentCount;
+	unsigned int aFailedCount;
+	size_t aUploadedBytes;
+	double aUpdateMs;
+
+	TextureStreamer();
+	~TextureStreamer();
+
+	// pLoaderCount threads read and decode. They are separate from gJobs since they mostly wait for the disk.
+	void mpInit(unsigned int pLoaderCount, size_t pBytesPerFrame);
+	void mpDestroy();
+
+	// Queues the file for loading and returns its id for mfGetTexture
+	unsigned int mfRequest(const std::string& pPath);
+
+	// The texture once it is complete, the placeholder before and when loading failed
+	GLuint mfGetTexture(unsigned int pId) const;
+	bool mfIsResident(unsigned int pId) const;
+	size_t mfGetCount() const { return this->aTextures.size(); }
+
+	// Uploads up to the byte budget, only call on the GL thread
+	void mpUpdate();
+
+	// Time the loaders spent decoding so far
+	double mfGetDecodeMs();
+
+private:
+	// Pixel unpack buffers uploads rotate through. A buffer is only refilled once the GPU read it, checked with a
+	// fence, so a slow driver delays the upload instead of stalling the frame.
+	static const unsigned int PIXEL_BUFFER_COUNT = 4;
+	static const size_t PIXEL_BUFFER_SIZE = 4 * 1024 * 1024;
+	// Decoded pixels waiting for upload, loaders pause above it
+	static const size_t MAX_DECODED_BYTES = 64 * 1024 * 1024;
+	// Rows of the first mipmap level per thread before building it is split over gJobs
+	static const unsigned int MIN_MIPMAP_ROWS_PER_THREAD = 256;
+
+	struct TextureLevel
+	{
+		size_t aOffset;
+		int aWidth;
+		int aHeight;
+	};
+
+	struct StreamedTexture
+	{
+		std::string aPath;
+		GLuint aTexture;
+		bool aResident;
+		// RGBA8 pixels of all mipmap levels from the loader, freed once uploaded. No levels when decoding failed.
+		std::vector<unsigned char> aPixels;
+		std::vector<TextureLevel> aLevels;
+		// Upload position
+		unsigned int aUploadLevel;
+		int aUploadedRows;
+	};
+
+	// Entries never move, loaders hold pointers to them
+	std::vector<std::unique_ptr<StreamedTexture> > aTextures;
+	GLuint aPlaceholder;
+	size_t aBytesPerFrame;
+
+	// Shared with the loaders
+	std::mutex aMutex;
+	std::condition_variable aLoadWake;
+	std::deque<StreamedTexture*> aToDecode;
+	std::deque<StreamedTexture*> aDecoded;
+	size_t aDecodedBytes;
+	double aDecodeMs;
+	bool aStopping;
+	std::vector<std::thread> aLoaders;
+
+	// GL thread only: decoded textures in upload order, the first one partly uploaded
+	std::deque<StreamedTexture*> aUploads;
+	GLuint aPixelBuffers[PIXEL_BUFFER_COUNT];
+	GLsync aFences[PIXEL_BUFFER_COUNT];
+	unsigned int aNextBuffer;
+
+	void mpLoaderLoop();
+	// Wakes the loaders and joins them, safe to call again
+	void mpStopLoaders();
+	// Uploads the next rows of pTexture within pBudget, returns the bytes uploaded, 0 when no buffer was free
+	size_t mfUploadRows(StreamedTexture& pTexture, size_t pBudget);
+	void mpFinish(StreamedTexture& pTexture);
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+// Std. Includes
+#include <cstring>
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+
+#include "GLStateCache.h"
+
+// Uniform block binding points shared by the C++ side and every program using the blocks
+const GLuint LIGHTS_BINDING = 0;
+const GLuint MATERIAL_BINDING = 1;
+
+// Connects the named uniform block of a program to a binding point. GLSL 330 has no layout(binding = N).
+inline bool mfBindUniformBlock(GLuint pProgramID, const char* pBlockName, GLuint pBindingPoint)
+{
+	GLuint lBlockIndex = glGetUniformBlockIndex(pProgramID, pBlockName);
+	if (lBlockIndex == GL_INVALID_INDEX)
+		return false;
+
+	glUniformBlockBinding(pProgramID, lBlockIndex, pBindingPoint);
+	return true;
+}
+
+// A uniform buffer holding a number of std140 blocks of type T with a CPU side copy.
+// mpSet only marks slots whose contents actually changed, mfUpload sends the dirty byte range with one glBufferSubData.
+template <typename T>
+class UniformBuffer
+{
+public:
+	// Statistics, reset by the caller whenever it wants
+	unsigned int aUploadCount;
+	unsigned int aUploadedBytes;
+
+	~UniformBuffer() {}
+
+	UniformBuffer() : aUploadCount(0), aUploadedBytes(0), aBuffer(0), aStride(0), aCount(0), aDirtyBegin(0), aDirtyEnd(0)
+	{
+	}
+
+	// With pPerSlotBinding each slot starts at a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so it can be bound
+	// on its own through mpBindSlot. Otherwise the slots are tightly packed and mirror a GLSL array bound with mpBindAll.
+	void mpInit(unsigned int pCount, bool pPerSlotBinding)
+	{
+		this->aStride = sizeof(T);
+		if (pPerSlotBinding)
+		{
+			GLint lAlignment = 1;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &lAlignment);
+			this->aStride = ((sizeof(T) + lAlignment - 1) / lAlignment) * lAlignment;
+		}
+
+		this->aCount = pCount;
+		this->aData.assign(this->aStride * pCount, 0);
+
+		glGenBuffers(1, &this->aBuffer);
+		gGLState.mpBindBuffer(GL_UNIFORM_BUFFER, this->aBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, this->aData.size(), &this->aData[0], GL_DYNAMIC_DRAW);
+	}
+
+	void mpSet(unsigned int pSlot, const T& pData)
+	{
+		unsigned char* lDest = &this->aData[pSlot * this->aStride];
+		if (memcmp(lDest, &pData, sizeof(T)) == 0)
+			return;
+
+		memcpy(lDest, &pData, sizeof(T));
+		this->mpMarkDirty(pSlot * this->aStride, pSlot * this->aStride + sizeof(T));
+	}
+
+	// Sends everything changed since the last upload. Returns false when there was nothing to send.
+	bool mfUpload()
+	{
+		if (this->aDirtyBegin >= this->aDirtyEnd)
+			return false;
+
+		gGLState.mpBindBuffer(GL_UNIFORM_BUFFER, this->aBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, this->aDirtyBegin, this->aDirtyEnd - this->aDirtyBegin, &this->aData[this->aDirtyBegin]);
+
+		this->aUploadCount++;
+		this->aUploadedBytes += this->aDirtyEnd - this->aDirtyBegin;
+		this->aDirtyBegin = this->aDirtyEnd = 0;
+		return true;
+	}
+
+	void mpBindAll(GLuint pBindingPoint)
+	{
+		gGLState.mpBindBufferBase(GL_UNIFORM_BUFFER, pBindingPoint, this->aBuffer);
+	}
+
+	void mpBindSlot(GLuint pBindingPoint, unsigned int pSlot)
+	{
+		gGLState.mpBindBufferRange(GL_UNIFORM_BUFFER, pBindingPoint, this->aBuffer, pSlot * this->aStride, sizeof(T));
+	}
+
+	void mpDestroy()
+	{
+		if (this->aBuffer != 0)
+		{
+			gGLState.mpForgetBuffer(this->aBuffer);
+			glDeleteBuffers(1, &this->aBuffer);
+		}
+		this->aBuffer = 0;
+	}
+
+private:
+	GLuint aBuffer;
+	size_t aStride;
+	unsigned int aCount;
+	std::vector<unsigned char> aData;
+
+	// Byte range waiting for upload, empty when aDirtyBegin == aDirtyEnd
+	size_t aDirtyBegin;
+	size_t aDirtyEnd;
+
+	void mpMarkDirty(size_t pBegin, size_t pEnd)
+	{
+		if (this->aDirtyBegin >= this->aDirtyEnd)
+		{
+			this->aDirtyBegin = pBegin;
+			this->aDirtyEnd = pEnd;
+			return;
+		}
+
+		if (pBegin < this->aDirtyBegin)
+			this->aDirtyBegin = pBegin;
+		if (pEnd > this->aDirtyEnd)
+			this->aDirtyEnd = pEnd;
+	}
+};
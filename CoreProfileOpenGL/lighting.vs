@@ -5,7 +5,23 @@ layout (location = 1) in vec3 normal;
 out vec3 Normal;
 out vec3 FragPos;
 
+#ifdef INSTANCED
+// Per instance attributes, see MeshInstances
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in vec4 instanceDiffuse;     // diffuse color, shininess
+layout (location = 8) in vec3 instanceSpecular;
+layout (location = 9) in mat3 instanceNormalMatrix;
+
+flat out vec4 MaterialDiffuse;
+flat out vec3 MaterialSpecular;
+
+#define model instanceModel
+#define normalMatrix instanceNormalMatrix
+#else
 uniform mat4 model;
+// Inverse transpose of the model matrix, computed on the CPU once per draw
+uniform mat3 normalMatrix;
+#endif
 uniform mat4 view;
 uniform mat4 projection;
 
@@ -13,5 +29,9 @@ void main()
 {
     gl_Position = projection * view *  model * vec4(position, 1.0f);
     FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;  
+    Normal = normalMatrix * normal;
+#ifdef INSTANCED
+    MaterialDiffuse = instanceDiffuse;
+    MaterialSpecular = instanceSpecular;
+#endif
 } 
\ No newline at end of file
@@ -0,0 +1,70 @@
+#version 330 core
+#include "lighting_structs.glsl"
+
+// Lights are only binned into the clusters their cone reaches, so the ambient term is limited to the cone too
+#define CONE_AMBIENT
+
+in vec3 FragPos;  
+in vec3 Normal;  
+  
+out vec4 color;
+  
+// Must match CLUSTER_X, CLUSTER_Y and CLUSTER_Z in LightClusters.h
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+
+uniform vec3 ambientKeyColor;
+uniform vec3 viewPos;
+
+// Every light is 5 texels laid out like SpotlightBlock
+uniform samplerBuffer lightData;
+// (offset, count) into lightIndices for every cluster
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer lightIndices;
+
+uniform vec2 tileScale;
+uniform float sliceScale;
+uniform float sliceBias;
+uniform float zNear;
+uniform float zFar;
+
+#include "lighting_material.glsl"
+
+Light FetchLight(int index)
+{
+    vec4 t0 = texelFetch(lightData, index * 5);
+    vec4 t1 = texelFetch(lightData, index * 5 + 1);
+    vec4 t2 = texelFetch(lightData, index * 5 + 2);
+    vec4 t3 = texelFetch(lightData, index * 5 + 3);
+    vec4 t4 = texelFetch(lightData, index * 5 + 4);
+    return Light(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.xyz, t4.w);
+}
+
+#include "spotlight.glsl"
+
+int GetCluster()
+{
+    // View space depth from the perspective depth buffer value
+    float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+    float depth = (2.0 * zNear * zFar) / (zFar + zNear - ndcDepth * (zFar - zNear));
+
+    ivec2 tile = ivec2(gl_FragCoord.xy * tileScale);
+    int slice = clamp(int(log(depth) * sliceScale + sliceBias), 0, CLUSTER_Z - 1);
+    return (slice * CLUSTER_Y + min(tile.y, CLUSTER_Y - 1)) * CLUSTER_X + min(tile.x, CLUSTER_X - 1);
+}
+
+void main()
+{
+    LoadMaterial();
+    vec3 norm = normalize(Normal);        
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+    uvec2 range = texelFetch(clusterRanges, GetCluster()).xy;
+
+    vec3 result = ambientKeyColor * 0.1f;
+    for (uint i = 0u; i < range.y; i++)
+        result += CalcSpotlight(FetchLight(int(texelFetch(lightIndices, int(range.x + i)).r)), norm, viewDir);
+
+    color = vec4(result, 1.0f); 
+} 
\ No newline at end of file
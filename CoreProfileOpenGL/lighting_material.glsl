@@ -0,0 +1,22 @@
+// Material of the fragment. Regular draws read the MaterialBlock uniform buffer, INSTANCED draws get
+// the material of their instance from lighting.vs. Call LoadMaterial() before using material.
+#ifdef INSTANCED
+flat in vec4 MaterialDiffuse;
+flat in vec3 MaterialSpecular;
+
+Material material;
+
+void LoadMaterial()
+{
+    material = Material(MaterialDiffuse.rgb, MaterialDiffuse.a, MaterialSpecular);
+}
+#else
+layout (std140) uniform MaterialBlock
+{
+    Material material;
+};
+
+void LoadMaterial()
+{
+}
+#endif
@@ -0,0 +1,23 @@
+// Shared by every lighting shader, included through the #include support of LoadShaders.
+// Field order matches MaterialBlock / SpotlightBlock (std140: every vec3 is followed by a float)
+struct Material 
+{
+    vec3 diffuse;
+    float shininess;
+    vec3 specular;
+};  
+
+struct Light 
+{
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+  
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;       
+    float quadratic;
+};
@@ -1,14 +1,39 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <thread>
+#include <vector>
 
-#include <GL\glew.h>
-#include <GLFW\glfw3.h>
-#include <soil\SOIL.h>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <soil/SOIL.h>
 #include <time.h>
 
 #include "shader.hpp"
 #include "Camera.h"
 #include "Spotlight.h"
 #include "Material.h"
+#include "UniformBuffer.h"
+#include "LightClusters.h"
+#include "ParallelFor.h"
+#include "RunOptions.h"
+#include "FrameProfiler.h"
+#include "OffscreenContext.h"
+#include "ShaderWatcher.h"
+#include "LightingProgram.h"
+#include "Mesh.h"
+#include "MeshInstances.h"
+#include "GLStateCache.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "Frustum.h"
+#include "Bvh.h"
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Simulation.h"
+#include "TextureStreamer.h"
+#include "TextureContainer.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -18,89 +43,198 @@ void mpKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mo
 void mpMouseCallback(GLFWwindow* window, double xpos, double ypos);
 void mpScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void mpHandleInput();
+void mpAddRandomSpotlights(unsigned int pCount);
 float mfGetRandomFloat();
+void mpLayoutCubes(unsigned int pCount);
+std::vector<MeshVertex> mfGetSubdividedCube(unsigned int pDetail);
+void mpBenchmarkBvhQueries(const Bvh& pBvh, const glm::mat4& pViewProjection);
+void mpBenchmarkJobScaling(unsigned int pMaxThreads, const glm::mat4& pViewProjection);
+void mpBenchmarkTextureStartup(const std::string& pContainerPath);
+void mpDeleteTextures(std::vector<GLuint>& pTextures);
+std::string mfGetLightingDefines(const std::vector<Material>& pMaterials, bool pFixedLightCount);
+size_t mfGetLightingProgram(std::vector<LightingProgram>& pPrograms, const char* pFragmentShader, const std::string& pDefines);
+bool mfAnyLightingProgramFailed(const std::vector<LightingProgram>& pPrograms);
 
 // Window dimensions
 const GLuint WIDTH = 800, HEIGHT = 600;
 
-// Camera
-Camera gCamera(glm::vec3(0.0f, 0.0f, 3.0f));
+// Depth buffer of the occlusion culler
+const GLuint OCCLUSION_WIDTH = 256, OCCLUSION_HEIGHT = 192;
+
+// Fewest draws a thread records into the render queue
+const unsigned int MIN_DRAWS_PER_THREAD = 4096;
+
+// Texture streaming: loader threads, and bytes uploaded per frame at most
+const unsigned int TEXTURE_LOADER_COUNT = 2;
+const size_t TEXTURE_UPLOAD_BYTES_PER_FRAME = 4 * 1024 * 1024;
+// Images the streamed textures cycle through
+const char* STREAMED_TEXTURE_PATHS[] = { "container2.png", "container2_specular.png", "wall.jpg" };
+
+// Projection clip planes
+const GLfloat NEAR_PLANE = 0.1f, FAR_PLANE = 100.0f;
+
+// Bounds of the unit cube, the cubes and the floor before scaling
+const glm::vec3 CUBE_BOUNDS_MIN(-0.5f), CUBE_BOUNDS_MAX(0.5f);
+
+// Camera and cube animation, ticking at a fixed rate apart from the frame rate
+Simulation gSimulation(Camera(glm::vec3(0.0f, 0.0f, 3.0f)));
 
 // Materials
 Material gCubeMaterial(glm::vec3(1.0f, 0.722f, 0.318f), 100.0f);
 Material gFloorMaterial(glm::vec3(0.404f, 0.4f, 0.851f), 10.0f);
 
-// Spotlights
-Spotlight gSpotlightA(glm::vec3(0.0, 3.0, 0.0), 
-					  glm::vec3(0.0, 0.0, 0.0), 
-					  glm::cos(glm::radians(20.0f)), 
-					  glm::cos(glm::radians(22.0f)), 
-					  1.0f, 0.09f, 0.032);
-
-Spotlight gSpotlightB(glm::vec3(0.0, 0.0, 3.0), 
-					  glm::vec3(0.0, 0.0, 0.0), 
-					  glm::cos(glm::radians(8.0f)), 
-					  glm::cos(glm::radians(10.0f)), 
-					  1.0f, 0.09f, 0.032);
-
-GLfloat gDeltaTime = 0.0f;	
-GLfloat gLastFrame = 0.0f;  	
+// Materials the cubes cycle through, a single cube uses gCubeMaterial
+std::vector<Material> gCubeMaterials = {
+	gCubeMaterial,
+	Material(glm::vec3(0.8f, 0.25f, 0.25f), 32.0f),
+	Material(glm::vec3(0.25f, 0.75f, 0.35f), 100.0f),
+	Material(glm::vec3(0.3f, 0.45f, 0.9f), 32.0f),
+	Material(glm::vec3(0.9f, 0.85f, 0.3f), 100.0f),
+	Material(glm::vec3(0.7f, 0.35f, 0.85f), 32.0f),
+	Material(glm::vec3(0.25f, 0.8f, 0.8f), 100.0f),
+	Material(glm::vec3(0.95f, 0.55f, 0.2f), 32.0f)
+};
+
+// Position (xyz) and uniform scale (w) of every cube
+std::vector<glm::vec4> gCubePlacements;
+
+// Spotlights, every entry is uploaded to the lights array of lighting.fs
+std::vector<Spotlight> gSpotlights = {
+	Spotlight(glm::vec3(0.0, 3.0, 0.0), 
+			  glm::vec3(0.0, 0.0, 0.0), 
+			  glm::cos(glm::radians(20.0f)), 
+			  glm::cos(glm::radians(22.0f)), 
+			  1.0f, 0.09f, 0.032),
+
+	Spotlight(glm::vec3(0.0, 0.0, 3.0), 
+			  glm::vec3(0.0, 0.0, 0.0), 
+			  glm::cos(glm::radians(8.0f)), 
+			  glm::cos(glm::radians(10.0f)), 
+			  1.0f, 0.09f, 0.032)
+};
+
 int gCurrentAmbientIdx = 0;
 
-int main()
+int main(int argc, char* argv[])
 {
-	srand(time(NULL));
+	RunOptions lOptions;
+	if (!lOptions.mfParse(argc, argv))
+		return -1;
 
-	// Init GLFW
-	glfwInit();
+	// Baking needs no context, it decodes and compresses the streamed images and exits
+	if (!lOptions.aBakeTexturesPath.empty())
+	{
+		gJobs.mpStart((lOptions.aThreadCount > 0 ? lOptions.aThreadCount : mfGetDefaultThreadCount()) - 1);
+		std::vector<std::string> lSources(STREAMED_TEXTURE_PATHS, STREAMED_TEXTURE_PATHS + sizeof(STREAMED_TEXTURE_PATHS) / sizeof(STREAMED_TEXTURE_PATHS[0]));
+		std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+		bool lBaked = TextureContainer::mfBake(lSources, lOptions.aBakeTexturesPath);
+		std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+		gJobs.mpStop();
+		if (!lBaked)
+			return -1;
+		printf("Baked %u textures into %s in %.1f ms\n", (unsigned int)lSources.size(), lOptions.aBakeTexturesPath.c_str(), lElapsed.count());
+		return 0;
+	}
 
-	// Set all the required options for GLFW
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	// Headless runs are benchmarks, keep the random light colors identical between them
+	srand(lOptions.aHeadless ? 0 : time(NULL));
 
-	// Create a GLFWwindow object that we can use for GLFW's functions
-	GLFWwindow* lWindow = glfwCreateWindow(WIDTH, HEIGHT, "LearnOpenGL", nullptr, nullptr);
+	GLFWwindow* lWindow = nullptr;
+	OffscreenContext lOffscreen;
 
-	if (lWindow == nullptr)
+	if (lOptions.aHeadless)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		if (!lOffscreen.mfCreateContext())
+		{
+			std::cout << "Failed to create offscreen OpenGL context" << std::endl;
+			return -1;
+		}
 	}
+	else
+	{
+		// Init GLFW
+		glfwInit();
 
-	glfwMakeContextCurrent(lWindow);
+		// Set all the required options for GLFW
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
-	// Set the required callback functions
-	glfwSetKeyCallback(lWindow, mpKeyCallback);
-	glfwSetCursorPosCallback(lWindow, mpMouseCallback);
-	glfwSetScrollCallback(lWindow, mpScrollCallback);
+		// Create a GLFWwindow object that we can use for GLFW's functions
+		lWindow = glfwCreateWindow(WIDTH, HEIGHT, "LearnOpenGL", nullptr, nullptr);
+
+		if (lWindow == nullptr)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+
+		glfwMakeContextCurrent(lWindow);
+
+		// Set the required callback functions
+		glfwSetKeyCallback(lWindow, mpKeyCallback);
+		glfwSetCursorPosCallback(lWindow, mpMouseCallback);
+		glfwSetScrollCallback(lWindow, mpScrollCallback);
+
+		// GLFW Options
+		glfwSetInputMode(lWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
-	// GLFW Options
-	glfwSetInputMode(lWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 
 	// Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
 	glewExperimental = GL_TRUE;
 
-	// Initialize GLEW to setup the OpenGL Function pointers
-	if (glewInit() != GLEW_OK)
+	// Initialize GLEW to setup the OpenGL Function pointers.
+	// Under EGL there is no GLX display, so glewInit reports an error after the GL entry points were already loaded.
+	GLenum lGlewResult = glewInit();
+	if (lGlewResult != GLEW_OK && !(lOptions.aHeadless && glGenVertexArrays != nullptr))
 	{
 		std::cout << "Failed to initialize GLEW" << std::endl;
 		return -1;
 	}
 
+	if (lOptions.aHeadless && !lOffscreen.mfCreateFramebuffer(WIDTH, HEIGHT))
+		return -1;
+
 	// Define the viewport dimensions
 	glViewport(0, 0, WIDTH, HEIGHT);
 
 	// OpenGL options
 	glEnable(GL_DEPTH_TEST);
 
-	// Build and compile our shader program
-	GLuint lLightingProgramID = LoadShaders("lighting.vs", "lighting.fs");
+	for (size_t i = 0; i < gSpotlights.size(); i++)
+		gSpotlights[i].mpSetColor(mfGetRandomFloat(), mfGetRandomFloat(), mfGetRandomFloat());
 
-	// Set up vertex data (and buffer(s)) and attribute pointers
+	if (!lOptions.aClustered && lOptions.aLightCount > MAX_SPOTLIGHTS)
+	{
+		std::cout << "Limiting the scene to " << MAX_SPOTLIGHTS << " spotlights" << std::endl;
+		lOptions.aLightCount = MAX_SPOTLIGHTS;
+	}
+	if (lOptions.aLightCount > gSpotlights.size())
+		mpAddRandomSpotlights(lOptions.aLightCount - gSpotlights.size());
+	else
+		gSpotlights.resize(lOptions.aLightCount, gSpotlights[0]);
+
+	// Start building the lighting shader variants, or reloading them from the program binary cache, while the scene is set up.
+	// Every draw asks for the cheapest permutation its material and the lights allow, equal requests share one program.
+	SetShaderCacheDirectory(lOptions.aShaderCachePath.empty() ? nullptr : lOptions.aShaderCachePath.c_str());
+	const char* lLightingShader = lOptions.aClustered ? "lighting_clustered.fs" : "lighting.fs";
+	std::vector<LightingProgram> lLightingPrograms;
+	mpLayoutCubes(lOptions.aCubeCount);
+	if (gCubePlacements.size() < gCubeMaterials.size())
+		gCubeMaterials.resize(gCubePlacements.size(), gCubeMaterial);
+
+	std::string lCubeDefines = mfGetLightingDefines(gCubeMaterials, !lOptions.aClustered);
+	if (lOptions.aInstanced)
+		lCubeDefines += " INSTANCED";
+	size_t lCubeProgram = mfGetLightingProgram(lLightingPrograms, lLightingShader, lCubeDefines);
+	size_t lFloorProgram = mfGetLightingProgram(lLightingPrograms, lLightingShader, mfGetLightingDefines({ gFloorMaterial }, !lOptions.aClustered));
+	bool lProgramsReady = false;
+
+	// Set up vertex data
 	GLfloat lVerticesData[] = {
 		// Positions          // Normals           // Texture Coords
 		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
@@ -146,167 +280,503 @@ int main()
 		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
 	};
 
-	GLuint lVAO;
-	glGenVertexArrays(1, &lVAO);
-	glBindVertexArray(lVAO);
-
-	GLuint lVBO;
-	glGenBuffers(1, &lVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, lVBO);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(lVerticesData), lVerticesData, GL_STATIC_DRAW);
-	
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-
-	glBindVertexArray(0);
+	// Weld the duplicate corners into an indexed mesh in a compact format, lighting.vs does not read texture coordinates.
+	// The floor is drawn with the same cube, scaled flat.
+	Mesh lCube;
+	if (lOptions.aCubeDetail > 1)
+		lCube.mpBuild(mfGetSubdividedCube(lOptions.aCubeDetail), false, 8 * sizeof(GLfloat));
+	else
+		lCube.mpBuild(lVerticesData, 36, 8, false);
+	lCube.mpPrintStats("cube");
+
+	// The floor never moves, so after the first update the scene only recomputes the cubes. The cube nodes are
+	// consecutive, their world matrices can be streamed to the instance buffer as they are.
+	Scene lScene;
+	uint32_t lFloorNode = lScene.mfAddNode(SCENE_NO_PARENT);
+	lScene.mpSetTranslation(lFloorNode, glm::vec3(0.0f, -0.5f, 0.0f));
+	lScene.mpSetScale(lFloorNode, glm::vec3(5.0f, 0.01f, 5.0f));
+	lScene.mpSetBoundingBox(lFloorNode, CUBE_BOUNDS_MIN, CUBE_BOUNDS_MAX);
+
+	uint32_t lFirstCubeNode = (uint32_t)lScene.mfSize();
+	for (size_t i = 0; i < gCubePlacements.size(); i++)
+	{
+		uint32_t lNode = lScene.mfAddNode(SCENE_NO_PARENT);
+		lScene.mpSetTranslation(lNode, glm::vec3(gCubePlacements[i]));
+		lScene.mpSetScale(lNode, glm::vec3(gCubePlacements[i].w));
+		lScene.mpSetBoundingBox(lNode, CUBE_BOUNDS_MIN, CUBE_BOUNDS_MAX);
+	}
+	unsigned int lThreadCount = lOptions.aThreadCount > 0 ? lOptions.aThreadCount : mfGetDefaultThreadCount();
+	gJobs.mpStart(lThreadCount - 1);
+	double lSceneMsTotal = 0.0;
+
+	// The instanced path streams every cube's model matrix and reads its material from a static instance buffer,
+	// the regular path sets the model matrix and binds the material slot for every cube
+	MeshInstances lCubeInstances;
+	if (lOptions.aInstanced)
+	{
+		std::vector<MaterialBlock> lInstanceMaterials(gCubePlacements.size());
+		for (size_t i = 0; i < lInstanceMaterials.size(); i++)
+			lInstanceMaterials[i] = gCubeMaterials[i % gCubeMaterials.size()].mfGetBlock();
 
-	GLuint lFloorVAO;
-	glGenVertexArrays(1, &lFloorVAO);
-	glBindVertexArray(lFloorVAO);
+		lCubeInstances.mpInit(lCube);
+		lCubeInstances.mpSetMaterials(lInstanceMaterials);
+	}
 
-	//Use the same VBO, the floor is also a 3D cube.
-	glBindBuffer(GL_ARRAY_BUFFER, lVBO);
+	// Forward shading walks the whole lights array, clustered shading reads the lights from texture buffers
+	UniformBuffer<SpotlightBlock> lLightBuffer;
+	LightClusters lClusters;
+	double lBinMsTotal = 0.0;
+
+	// GL calls issued and dropped by gGLState over all frames
+	unsigned int lStateIssued[GL_STATE_CALL_COUNT] = {};
+	unsigned int lStateElided[GL_STATE_CALL_COUNT] = {};
+
+	RenderQueue lRenderQueue;
+	double lRecordMsTotal = 0.0;
+	double lSortMsTotal = 0.0;
+
+	// Only the cubes whose bounds touch the view frustum are queued. The hierarchy covers all scene nodes.
+	Frustum lFrustum;
+	Bvh lBvh;
+	std::vector<uint32_t> lVisibleNodes;
+	std::vector<uint32_t> lVisibleFloor;
+	std::vector<uint32_t> lVisibleCubes;
+	double lCullMsTotal = 0.0;
+	double lRefitMsTotal = 0.0;
+	unsigned int lCulledTotal = 0;
+
+	// Cubes hide each other, the occluders are drawn as the unit cube of their model matrix
+	OcclusionCuller lOcclusion;
+	double lOcclusionMsTotal = 0.0;
+	double lOcclusionWaitMsTotal = 0.0;
+	unsigned int lOccludedTotal = 0;
+	if (lOptions.aOcclusion)
+	{
+		std::vector<glm::vec3> lCorners;
+		for (int i = 0; i < 8; i++)
+			lCorners.push_back(glm::mix(CUBE_BOUNDS_MIN, CUBE_BOUNDS_MAX, glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1)));
+		std::vector<uint32_t> lFaces = { 0, 2, 6, 4,  1, 3, 7, 5,  0, 1, 5, 4,  2, 3, 7, 6,  0, 1, 3, 2,  4, 5, 7, 6 };
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
+		lOcclusion.mpInit(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+		lOcclusion.mpSetOccluderMesh(lCorners, lFaces);
+	}
 
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
+	// Stands in for loading a level: every texture is requested up front and the frames go on while they arrive
+	TextureStreamer lTextures;
+	double lTextureMsTotal = 0.0;
+	double lTextureMsMax = 0.0;
+	double lTextureBytesTotal = 0.0;
+	int lTexturesDoneFrame = -1;
+	if (lOptions.aStreamTextureCount > 0)
+	{
+		lTextures.mpInit(TEXTURE_LOADER_COUNT, TEXTURE_UPLOAD_BYTES_PER_FRAME);
+		size_t lPathCount = sizeof(STREAMED_TEXTURE_PATHS) / sizeof(STREAMED_TEXTURE_PATHS[0]);
+		for (unsigned int i = 0; i < lOptions.aStreamTextureCount; i++)
+			lTextures.mfRequest(STREAMED_TEXTURE_PATHS[i % lPathCount]);
+	}
 
-	glBindVertexArray(0);
+	// Baked textures go to the GL straight from the mapped container, before the first frame
+	std::vector<GLuint> lContainerTextures;
+	if (!lOptions.aTextureContainerPath.empty())
+	{
+		TextureContainer lContainer;
+		std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+		if (!TextureContainer::mfIsSupported())
+			std::cout << "DXT textures are not supported, skipping " << lOptions.aTextureContainerPath << std::endl;
+		else if (lContainer.mfOpen(lOptions.aTextureContainerPath))
+		{
+			for (size_t i = 0; i < lContainer.mfGetTextureCount(); i++)
+				lContainerTextures.push_back(lContainer.mfCreateTexture(i));
+			std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+			printf("Texture container: %u textures, %.2f MB mapped, open and upload ms: %.3f\n", (unsigned int)lContainerTextures.size(),
+				lContainer.mfGetSize() / (1024.0 * 1024.0), lElapsed.count());
+		}
+		// The GL holds its own copy of every level by now, the mapping can go
+	}
 
-	glUseProgram(lLightingProgramID);
+	if (lOptions.aClustered)
+	{
+		lClusters.mpInit(lOptions.aThreadCount > 0 ? lOptions.aThreadCount : mfGetDefaultThreadCount());
+	}
+	else
+	{
+		lLightBuffer.mpInit(MAX_SPOTLIGHTS, false);
+		lLightBuffer.mpBindAll(LIGHTS_BINDING);
+	}
 
-	// Set material properties
+	// The floor material, followed by the cube materials
+	const unsigned int FLOOR_MATERIAL = 0, FIRST_CUBE_MATERIAL = 1;
+	UniformBuffer<MaterialBlock> lMaterialBuffer;
+	lMaterialBuffer.mpInit(FIRST_CUBE_MATERIAL + gCubeMaterials.size(), true);
 
-	GLint lMatDiffuseLoc = glGetUniformLocation(lLightingProgramID, "material.diffuse");
-	GLint lMatSpecularLoc = glGetUniformLocation(lLightingProgramID, "material.specular");
-	GLint lMatShininessLoc = glGetUniformLocation(lLightingProgramID, "material.shininess");
+	glm::mat4 lViewMatrix;
+	glm::mat4 lProjectionMatrix;
 
-	//Get PROPERTIES for SPOTLIGHT A
-	gSpotlightA.mpSetColor(mfGetRandomFloat(), mfGetRandomFloat(), mfGetRandomFloat());
+	glm::vec3 lAmbientKeyColors[4];
+	lAmbientKeyColors[0] = glm::vec3(0.0f, 0.0f, 0.0f);
+	lAmbientKeyColors[1] = glm::vec3(1.0f, 0.0f, 0.0f);
+	lAmbientKeyColors[2] = glm::vec3(0.0f, 1.0f, 0.0f);
+	lAmbientKeyColors[3] = glm::vec3(0.0f, 0.0f, 1.0f);
 
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightA.position"),  gSpotlightA.aPosition.x,  gSpotlightA.aPosition.y,  gSpotlightA.aPosition.z);
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightA.direction"), gSpotlightA.aDirection.x, gSpotlightA.aDirection.y, gSpotlightA.aDirection.z);
+	FrameProfiler lProfiler;
+	unsigned int lFrameIdx = 0;
 
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightA.cutOff"),      gSpotlightA.aCutoff);
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightA.outerCutOff"), gSpotlightA.aOuterCutoff);
+	// Windowed runs pick up edits to the shaders next to the executable
+	ShaderWatcher lShaderWatcher;
+	std::vector<std::string> lChangedShaders;
+	bool lReportedFailure = false;
+	if (!lOptions.aHeadless && !lShaderWatcher.mfInit("."))
+		std::cout << "Shader hot reload is not available" << std::endl;
 
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightA.ambient"),  gSpotlightA.aAmbient.r,  gSpotlightA.aAmbient.g,  gSpotlightA.aAmbient.b);
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightA.diffuse"),  gSpotlightA.aDiffuse.r,  gSpotlightA.aDiffuse.g,  gSpotlightA.aDiffuse.b);
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightA.specular"), gSpotlightA.aSpecular.r, gSpotlightA.aSpecular.g, gSpotlightA.aSpecular.b);
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightA.constant"), gSpotlightA.aConstant);
+	if (lOptions.aHeadless)
+	{
+		// Benchmarks time complete frames only, wait for the program instead of drawing empty frames
+		FinishShaderPrograms();
+		if (mfAnyLightingProgramFailed(lLightingPrograms))
+		{
+			std::cout << "Failed to build the lighting program" << std::endl;
+			return -1;
+		}
+		lProfiler.mpInit(lOptions.aFrameCount);
+	}
 
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightA.linear"),    gSpotlightA.aLinear);
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightA.quadratic"), gSpotlightA.aQuadratic);
+	if (!lOptions.aHeadless)
+		gSimulation.mpStart();
 
-	//Get PROPERTIES for SPOTLIGHT B
-	gSpotlightB.mpSetColor(mfGetRandomFloat(), mfGetRandomFloat(), mfGetRandomFloat());
+	while (lOptions.aHeadless ? lFrameIdx < lOptions.aFrameCount : !glfwWindowShouldClose(lWindow))
+	{
+		if (lOptions.aHeadless)
+			lProfiler.mpBeginFrame();
+		gGLState.mpResetCounters();
 
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightB.position"),  gSpotlightB.aPosition.x,  gSpotlightB.aPosition.y,  gSpotlightB.aPosition.z);
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightB.direction"), gSpotlightB.aDirection.x, gSpotlightB.aDirection.y, gSpotlightB.aDirection.z);
+		// Clear the colorbuffer
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightB.cutOff"),      gSpotlightB.aCutoff);
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightB.outerCutOff"), gSpotlightB.aOuterCutoff);
+		// Upload the next rows of the streamed textures, no more than the budget per frame
+		if (lOptions.aStreamTextureCount > 0)
+		{
+			lTextures.mpUpdate();
+			lTextureMsTotal += lTextures.aUpdateMs;
+			lTextureMsMax = std::max(lTextureMsMax, lTextures.aUpdateMs);
+			lTextureBytesTotal += lTextures.aUploadedBytes;
+			if (lTexturesDoneFrame < 0 && lTextures.aResidentCount + lTextures.aFailedCount == lTextures.mfGetCount())
+				lTexturesDoneFrame = (int)lFrameIdx;
+		}
 
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightB.ambient"),  gSpotlightB.aAmbient.r,  gSpotlightB.aAmbient.g,  gSpotlightB.aAmbient.b);
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightB.diffuse"),  gSpotlightB.aDiffuse.r,  gSpotlightB.aDiffuse.g,  gSpotlightB.aDiffuse.b);
-	glUniform3f(glGetUniformLocation(lLightingProgramID, "lightB.specular"), gSpotlightB.aSpecular.r, gSpotlightB.aSpecular.g, gSpotlightB.aSpecular.b);
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightB.constant"), gSpotlightB.aConstant);
+		if (!lOptions.aHeadless)
+		{
+			// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
+			glfwPollEvents();
+			mpHandleInput();
+		}
 
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightB.linear"),    gSpotlightB.aLinear);
-	glUniform1f(glGetUniformLocation(lLightingProgramID, "lightB.quadratic"), gSpotlightB.aQuadratic);
+		// Rebuild edited shaders in the background, a rebuilt program is swapped in by PollShaderPrograms
+		if (!lOptions.aHeadless)
+		{
+			lChangedShaders.clear();
+			lShaderWatcher.mpPoll(lChangedShaders);
+			for (size_t i = 0; i < lChangedShaders.size(); i++)
+			{
+				if (ReloadShadersUsing(lChangedShaders[i].c_str()) > 0)
+					std::cout << "Reloading shaders using " << lChangedShaders[i] << std::endl;
+			}
+		}
 
-	GLint lViewPosLoc = glGetUniformLocation(lLightingProgramID, "viewPos");
-	GLint lModelMatrixLoc = glGetUniformLocation(lLightingProgramID, "model");
-	GLint lViewMatrixLoc = glGetUniformLocation(lLightingProgramID, "view");
-	GLint lProjectionMatrixLoc = glGetUniformLocation(lLightingProgramID, "projection");
+		PollShaderPrograms();
+		bool lAllReady = true;
+		for (size_t i = 0; i < lLightingPrograms.size(); i++)
+			lAllReady = lLightingPrograms[i].mfRefresh() && lAllReady;
+		if (!lAllReady)
+		{
+			// Keep the window responsive and show the cleared frame until the programs are linked
+			if (mfAnyLightingProgramFailed(lLightingPrograms) && !lReportedFailure)
+			{
+				std::cout << "Failed to build the lighting program, waiting for a shader change" << std::endl;
+				lReportedFailure = true;
+			}
+			glfwSwapBuffers(lWindow);
+			continue;
+		}
+		if (!lProgramsReady)
+		{
+			PrintShaderCacheStats();
+			lProgramsReady = true;
+		}
 
-	glm::mat4 lViewMatrix;
-	glm::mat4 lProjectionMatrix;
-	glm::mat4 lModelMatrix;
+		// Headless runs tick once per frame so every run animates the scene identically, windowed runs interpolate
+		// between the last two ticks of the simulation thread
+		if (lOptions.aHeadless)
+			gSimulation.mpStep();
+		SimulationState lSimulationState = gSimulation.mfGetState();
 
-	GLint lAmbientKeyColorLoc = glGetUniformLocation(lLightingProgramID, "ambientKeyColor");
-	glm::vec3 lAmbientKeyColors[4];
-	lAmbientKeyColors[0] = glm::vec3(0.0f, 0.0f, 0.0f);
-	lAmbientKeyColors[1] = glm::vec3(1.0f, 0.0f, 0.0f);
-	lAmbientKeyColors[2] = glm::vec3(0.0f, 1.0f, 0.0f);
-	lAmbientKeyColors[3] = glm::vec3(0.0f, 0.0f, 1.0f);
+		// Update camera transformations
+		lViewMatrix  = lSimulationState.mfGetViewMatrix();
+		lProjectionMatrix = glm::perspective(lSimulationState.aCameraZoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, NEAR_PLANE, FAR_PLANE);
 
-	GLfloat lCurrentFrame = 0.0f;
-	float lRotationAngle = 0.0f;
+		// Update cube transformations
+		glm::quat lCubeRotation = glm::angleAxis(glm::radians(lSimulationState.aRotationAngle), glm::vec3(0, 1, 0));
+		for (size_t i = 0; i < gCubePlacements.size(); i++)
+			lScene.mpSetRotation(lFirstCubeNode + (uint32_t)i, lCubeRotation);
+		lScene.mpUpdate(lThreadCount);
+		lSceneMsTotal += lScene.aUpdateMs;
+
+		lFrustum.mpSetMatrix(lProjectionMatrix * lViewMatrix);
+		if (lOptions.aBvh)
+		{
+			// Built once the scene has all its nodes, afterwards only the boxes of moved nodes are refit
+			if (lBvh.mfSize() != lScene.mfSize())
+			{
+				lBvh.mpBuild(lScene.mfGetWorldBoxMins(0), lScene.mfGetWorldBoxMaxs(0), lScene.mfSize());
+			}
+			else
+			{
+				lBvh.mpRefit(lScene.mfGetWorldBoxMins(0), lScene.mfGetWorldBoxMaxs(0), lScene.mfGetWorldChanged(0));
+				lRefitMsTotal += lBvh.aRefitMs;
+			}
+
+			std::chrono::high_resolution_clock::time_point lCullStart = std::chrono::high_resolution_clock::now();
+			lBvh.mpQueryFrustum(lFrustum, lVisibleNodes);
+			lVisibleFloor.clear();
+			lVisibleCubes.clear();
+			for (size_t i = 0; i < lVisibleNodes.size(); i++)
+			{
+				if (lVisibleNodes[i] == lFloorNode)
+					lVisibleFloor.push_back(0);
+				else if (lVisibleNodes[i] >= lFirstCubeNode)
+					lVisibleCubes.push_back(lVisibleNodes[i] - lFirstCubeNode);
+			}
+			std::chrono::duration<double, std::milli> lCullElapsed = std::chrono::high_resolution_clock::now() - lCullStart;
+			lCullMsTotal += lCullElapsed.count();
+		}
+		else
+		{
+			lFrustum.mpCullSpheres(lScene.mfGetWorldSpheres(lFloorNode), 1, lVisibleFloor);
+			lCullMsTotal += lFrustum.aCullMs;
+			lFrustum.mpCullSpheres(lScene.mfGetWorldSpheres(lFirstCubeNode), gCubePlacements.size(), lVisibleCubes, lThreadCount);
+			lCullMsTotal += lFrustum.aCullMs;
+		}
+		lCulledTotal += (unsigned int)(gCubePlacements.size() + 1 - lVisibleFloor.size() - lVisibleCubes.size());
 
-	while (!glfwWindowShouldClose(lWindow))
-	{
-		// Clear the colorbuffer
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// The occlusion culler works on the cubes that passed while this thread uploads the lights
+		if (lOptions.aOcclusion)
+		{
+			lOcclusion.mpBeginCull(lProjectionMatrix * lViewMatrix, lScene.mfGetWorlds(lFirstCubeNode), lScene.mfGetWorldBoxMins(lFirstCubeNode),
+				lScene.mfGetWorldBoxMaxs(lFirstCubeNode), lVisibleCubes);
+		}
 
-		// Calculate deltatime of current frame
-		lCurrentFrame = glfwGetTime();
-		gDeltaTime = lCurrentFrame - gLastFrame;
-		gLastFrame = lCurrentFrame;
+		// Only lights and materials that changed since the last frame are uploaded
+		if (lOptions.aClustered)
+		{
+			lClusters.mpSetProjection(lProjectionMatrix, NEAR_PLANE, FAR_PLANE, WIDTH, HEIGHT);
+			lClusters.mpBuild(gSpotlights, lViewMatrix);
+			lClusters.mpUpload();
+			lBinMsTotal += lClusters.aBinMs;
+		}
+		else
+		{
+			for (size_t i = 0; i < gSpotlights.size(); i++)
+				lLightBuffer.mpSet(i, gSpotlights[i].mfGetBlock());
+			lLightBuffer.mfUpload();
+		}
 
-		// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
-		glfwPollEvents();
-		mpHandleInput();
+		lMaterialBuffer.mpSet(FLOOR_MATERIAL, gFloorMaterial.mfGetBlock());
+		for (size_t i = 0; i < gCubeMaterials.size(); i++)
+			lMaterialBuffer.mpSet(FIRST_CUBE_MATERIAL + i, gCubeMaterials[i].mfGetBlock());
+		lMaterialBuffer.mfUpload();
 
-		// Use cooresponding shader when setting uniforms/drawing objects
-		glUseProgram(lLightingProgramID);
+		if (lOptions.aOcclusion)
+		{
+			lOcclusion.mpFinishCull(lVisibleCubes);
+			lOccludedTotal += lOcclusion.aOccludedCount;
+			lOcclusionMsTotal += lOcclusion.aRasterMs + lOcclusion.aTestMs;
+			lOcclusionWaitMsTotal += lOcclusion.aWaitMs;
+		}
 
-		//Update ambient color
-		glUniform3f(lAmbientKeyColorLoc, lAmbientKeyColors[gCurrentAmbientIdx].r, lAmbientKeyColors[gCurrentAmbientIdx].g, lAmbientKeyColors[gCurrentAmbientIdx].b);
+		// Switches to the draw's program, the per frame uniforms are set whenever the program changes
+		LightingProgram* lCurrentProgram = nullptr;
+		auto mpUseLightingProgram = [&](size_t pIndex)
+		{
+			if (lCurrentProgram == &lLightingPrograms[pIndex])
+				return;
+			lCurrentProgram = &lLightingPrograms[pIndex];
+			lCurrentProgram->mpUse(lViewMatrix, lProjectionMatrix, lSimulationState.aCameraPosition, lAmbientKeyColors[gCurrentAmbientIdx], (GLint)gSpotlights.size());
+			if (lOptions.aClustered)
+				lClusters.mpBind(lCurrentProgram->aProgramID, 0);
+		};
+
+		// Queue the draws, the queue orders them by program, material and mesh and front to back within those
+		auto mfGetViewDepth = [&](const glm::mat4& pModel)
+		{
+			return -(lViewMatrix * pModel[3]).z;
+		};
+
+		std::chrono::high_resolution_clock::time_point lRecordStart = std::chrono::high_resolution_clock::now();
+		unsigned int lLaneCount = std::max(1u, std::min(lThreadCount, (unsigned int)lVisibleCubes.size() / MIN_DRAWS_PER_THREAD));
+		lRenderQueue.mpClear(lOptions.aInstanced ? 1 : lLaneCount);
+		RenderItem lItem;
+		lItem.aMesh = &lCube;
+		lItem.aInstances = nullptr;
+		lItem.aModel = nullptr;
+		if (lOptions.aInstanced)
+		{
+			lCubeInstances.mpSetTransforms(lScene.mfGetWorlds(lFirstCubeNode), lVisibleCubes.data(), lVisibleCubes.size());
+			lItem.aProgram = lCubeProgram;
+			lItem.aMaterial = 0;
+			lItem.aInstances = &lCubeInstances;
+			lRenderQueue.mpSubmit(RenderQueue::mfMakeKey(RENDER_PASS_OPAQUE, lCubeProgram, 0, lCubeInstances.mfGetVertexArray(), 0.0f, FAR_PLANE), lItem);
+			lItem.aInstances = nullptr;
+		}
+		else
+		{
+			// Each lane records a contiguous run of the visible cubes on its own thread
+			mpParallelFor(lLaneCount, lLaneCount, [&](unsigned int pBegin, unsigned int pEnd)
+			{
+				RenderItem lCubeItem;
+				lCubeItem.aProgram = lCubeProgram;
+				lCubeItem.aMesh = &lCube;
+				lCubeItem.aInstances = nullptr;
+				for (unsigned int l = pBegin; l < pEnd; l++)
+				{
+					size_t lFirst = lVisibleCubes.size() * l / lLaneCount;
+					size_t lLast = lVisibleCubes.size() * (l + 1) / lLaneCount;
+					for (size_t v = lFirst; v < lLast; v++)
+					{
+						uint32_t i = lVisibleCubes[v];
+						lCubeItem.aMaterial = FIRST_CUBE_MATERIAL + i % gCubeMaterials.size();
+						lCubeItem.aModel = &lScene.mfGetWorld(lFirstCubeNode + i);
+						lRenderQueue.mpSubmit(l, RenderQueue::mfMakeKey(RENDER_PASS_OPAQUE, lCubeProgram, lCubeItem.aMaterial, lCube.mfGetVertexArray(),
+							mfGetViewDepth(*lCubeItem.aModel), FAR_PLANE), lCubeItem);
+					}
+				}
+			});
+		}
 
-		// Update camera transformations
-		lViewMatrix  = gCamera.GetViewMatrix();
-		lProjectionMatrix = glm::perspective(gCamera.Zoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+		if (!lVisibleFloor.empty())
+		{
+			lItem.aProgram = lFloorProgram;
+			lItem.aMaterial = FLOOR_MATERIAL;
+			lItem.aModel = &lScene.mfGetWorld(lFloorNode);
+			lRenderQueue.mpSubmit(RenderQueue::mfMakeKey(RENDER_PASS_OPAQUE, lFloorProgram, FLOOR_MATERIAL, lCube.mfGetVertexArray(),
+				mfGetViewDepth(*lItem.aModel), FAR_PLANE), lItem);
+		}
+		std::chrono::duration<double, std::milli> lRecordElapsed = std::chrono::high_resolution_clock::now() - lRecordStart;
+		lRecordMsTotal += lRecordElapsed.count();
 
-		// Update view position uniform
-		glUniform3f(lViewPosLoc, gCamera.Position.x, gCamera.Position.y, gCamera.Position.z);
+		lRenderQueue.mpSort();
+		lSortMsTotal += lRenderQueue.aSortMs;
 
-		// Update matrices uniforms
-		glUniformMatrix4fv(lViewMatrixLoc,		 1, GL_FALSE, glm::value_ptr(lViewMatrix));
-		glUniformMatrix4fv(lProjectionMatrixLoc, 1, GL_FALSE, glm::value_ptr(lProjectionMatrix));
+		// Draw the queue on the context thread, gGLState drops the binds that did not change between neighbouring draws
+		for (size_t i = 0; i < lRenderQueue.mfSize(); i++)
+		{
+			const RenderItem& lDraw = lRenderQueue.mfGet(i);
+			mpUseLightingProgram(lDraw.aProgram);
+			if (lDraw.aInstances != nullptr)
+			{
+				lDraw.aInstances->mpDraw();
+				continue;
+			}
+
+			lCurrentProgram->mpSetModel(*lDraw.aModel);
+			lMaterialBuffer.mpBindSlot(MATERIAL_BINDING, lDraw.aMaterial);
+			lDraw.aMesh->mpDraw();
+		}
 
-		// Update cube transformations
-		lRotationAngle += 50.0f * gDeltaTime;
-		lModelMatrix = glm::rotate(glm::mat4(), glm::radians(lRotationAngle), glm::vec3(0, 1, 0));
-		glUniformMatrix4fv(lModelMatrixLoc, 1, GL_FALSE, glm::value_ptr(lModelMatrix));
+		for (int i = 0; i < GL_STATE_CALL_COUNT; i++)
+		{
+			lStateIssued[i] += gGLState.aIssued[i];
+			lStateElided[i] += gGLState.aElided[i];
+		}
 
-		glUniform3f(lMatDiffuseLoc, gCubeMaterial.aDiffuse.r, gCubeMaterial.aDiffuse.g, gCubeMaterial.aDiffuse.b);
-		glUniform3f(lMatSpecularLoc, gCubeMaterial.aSpecular.r, gCubeMaterial.aSpecular.g, gCubeMaterial.aSpecular.b);
-		glUniform1f(lMatShininessLoc, gCubeMaterial.aShininess);
+		if (lOptions.aHeadless)
+		{
+			lProfiler.mpEndFrame();
+		}
+		else
+		{
+			// Swap the screen buffers
+			glfwSwapBuffers(lWindow);
+		}
 
-		//Draw cube
-		glBindVertexArray(lVAO);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
+		lFrameIdx++;
+	}
 
-		glUniform3f(lMatDiffuseLoc, gFloorMaterial.aDiffuse.r, gFloorMaterial.aDiffuse.g, gFloorMaterial.aDiffuse.b);
-		glUniform3f(lMatSpecularLoc, gFloorMaterial.aSpecular.r, gFloorMaterial.aSpecular.g, gFloorMaterial.aSpecular.b);
-		glUniform1f(lMatShininessLoc, gFloorMaterial.aShininess);
+	if (lOptions.aHeadless)
+	{
+		lProfiler.mpFinish();
+		lProfiler.mpPrintSummary();
 
-		// Update floor transformations
-		lModelMatrix = glm::mat4();
-		lModelMatrix = glm::translate(lModelMatrix, glm::vec3(0.0f, -0.5f, 0.0f));
-		lModelMatrix = glm::scale(lModelMatrix, glm::vec3(5.0f, 0.01f, 5.0f));
-		glUniformMatrix4fv(lModelMatrixLoc, 1, GL_FALSE, glm::value_ptr(lModelMatrix));
+		if (lOptions.aClustered && lFrameIdx > 0)
+		{
+			printf("Lights: %u, light binning ms: avg %.3f, cluster entries: %u, dropped: %u\n",
+				(unsigned int)gSpotlights.size(), lBinMsTotal / lFrameIdx, lClusters.aIndexCount, lClusters.aOverflowCount);
+		}
 
-		// Draw floor
-		glBindVertexArray(lFloorVAO);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
+		if (lFrameIdx > 0)
+		{
+			printf("Scene: %u nodes, %u updated per frame, update ms: avg %.3f\n", (unsigned int)lScene.mfSize(), lScene.aUpdatedCount, lSceneMsTotal / lFrameIdx);
+			printf("Render queue: %u draws, record ms: avg %.3f, sort ms: avg %.3f\n", (unsigned int)lRenderQueue.mfSize(), lRecordMsTotal / lFrameIdx,
+				lSortMsTotal / lFrameIdx);
+			unsigned int lObjectCount = (unsigned int)gCubePlacements.size() + 1;
+			printf("Culling: %u objects, %.1f culled per frame, cull ms: avg %.3f, %.0f objects/ms\n", lObjectCount, (double)lCulledTotal / lFrameIdx,
+				lCullMsTotal / lFrameIdx, lCullMsTotal > 0.0 ? lObjectCount * lFrameIdx / lCullMsTotal : 0.0);
+			if (lOptions.aBvh)
+			{
+				printf("BVH: %u nodes, build ms: %.3f, refit ms: avg %.3f (%u nodes)\n", (unsigned int)lBvh.mfNodeCount(), lBvh.aBuildMs,
+					lFrameIdx > 1 ? lRefitMsTotal / (lFrameIdx - 1) : 0.0, lBvh.aRefitCount);
+				mpBenchmarkBvhQueries(lBvh, lProjectionMatrix * lViewMatrix);
+			}
+			if (lOptions.aOcclusion)
+			{
+				printf("Occlusion: %u occluders, %.1f of %u tested culled per frame, worker ms: avg %.3f, wait ms: avg %.3f\n", lOcclusion.aOccluderCount,
+					(double)lOccludedTotal / lFrameIdx, lOcclusion.aTestedCount, lOcclusionMsTotal / lFrameIdx, lOcclusionWaitMsTotal / lFrameIdx);
+			}
+			if (lOptions.aStreamTextureCount > 0)
+			{
+				printf("Textures: %u of %u resident, %u failed, all in by frame %d, decode ms: %.1f, upload ms: avg %.3f max %.3f, MB per frame: %.2f\n",
+					lTextures.aResidentCount, (unsigned int)lTextures.mfGetCount(), lTextures.aFailedCount, lTexturesDoneFrame, lTextures.mfGetDecodeMs(),
+					lTextureMsTotal / lFrameIdx, lTextureMsMax, lTextureBytesTotal / lFrameIdx / (1024.0 * 1024.0));
+			}
+			if (!lContainerTextures.empty())
+				mpBenchmarkTextureStartup(lOptions.aTextureContainerPath);
+
+			const char* lStateNames[GL_STATE_CALL_COUNT] = { "program", "vertex array", "buffer", "texture", "uniform" };
+			unsigned int lIssued = 0, lElided = 0;
+			for (int i = 0; i < GL_STATE_CALL_COUNT; i++)
+			{
+				lIssued += lStateIssued[i];
+				lElided += lStateElided[i];
+			}
+			printf("GL state calls per frame: issued %.1f, elided %.1f\n", (double)lIssued / lFrameIdx, (double)lElided / lFrameIdx);
+			for (int i = 0; i < GL_STATE_CALL_COUNT; i++)
+				printf("  %-12s issued %.1f, elided %.1f\n", lStateNames[i], (double)lStateIssued[i] / lFrameIdx, (double)lStateElided[i] / lFrameIdx);
+		}
 
-		// Swap the screen buffers
-		glfwSwapBuffers(lWindow);
+		if (!lOptions.aCsvPath.empty() && !lProfiler.mfWriteCsv(lOptions.aCsvPath.c_str()))
+			std::cout << "Failed to write " << lOptions.aCsvPath << std::endl;
+		if (!lOptions.aJsonPath.empty() && !lProfiler.mfWriteJson(lOptions.aJsonPath.c_str()))
+			std::cout << "Failed to write " << lOptions.aJsonPath << std::endl;
+		if (!lOptions.aScreenshotPath.empty() && !lOffscreen.mfWritePpm(lOptions.aScreenshotPath.c_str()))
+			std::cout << "Failed to write " << lOptions.aScreenshotPath << std::endl;
+
+		lCubeInstances.mpDestroy();
+		lCube.mpDestroy();
+		lLightBuffer.mpDestroy();
+		lClusters.mpDestroy();
+		lMaterialBuffer.mpDestroy();
+		lTextures.mpDestroy();
+		mpDeleteTextures(lContainerTextures);
+		// Only once the streamer loaders are joined, since the benchmark restarts gJobs
+		if (lOptions.aBenchJobs)
+			mpBenchmarkJobScaling(lThreadCount, lProjectionMatrix * lViewMatrix);
+		lProfiler.mpDestroy();
+		lOffscreen.mpDestroy();
+		return 0;
 	}
 
+	gSimulation.mpStop();
+	lTextures.mpDestroy();
+	mpDeleteTextures(lContainerTextures);
+
 	// Clear any resources allocated by GLFW.
 	glfwTerminate();
 	return 0;
@@ -349,16 +819,13 @@ void mpKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mo
 	}
 }
 
+// Hands the movement keys to the simulation, which moves the camera at its next tick
 void mpHandleInput()
 {
-	if (gKeysPressed[GLFW_KEY_W])
-		gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-	if (gKeysPressed[GLFW_KEY_S])
-		gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-	if (gKeysPressed[GLFW_KEY_A])
-		gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-	if (gKeysPressed[GLFW_KEY_D])
-		gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
+	gSimulation.mpSetMoving(FORWARD, gKeysPressed[GLFW_KEY_W]);
+	gSimulation.mpSetMoving(BACKWARD, gKeysPressed[GLFW_KEY_S]);
+	gSimulation.mpSetMoving(LEFT, gKeysPressed[GLFW_KEY_A]);
+	gSimulation.mpSetMoving(RIGHT, gKeysPressed[GLFW_KEY_D]);
 }
 
 bool gFirstMouseMovement = true;
@@ -382,15 +849,285 @@ void mpMouseCallback(GLFWwindow* window, double xpos, double ypos)
 	gLastMouseX = xpos;
 	gLastMouseY = ypos;
 
-	gCamera.ProcessMouseMovement(gMouseDeltaX, gMouseDeltaY);
+	gSimulation.mpAddMouseMovement(gMouseDeltaX, gMouseDeltaY);
 }
 
 void mpScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	gCamera.ProcessMouseScroll(yoffset);
+	gSimulation.mpAddScroll((GLfloat)yoffset);
+}
+
+// Scatters spotlights above the floor, each aimed at a random point on it
+void mpAddRandomSpotlights(unsigned int pCount)
+{
+	for (unsigned int i = 0; i < pCount; i++)
+	{
+		glm::vec3 lPosition(mfGetRandomFloat() * 5.0f - 2.5f, 1.0f + mfGetRandomFloat(), mfGetRandomFloat() * 5.0f - 2.5f);
+		glm::vec3 lTarget(mfGetRandomFloat() * 5.0f - 2.5f, -0.5f, mfGetRandomFloat() * 5.0f - 2.5f);
+		float lCutoffDegrees = 8.0f + mfGetRandomFloat() * 15.0f;
+
+		Spotlight lSpotlight(lPosition, lTarget,
+							 glm::cos(glm::radians(lCutoffDegrees)),
+							 glm::cos(glm::radians(lCutoffDegrees + 2.0f)),
+							 1.0f, 0.7f, 1.8f);
+		lSpotlight.mpSetColor(mfGetRandomFloat(), mfGetRandomFloat(), mfGetRandomFloat());
+		gSpotlights.push_back(lSpotlight);
+	}
 }
 
 float mfGetRandomFloat()
 {
 	return (float)rand() / (float)RAND_MAX;
-}
\ No newline at end of file
+}
+
+// Shader permutation for drawing pMaterials under the current spotlights: the specular term only when one of the
+// materials has a highlight, soft cone edges only when some light has them, and a fixed loop bound for forward shading.
+std::string mfGetLightingDefines(const std::vector<Material>& pMaterials, bool pFixedLightCount)
+{
+	std::string lDefines;
+	for (size_t i = 0; i < pMaterials.size(); i++)
+	{
+		if (pMaterials[i].mfHasSpecular())
+		{
+			lDefines += " SPECULAR";
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < gSpotlights.size(); i++)
+	{
+		if (gSpotlights[i].mfHasSoftEdges())
+		{
+			lDefines += " SOFT_EDGES";
+			break;
+		}
+	}
+
+	if (pFixedLightCount)
+		lDefines += " LIGHT_COUNT=" + std::to_string(gSpotlights.size());
+	return lDefines;
+}
+
+// Index of the lighting program for the variant, draws asking for the same variant get the same entry
+size_t mfGetLightingProgram(std::vector<LightingProgram>& pPrograms, const char* pFragmentShader, const std::string& pDefines)
+{
+	ShaderProgramHandle lHandle = LoadShaderVariantAsync("lighting.vs", pFragmentShader, pDefines.c_str());
+	for (size_t i = 0; i < pPrograms.size(); i++)
+	{
+		if (pPrograms[i].aHandle == lHandle)
+			return i;
+	}
+	pPrograms.push_back(LightingProgram(lHandle));
+	return pPrograms.size() - 1;
+}
+
+bool mfAnyLightingProgramFailed(const std::vector<LightingProgram>& pPrograms)
+{
+	for (size_t i = 0; i < pPrograms.size(); i++)
+	{
+		if (GetShaderProgramStatus(pPrograms[i].aHandle) == SHADER_PROGRAM_FAILED)
+			return true;
+	}
+	return false;
+}
+
+// One cube stays at the origin, more are spread over the floor in a square grid
+void mpLayoutCubes(unsigned int pCount)
+{
+	gCubePlacements.clear();
+	if (pCount == 1)
+	{
+		gCubePlacements.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		return;
+	}
+
+	unsigned int lSide = (unsigned int)glm::ceil(glm::sqrt((float)pCount));
+	float lCell = 5.0f / lSide;
+	float lScale = lCell * 0.6f;
+	for (unsigned int i = 0; i < pCount; i++)
+	{
+		float lX = -2.5f + lCell * (i % lSide + 0.5f);
+		float lZ = -2.5f + lCell * (i / lSide + 0.5f);
+		gCubePlacements.push_back(glm::vec4(lX, -0.5f + lScale * 0.5f, lZ, lScale));
+	}
+}
+
+// Unit cube whose faces are split into pDetail x pDetail quads, as unindexed triangles in counter clockwise order
+std::vector<MeshVertex> mfGetSubdividedCube(unsigned int pDetail)
+{
+	const glm::vec3 lNormals[6] = { glm::vec3(0, 0, -1), glm::vec3(0, 0, 1), glm::vec3(-1, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0), glm::vec3(0, 1, 0) };
+
+	std::vector<MeshVertex> lVertices;
+	lVertices.reserve(6 * pDetail * pDetail * 6);
+	for (const glm::vec3& lNormal : lNormals)
+	{
+		// Face axes with cross(lU, lV) == lNormal
+		glm::vec3 lU = lNormal.y != 0.0f ? glm::vec3(lNormal.y, 0, 0) : glm::vec3(-lNormal.z, 0, lNormal.x);
+		glm::vec3 lV = glm::cross(lNormal, lU);
+
+		auto mfCorner = [&](unsigned int pI, unsigned int pJ)
+		{
+			glm::vec2 lUV(pI / (float)pDetail, pJ / (float)pDetail);
+			MeshVertex lVertex;
+			lVertex.aPosition = 0.5f * lNormal + (lUV.x - 0.5f) * lU + (lUV.y - 0.5f) * lV;
+			lVertex.aNormal = lNormal;
+			lVertex.aTexCoords = lUV;
+			return lVertex;
+		};
+
+		for (unsigned int j = 0; j < pDetail; j++)
+		{
+			for (unsigned int i = 0; i < pDetail; i++)
+			{
+				lVertices.push_back(mfCorner(i, j));
+				lVertices.push_back(mfCorner(i + 1, j));
+				lVertices.push_back(mfCorner(i + 1, j + 1));
+				lVertices.push_back(mfCorner(i + 1, j + 1));
+				lVertices.push_back(mfCorner(i, j + 1));
+				lVertices.push_back(mfCorner(i, j));
+			}
+		}
+	}
+	return lVertices;
+}
+
+// Times the other users of the hierarchy: the cone of every spotlight, and picking rays from the camera through a grid
+// of screen points
+void mpBenchmarkBvhQueries(const Bvh& pBvh, const glm::mat4& pViewProjection)
+{
+	const int GRID = 32;
+	std::vector<uint32_t> lResult;
+
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+	size_t lLitTotal = 0;
+	for (size_t i = 0; i < gSpotlights.size(); i++)
+	{
+		const Spotlight& lLight = gSpotlights[i];
+		float lCos = lLight.aOuterCutoff;
+		float lSin = std::sqrt(std::max(1.0f - lCos * lCos, 0.0f));
+		pBvh.mpQueryCone(lLight.aPosition, glm::normalize(lLight.aDirection), lCos, lSin, lLight.mfGetRange(LIGHT_CUTOFF_ATTENUATION), lResult);
+		lLitTotal += lResult.size();
+	}
+	std::chrono::duration<double, std::milli> lConeMs = std::chrono::high_resolution_clock::now() - lStart;
+
+	// Rays start on the near plane, unprojected with the inverse view projection
+	glm::mat4 lInverse = glm::inverse(pViewProjection);
+	unsigned int lHitCount = 0;
+	lStart = std::chrono::high_resolution_clock::now();
+	for (int y = 0; y < GRID; y++)
+	{
+		for (int x = 0; x < GRID; x++)
+		{
+			glm::vec2 lNdc((x + 0.5f) / GRID * 2.0f - 1.0f, (y + 0.5f) / GRID * 2.0f - 1.0f);
+			glm::vec4 lNear = lInverse * glm::vec4(lNdc, -1.0f, 1.0f);
+			glm::vec4 lFar = lInverse * glm::vec4(lNdc, 1.0f, 1.0f);
+			glm::vec3 lOrigin = glm::vec3(lNear) / lNear.w;
+			float lDistance;
+			if (pBvh.mfRaycast(lOrigin, glm::normalize(glm::vec3(lFar) / lFar.w - lOrigin), lDistance) != BVH_NONE)
+				lHitCount++;
+		}
+	}
+	std::chrono::duration<double, std::milli> lRayMs = std::chrono::high_resolution_clock::now() - lStart;
+
+	printf("BVH queries: %u spotlight cones in %.3f ms (%.1f objects each), %d picking rays in %.3f ms (%u hit)\n", (unsigned int)gSpotlights.size(),
+		lConeMs.count(), gSpotlights.empty() ? 0.0 : (double)lLitTotal / gSpotlights.size(), GRID * GRID, lRayMs.count(), lHitCount);
+}
+
+// Transform update and frustum culling of a synthetic scene of 1024 spinning roots with 127 children each, run with
+// 1 to pMaxThreads threads on gJobs. gJobs is left with pMaxThreads - 1 workers.
+void mpBenchmarkJobScaling(unsigned int pMaxThreads, const glm::mat4& pViewProjection)
+{
+	const unsigned int ROOTS = 1024, CHILDREN = 127, FRAMES = 8;
+
+	Scene lScene;
+	for (unsigned int r = 0; r < ROOTS; r++)
+	{
+		uint32_t lRoot = lScene.mfAddNode(SCENE_NO_PARENT);
+		lScene.mpSetTranslation(lRoot, glm::vec3((float)(r % 32) * 4.0f - 64.0f, -2.0f, -(float)(r / 32) * 4.0f));
+		lScene.mpSetBoundingBox(lRoot, CUBE_BOUNDS_MIN, CUBE_BOUNDS_MAX);
+		for (unsigned int c = 0; c < CHILDREN; c++)
+		{
+			uint32_t lChild = lScene.mfAddNode(lRoot);
+			float lAngle = c * 0.7f;
+			lScene.mpSetTranslation(lChild, glm::vec3(std::cos(lAngle), (float)c / CHILDREN, std::sin(lAngle)) * 1.5f);
+			lScene.mpSetScale(lChild, glm::vec3(0.1f));
+			lScene.mpSetBoundingBox(lChild, CUBE_BOUNDS_MIN, CUBE_BOUNDS_MAX);
+		}
+	}
+
+	Frustum lFrustum;
+	lFrustum.mpSetMatrix(pViewProjection);
+	std::vector<uint32_t> lVisible;
+	double lSingleMs = 0.0;
+	printf("Job scaling: %u nodes, transform update and culling per frame\n", (unsigned int)lScene.mfSize());
+	for (unsigned int t = 1; t <= pMaxThreads; t++)
+	{
+		gJobs.mpStart(t - 1);
+		std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+		for (unsigned int f = 0; f < FRAMES; f++)
+		{
+			glm::quat lRotation = glm::angleAxis(glm::radians(10.0f * (f + t * FRAMES)), glm::vec3(0, 1, 0));
+			for (unsigned int r = 0; r < ROOTS; r++)
+				lScene.mpSetRotation(r * (CHILDREN + 1), lRotation);
+			lScene.mpUpdate(t);
+			lFrustum.mpCullSpheres(lScene.mfGetWorldSpheres(0), lScene.mfSize(), lVisible, t);
+		}
+		std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+		double lFrameMs = lElapsed.count() / FRAMES;
+		if (t == 1)
+			lSingleMs = lFrameMs;
+		printf("  %2u threads: %.3f ms (%.2fx), %u jobs stolen\n", t, lFrameMs, lSingleMs / lFrameMs, gJobs.aStolenCount.load());
+	}
+}
+
+void mpDeleteTextures(std::vector<GLuint>& pTextures)
+{
+	for (size_t i = 0; i < pTextures.size(); i++)
+		gGLState.mpForgetTexture(pTextures[i]);
+	if (!pTextures.empty())
+		glDeleteTextures((GLsizei)pTextures.size(), pTextures.data());
+	pTextures.clear();
+}
+
+// Time until the scene's textures are usable: decoding and mipmapping the images as the streamer does with no upload
+// budget, against creating them from the container with the file dropped from the OS cache first, then again warm
+void mpBenchmarkTextureStartup(const std::string& pContainerPath)
+{
+	size_t lPathCount = sizeof(STREAMED_TEXTURE_PATHS) / sizeof(STREAMED_TEXTURE_PATHS[0]);
+	std::chrono::high_resolution_clock::time_point lStart = std::chrono::high_resolution_clock::now();
+	TextureStreamer lStreamer;
+	lStreamer.mpInit(TEXTURE_LOADER_COUNT, (size_t)-1);
+	for (size_t i = 0; i < lPathCount; i++)
+		lStreamer.mfRequest(STREAMED_TEXTURE_PATHS[i]);
+	while (lStreamer.aResidentCount + lStreamer.aFailedCount < lPathCount)
+	{
+		lStreamer.mpUpdate();
+		std::this_thread::yield();
+	}
+	glFinish();
+	std::chrono::duration<double, std::milli> lDecodeMs = std::chrono::high_resolution_clock::now() - lStart;
+	lStreamer.mpDestroy();
+
+	double lContainerMs[2] = { 0.0, 0.0 };
+	unsigned int lContainerCount = 0;
+	for (int lWarm = 0; lWarm < 2; lWarm++)
+	{
+		if (!lWarm)
+			TextureContainer::mpDropFromFileCache(pContainerPath);
+		lStart = std::chrono::high_resolution_clock::now();
+		std::vector<GLuint> lTextures;
+		TextureContainer lContainer;
+		if (lContainer.mfOpen(pContainerPath))
+		{
+			for (size_t i = 0; i < lContainer.mfGetTextureCount(); i++)
+				lTextures.push_back(lContainer.mfCreateTexture(i));
+		}
+		glFinish();
+		std::chrono::duration<double, std::milli> lElapsed = std::chrono::high_resolution_clock::now() - lStart;
+		lContainerMs[lWarm] = lElapsed.count();
+		lContainerCount = (unsigned int)lTextures.size();
+		mpDeleteTextures(lTextures);
+	}
+	printf("Texture startup: %u images decoded in %.3f ms, %u from the container in %.3f ms cold, %.3f ms warm\n",
+		(unsigned int)lPathCount, lDecodeMs.count(), lContainerCount, lContainerMs[0], lContainerMs[1]);
+}
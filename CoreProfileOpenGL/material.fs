@@ -1,18 +1,5 @@
 #version 330 core
-struct Material {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;    
-    float shininess;
-}; 
-
-struct Light {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+#include "lighting_structs.glsl"
 
 in vec3 FragPos;  
 in vec3 Normal;  
@@ -26,7 +13,7 @@ uniform Light light;
 void main()
 {
     // Ambient
-    vec3 ambient = light.ambient * material.ambient;
+    vec3 ambient = light.ambient * material.diffuse;
   	
     // Diffuse 
     vec3 norm = normalize(Normal);
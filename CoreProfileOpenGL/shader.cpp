@@ -4,91 +4,365 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <map>
 using namespace std;
 
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 #include <GL/glew.h>
 
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+static std::string ShaderCacheDirectory = "shader_cache";
+static ShaderCacheStats CacheStats = { 0, 0, 0, 0.0, 0.0, 0.0 };
+
+// Header in front of every cached program binary
+struct ProgramBinaryHeader {
+	char Magic[8];
+	unsigned long long Key;
+	GLenum Format;
+	GLint Length;
+	float CompileMs;
+};
+
+static const char ProgramBinaryMagic[8] = { 'C', 'P', 'G', 'L', 'B', 'I', 'N', '1' };
+
+static double ElapsedMs(std::chrono::high_resolution_clock::time_point start){
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	return elapsed.count();
+}
+
+// 64 bit FNV-1a, the terminating zero is hashed too so "ab"+"c" and "a"+"bc" differ
+static unsigned long long HashString(unsigned long long hash, const char * text){
+	do {
+		hash ^= (unsigned char)*text;
+		hash *= 1099511628211ULL;
+	} while (*text++);
+	return hash;
+}
+
+static unsigned long long ProgramCacheKey(const std::string& vertexCode, const std::string& fragmentCode){
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = HashString(hash, vertexCode.c_str());
+	hash = HashString(hash, fragmentCode.c_str());
+	hash = HashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = HashString(hash, (const char*)glGetString(GL_RENDERER));
+	hash = HashString(hash, (const char*)glGetString(GL_VERSION));
+	return hash;
+}
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
+static bool ProgramCacheAvailable(){
+	if (ShaderCacheDirectory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+		return false;
+
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	return formatCount > 0;
+}
+
+static std::string ProgramCachePath(unsigned long long key){
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", key);
+	return ShaderCacheDirectory + "/" + name;
+}
+
+// Returns 0 when there is no usable blob for this key
+static GLuint LoadCachedProgram(unsigned long long key){
+	std::string path = ProgramCachePath(key);
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
 		return 0;
+
+	ProgramBinaryHeader header;
+	std::vector<char> binary;
+	bool valid = file.read((char*)&header, sizeof(header))
+		&& memcmp(header.Magic, ProgramBinaryMagic, sizeof(ProgramBinaryMagic)) == 0
+		&& header.Key == key
+		&& header.Length > 0;
+	if (valid){
+		binary.resize(header.Length);
+		valid = (bool)file.read(&binary[0], header.Length);
 	}
+	file.close();
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+	if (!valid){
+		CacheStats.Rejected++;
+		return 0;
 	}
 
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.Format, &binary[0], header.Length);
+
+	// A driver update or a different GPU invalidates the binary, which shows up as a failed link
 	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE){
+		glDeleteProgram(ProgramID);
+		CacheStats.Rejected++;
+		return 0;
+	}
 
+	double loadMs = ElapsedMs(start);
+	CacheStats.Hits++;
+	CacheStats.LoadMs += loadMs;
+	CacheStats.SavedMs += std::max(header.CompileMs - loadMs, 0.0);
+	return ProgramID;
+}
 
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
+static void StoreCachedProgram(unsigned long long key, GLuint ProgramID, double compileMs){
+	GLint Length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &Length);
+	if (Length <= 0)
+		return;
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+	ProgramBinaryHeader header;
+	memcpy(header.Magic, ProgramBinaryMagic, sizeof(ProgramBinaryMagic));
+	header.Key = key;
+	header.CompileMs = (float)compileMs;
+
+	std::vector<char> binary(Length);
+	glGetProgramBinary(ProgramID, Length, &header.Length, &header.Format, &binary[0]);
+	if (header.Length <= 0)
+		return;
+
+#ifdef _WIN32
+	_mkdir(ShaderCacheDirectory.c_str());
+#else
+	mkdir(ShaderCacheDirectory.c_str(), 0755);
+#endif
+
+	std::string path = ProgramCachePath(key);
+	std::ofstream file(path, std::ios::out | std::ios::binary);
+	if (!file.is_open()){
+		printf("Impossible to write shader cache file %s\n", path.c_str());
+		return;
 	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(&binary[0], header.Length);
+	file.close();
+}
 
+void SetShaderCacheDirectory(const char * directory){
+	ShaderCacheDirectory = directory != NULL ? directory : "";
+}
 
+ShaderCacheStats GetShaderCacheStats(){
+	return CacheStats;
+}
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
+void PrintShaderCacheStats(){
+	printf("Shader cache: %u hits, %u misses, %u rejected, load %.2f ms, compile %.2f ms, saved %.2f ms\n",
+		CacheStats.Hits, CacheStats.Misses, CacheStats.Rejected, CacheStats.LoadMs, CacheStats.CompileMs, CacheStats.SavedMs);
+}
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+// GL_KHR_parallel_shader_compile uses the same value as the ARB extension, GLEW only knows the ARB name
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+enum PendingProgramStage {
+	STAGE_READING,		// Sources are being read on a worker thread
+	STAGE_COMPILING,	// Both shaders were submitted to the driver
+	STAGE_LINKING,		// The program was submitted to the driver
+	STAGE_DONE
+};
+
+struct ShaderSources {
+	bool Valid;
+	std::string VertexCode;
+	std::string FragmentCode;
+	// Every file read for each stage, the index is the source string number in #line directives
+	std::vector<std::string> VertexFiles;
+	std::vector<std::string> FragmentFiles;
+};
+
+struct PendingProgram {
+	std::string VertexPath;
+	std::string FragmentPath;
+	std::string Defines;
+	std::vector<std::string> VertexFiles;
+	std::vector<std::string> FragmentFiles;
+	PendingProgramStage Stage;
+	ShaderProgramStatus Status;
+	std::future<ShaderSources> Sources;
+	bool UseCache;
+	unsigned long long CacheKey;
+	std::chrono::high_resolution_clock::time_point CompileStart;
+	GLuint VertexShaderID;
+	GLuint FragmentShaderID;
+	GLuint BuildProgramID;		// Program being built, replaces ProgramID once it linked
+	GLuint ProgramID;			// Program handed out by GetShaderProgram
+	bool ReloadQueued;			// A source changed again while the program was being rebuilt
+};
+
+static std::vector<PendingProgram> Programs;
+// Handle of every variant requested so far, keyed by a hash of its files and defines
+static std::map<unsigned long long, ShaderProgramHandle> Variants;
+static int ParallelCompile = -1;
+
+static bool ReadShaderFile(const char * file_path, std::string& code){
+	std::ifstream stream(file_path, std::ios::in);
+	if(!stream.is_open()){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", file_path);
+		return false;
 	}
+	std::string Line = "";
+	while(getline(stream, Line))
+		code += "\n" + Line;
+	return true;
+}
 
+// Copies the file into code, replacing every #include "file" (relative to the including file) with the
+// included file. Each file is included once, #line directives keep the compiler messages pointing at the right file.
+static bool PreprocessFile(const std::string& file_path, std::string& code, std::vector<std::string>& files){
+	std::string text;
+	if (!ReadShaderFile(file_path.c_str(), text))
+		return false;
 
+	int FileIndex = (int)files.size();
+	files.push_back(file_path);
+	size_t Slash = file_path.find_last_of("/\\");
+	std::string Directory = Slash == std::string::npos ? "" : file_path.substr(0, Slash + 1);
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+	// ReadShaderFile puts a newline in front of every line
+	int LineNumber = 0;
+	size_t Start = 1;
+	while (Start <= text.size()){
+		size_t End = text.find('\n', Start);
+		if (End == std::string::npos)
+			End = text.size();
+		std::string Line = text.substr(Start, End - Start);
+		Start = End + 1;
+		LineNumber++;
+
+		size_t First = Line.find_first_not_of(" \t");
+		if (First == std::string::npos || Line.compare(First, 8, "#include") != 0){
+			code += Line + "\n";
+			continue;
+		}
+
+		size_t Open = Line.find('"', First);
+		size_t Close = Open == std::string::npos ? Open : Line.find('"', Open + 1);
+		if (Close == std::string::npos){
+			printf("%s:%d: malformed #include\n", file_path.c_str(), LineNumber);
+			return false;
+		}
 
-	// Check the program
+		std::string IncludePath = Directory + Line.substr(Open + 1, Close - Open - 1);
+		if (std::find(files.begin(), files.end(), IncludePath) == files.end()){
+			code += "#line 1 " + std::to_string(files.size()) + "\n";
+			if (!PreprocessFile(IncludePath, code, files))
+				return false;
+			code += "#line " + std::to_string(LineNumber + 1) + " " + std::to_string(FileIndex) + "\n";
+		}else{
+			code += "\n";
+		}
+	}
+	return true;
+}
+
+// Preprocesses a shader stage and puts a #define for every entry of defines right after its #version line
+static bool PreprocessShader(const std::string& file_path, const std::string& defines, std::string& code, std::vector<std::string>& files){
+	std::string body;
+	if (!PreprocessFile(file_path, body, files))
+		return false;
+
+	std::string DefineLines;
+	size_t Start = 0;
+	while (Start < defines.size()){
+		size_t End = defines.find(' ', Start);
+		if (End == std::string::npos)
+			End = defines.size();
+		std::string Define = defines.substr(Start, End - Start);
+		size_t Equals = Define.find('=');
+		if (Equals != std::string::npos)
+			Define[Equals] = ' ';
+		DefineLines += "#define " + Define + "\n";
+		Start = End + 1;
+	}
+
+	size_t VersionEnd = 0;
+	if (body.compare(0, 8, "#version") == 0)
+		VersionEnd = body.find('\n') + 1;
+	code = body.substr(0, VersionEnd) + DefineLines;
+	if (VersionEnd > 0 && !DefineLines.empty())
+		code += "#line 2 0\n";
+	code += body.substr(VersionEnd);
+	return true;
+}
+
+static ShaderSources ReadShaderSources(std::string vertex_file_path, std::string fragment_file_path, std::string defines){
+	ShaderSources sources;
+	sources.Valid = PreprocessShader(vertex_file_path, defines, sources.VertexCode, sources.VertexFiles);
+	sources.Valid = PreprocessShader(fragment_file_path, defines, sources.FragmentCode, sources.FragmentFiles) && sources.Valid;
+	return sources;
+}
+
+static void PrintSourceFiles(const std::vector<std::string>& files){
+	for (size_t i = 1; i < files.size(); i++)
+		printf("  source string %d : %s\n", (int)i, files[i].c_str());
+}
+
+// Without the extension every completion query below would block, so they are skipped and the status is read directly
+static bool HasParallelCompile(){
+	if (ParallelCompile < 0){
+		ParallelCompile = 0;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count && ParallelCompile == 0; i++){
+			const char * name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+				ParallelCompile = 1;
+		}
+		// Let the driver use as many compiler threads as it likes
+		if (ParallelCompile && GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+	return ParallelCompile == 1;
+}
+
+static bool ShaderCompleted(GLuint ShaderID){
+	GLint Completed = GL_TRUE;
+	if (HasParallelCompile())
+		glGetShaderiv(ShaderID, GL_COMPLETION_STATUS_KHR, &Completed);
+	return Completed == GL_TRUE;
+}
+
+static bool ProgramCompleted(GLuint ProgramID){
+	GLint Completed = GL_TRUE;
+	if (HasParallelCompile())
+		glGetProgramiv(ProgramID, GL_COMPLETION_STATUS_KHR, &Completed);
+	return Completed == GL_TRUE;
+}
+
+static bool CheckShader(GLuint ShaderID){
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
+	}
+	return Result == GL_TRUE;
+}
+
+static bool CheckProgram(GLuint ProgramID){
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
 	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
@@ -96,15 +370,374 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
+	return Result == GL_TRUE;
+}
 
-	
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-	
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+// Copies the default block uniforms and the uniform block bindings of a program that is being replaced,
+// so values that are only set when they change survive a reload
+static void CopyProgramState(GLuint oldProgramID, GLuint newProgramID){
+	GLint CurrentProgramID = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &CurrentProgramID);
+	glUseProgram(newProgramID);
 
-	return ProgramID;
+	GLint UniformCount = 0;
+	glGetProgramiv(oldProgramID, GL_ACTIVE_UNIFORMS, &UniformCount);
+	for (GLint i = 0; i < UniformCount; i++){
+		char Name[256];
+		GLint Size;
+		GLenum Type;
+		glGetActiveUniform(oldProgramID, i, sizeof(Name), NULL, &Size, &Type, Name);
+
+		// Array uniforms are reported as "name[0]", every element has its own location
+		char * Bracket = strchr(Name, '[');
+		if (Bracket != NULL)
+			*Bracket = 0;
+
+		for (GLint Element = 0; Element < Size; Element++){
+			std::string ElementName = Name;
+			if (Size > 1 || Bracket != NULL)
+				ElementName += "[" + std::to_string(Element) + "]";
+
+			GLint OldLocation = glGetUniformLocation(oldProgramID, ElementName.c_str());
+			GLint NewLocation = glGetUniformLocation(newProgramID, ElementName.c_str());
+			if (OldLocation < 0 || NewLocation < 0)
+				continue;
+
+			GLfloat Floats[16];
+			GLint Ints[4];
+			switch (Type){
+			case GL_FLOAT:		glGetUniformfv(oldProgramID, OldLocation, Floats); glUniform1fv(NewLocation, 1, Floats); break;
+			case GL_FLOAT_VEC2:	glGetUniformfv(oldProgramID, OldLocation, Floats); glUniform2fv(NewLocation, 1, Floats); break;
+			case GL_FLOAT_VEC3:	glGetUniformfv(oldProgramID, OldLocation, Floats); glUniform3fv(NewLocation, 1, Floats); break;
+			case GL_FLOAT_VEC4:	glGetUniformfv(oldProgramID, OldLocation, Floats); glUniform4fv(NewLocation, 1, Floats); break;
+			case GL_FLOAT_MAT3:	glGetUniformfv(oldProgramID, OldLocation, Floats); glUniformMatrix3fv(NewLocation, 1, GL_FALSE, Floats); break;
+			case GL_FLOAT_MAT4:	glGetUniformfv(oldProgramID, OldLocation, Floats); glUniformMatrix4fv(NewLocation, 1, GL_FALSE, Floats); break;
+			case GL_INT_VEC2:	glGetUniformiv(oldProgramID, OldLocation, Ints); glUniform2iv(NewLocation, 1, Ints); break;
+			case GL_INT_VEC3:	glGetUniformiv(oldProgramID, OldLocation, Ints); glUniform3iv(NewLocation, 1, Ints); break;
+			case GL_INT_VEC4:	glGetUniformiv(oldProgramID, OldLocation, Ints); glUniform4iv(NewLocation, 1, Ints); break;
+			case GL_BOOL_VEC2:	glGetUniformiv(oldProgramID, OldLocation, Ints); glUniform2iv(NewLocation, 1, Ints); break;
+			case GL_BOOL_VEC3:	glGetUniformiv(oldProgramID, OldLocation, Ints); glUniform3iv(NewLocation, 1, Ints); break;
+			case GL_BOOL_VEC4:	glGetUniformiv(oldProgramID, OldLocation, Ints); glUniform4iv(NewLocation, 1, Ints); break;
+			// int, bool and every sampler type are a single int
+			case GL_INT:
+			case GL_BOOL:
+			case GL_SAMPLER_1D:
+			case GL_SAMPLER_2D:
+			case GL_SAMPLER_3D:
+			case GL_SAMPLER_CUBE:
+			case GL_SAMPLER_1D_SHADOW:
+			case GL_SAMPLER_2D_SHADOW:
+			case GL_SAMPLER_1D_ARRAY:
+			case GL_SAMPLER_2D_ARRAY:
+			case GL_SAMPLER_1D_ARRAY_SHADOW:
+			case GL_SAMPLER_2D_ARRAY_SHADOW:
+			case GL_SAMPLER_2D_MULTISAMPLE:
+			case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+			case GL_SAMPLER_CUBE_SHADOW:
+			case GL_SAMPLER_BUFFER:
+			case GL_SAMPLER_2D_RECT:
+			case GL_SAMPLER_2D_RECT_SHADOW:
+			case GL_INT_SAMPLER_1D:
+			case GL_INT_SAMPLER_2D:
+			case GL_INT_SAMPLER_3D:
+			case GL_INT_SAMPLER_CUBE:
+			case GL_INT_SAMPLER_1D_ARRAY:
+			case GL_INT_SAMPLER_2D_ARRAY:
+			case GL_INT_SAMPLER_2D_MULTISAMPLE:
+			case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+			case GL_INT_SAMPLER_BUFFER:
+			case GL_INT_SAMPLER_2D_RECT:
+			case GL_UNSIGNED_INT_SAMPLER_1D:
+			case GL_UNSIGNED_INT_SAMPLER_2D:
+			case GL_UNSIGNED_INT_SAMPLER_3D:
+			case GL_UNSIGNED_INT_SAMPLER_CUBE:
+			case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+			case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+			case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+			case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+			case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+			case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+				glGetUniformiv(oldProgramID, OldLocation, Ints);
+				glUniform1iv(NewLocation, 1, Ints);
+				break;
+			default:
+				// Unsigned, double and non-square matrix uniforms are not used by our shaders and keep their defaults
+				break;
+			}
+		}
+	}
+
+	GLint BlockCount = 0;
+	glGetProgramiv(oldProgramID, GL_ACTIVE_UNIFORM_BLOCKS, &BlockCount);
+	for (GLint i = 0; i < BlockCount; i++){
+		char Name[256];
+		GLint Binding = 0;
+		glGetActiveUniformBlockName(oldProgramID, i, sizeof(Name), NULL, Name);
+		glGetActiveUniformBlockiv(oldProgramID, i, GL_UNIFORM_BLOCK_BINDING, &Binding);
+		GLuint NewIndex = glGetUniformBlockIndex(newProgramID, Name);
+		if (NewIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(newProgramID, NewIndex, Binding);
+	}
+
+	glUseProgram(CurrentProgramID);
+}
+
+static void StartBuild(PendingProgram& program){
+	program.Stage = STAGE_READING;
+	program.ReloadQueued = false;
+	program.Sources = std::async(std::launch::async, ReadShaderSources, program.VertexPath, program.FragmentPath, program.Defines);
 }
 
+static void FinishProgram(PendingProgram& program, bool built){
+	if (program.VertexShaderID != 0){
+		if (program.BuildProgramID != 0){
+			glDetachShader(program.BuildProgramID, program.VertexShaderID);
+			glDetachShader(program.BuildProgramID, program.FragmentShaderID);
+		}
+		glDeleteShader(program.VertexShaderID);
+		glDeleteShader(program.FragmentShaderID);
+		program.VertexShaderID = program.FragmentShaderID = 0;
+	}
+
+	if (built && program.ProgramID != 0){
+		// Reload: the new program takes over between two frames, the old one is released
+		CopyProgramState(program.ProgramID, program.BuildProgramID);
+		glDeleteProgram(program.ProgramID);
+		printf("Reloaded program : %s %s\n", program.VertexPath.c_str(), program.FragmentPath.c_str());
+	}
+
+	if (built)
+		program.ProgramID = program.BuildProgramID;
+	else if (program.BuildProgramID != 0)
+		glDeleteProgram(program.BuildProgramID);
+	program.BuildProgramID = 0;
+
+	// A failed reload keeps the previous program running
+	if (program.ProgramID != 0)
+		program.Status = SHADER_PROGRAM_READY;
+	else if (!built)
+		program.Status = SHADER_PROGRAM_FAILED;
+
+	program.Stage = STAGE_DONE;
+	if (program.ReloadQueued)
+		StartBuild(program);
+}
+
+// Sources arrived: reload the program from the cache or hand both shaders to the compiler without waiting for them
+static void SubmitCompile(PendingProgram& program){
+	ShaderSources sources = program.Sources.get();
+	program.VertexFiles = sources.VertexFiles;
+	program.FragmentFiles = sources.FragmentFiles;
+	if (!sources.Valid){
+		FinishProgram(program, false);
+		return;
+	}
+
+	program.UseCache = ProgramCacheAvailable();
+	if (program.UseCache){
+		program.CacheKey = ProgramCacheKey(sources.VertexCode, sources.FragmentCode);
+		program.BuildProgramID = LoadCachedProgram(program.CacheKey);
+		if (program.BuildProgramID != 0){
+			printf("Loaded cached program : %s %s\n", program.VertexPath.c_str(), program.FragmentPath.c_str());
+			FinishProgram(program, true);
+			return;
+		}
+		CacheStats.Misses++;
+	}
+
+	program.CompileStart = std::chrono::high_resolution_clock::now();
+
+	printf("Compiling shader : %s\n", program.VertexPath.c_str());
+	program.VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	char const * VertexSourcePointer = sources.VertexCode.c_str();
+	glShaderSource(program.VertexShaderID, 1, &VertexSourcePointer , NULL);
+	glCompileShader(program.VertexShaderID);
+
+	if (program.Defines.empty())
+		printf("Compiling shader : %s\n", program.FragmentPath.c_str());
+	else
+		printf("Compiling shader : %s (%s)\n", program.FragmentPath.c_str(), program.Defines.c_str());
+	program.FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	char const * FragmentSourcePointer = sources.FragmentCode.c_str();
+	glShaderSource(program.FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	glCompileShader(program.FragmentShaderID);
+
+	program.Stage = STAGE_COMPILING;
+}
+
+static void SubmitLink(PendingProgram& program){
+	if (!ShaderCompleted(program.VertexShaderID) || !ShaderCompleted(program.FragmentShaderID))
+		return;
+
+	// Check both shaders so both logs are printed
+	bool VertexValid = CheckShader(program.VertexShaderID);
+	if (!VertexValid)
+		PrintSourceFiles(program.VertexFiles);
+	bool FragmentValid = CheckShader(program.FragmentShaderID);
+	if (!FragmentValid)
+		PrintSourceFiles(program.FragmentFiles);
+	if (!VertexValid || !FragmentValid){
+		FinishProgram(program, false);
+		return;
+	}
+
+	printf("Linking program\n");
+	program.BuildProgramID = glCreateProgram();
+	glAttachShader(program.BuildProgramID, program.VertexShaderID);
+	glAttachShader(program.BuildProgramID, program.FragmentShaderID);
+	if (program.UseCache)
+		glProgramParameteri(program.BuildProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program.BuildProgramID);
+
+	program.Stage = STAGE_LINKING;
+}
+
+static void CompleteLink(PendingProgram& program){
+	if (!ProgramCompleted(program.BuildProgramID))
+		return;
+
+	bool Linked = CheckProgram(program.BuildProgramID);
+	double CompileMs = ElapsedMs(program.CompileStart);
+	if (program.UseCache){
+		CacheStats.CompileMs += CompileMs;
+		if (Linked)
+			StoreCachedProgram(program.CacheKey, program.BuildProgramID, CompileMs);
+	}
+	FinishProgram(program, Linked);
+}
+
+// Sorts the space separated defines so the same set always yields the same variant
+static std::string CanonicalDefines(const char * defines){
+	std::vector<std::string> List;
+	std::string Text = defines != NULL ? defines : "";
+	size_t Start = 0;
+	while (Start < Text.size()){
+		size_t End = Text.find(' ', Start);
+		if (End == std::string::npos)
+			End = Text.size();
+		if (End > Start)
+			List.push_back(Text.substr(Start, End - Start));
+		Start = End + 1;
+	}
+	std::sort(List.begin(), List.end());
+	List.erase(std::unique(List.begin(), List.end()), List.end());
+
+	std::string Result;
+	for (size_t i = 0; i < List.size(); i++)
+		Result += (i > 0 ? " " : "") + List[i];
+	return Result;
+}
+
+ShaderProgramHandle LoadShadersAsync(const char * vertex_file_path,const char * fragment_file_path){
+	return LoadShaderVariantAsync(vertex_file_path, fragment_file_path, NULL);
+}
+
+ShaderProgramHandle LoadShaderVariantAsync(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
+	std::string Defines = CanonicalDefines(defines);
+	unsigned long long VariantKey = 14695981039346656037ULL;
+	VariantKey = HashString(VariantKey, vertex_file_path);
+	VariantKey = HashString(VariantKey, fragment_file_path);
+	VariantKey = HashString(VariantKey, Defines.c_str());
+
+	std::map<unsigned long long, ShaderProgramHandle>::iterator Variant = Variants.find(VariantKey);
+	if (Variant != Variants.end())
+		return Variant->second;
+
+	PendingProgram program;
+	program.VertexPath = vertex_file_path;
+	program.FragmentPath = fragment_file_path;
+	program.Defines = Defines;
+	program.Status = SHADER_PROGRAM_PENDING;
+	program.UseCache = false;
+	program.CacheKey = 0;
+	program.VertexShaderID = 0;
+	program.FragmentShaderID = 0;
+	program.BuildProgramID = 0;
+	program.ProgramID = 0;
+	StartBuild(program);
+	Programs.push_back(std::move(program));
+
+	ShaderProgramHandle handle = (ShaderProgramHandle)Programs.size();
+	Variants[VariantKey] = handle;
+	return handle;
+}
+
+bool PollShaderPrograms(){
+	// Every compile this poll can start is submitted before any link, so the driver sees the whole batch at once
+	for (size_t i = 0; i < Programs.size(); i++){
+		if (Programs[i].Stage == STAGE_READING && Programs[i].Sources.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			SubmitCompile(Programs[i]);
+	}
+	for (size_t i = 0; i < Programs.size(); i++){
+		if (Programs[i].Stage == STAGE_COMPILING)
+			SubmitLink(Programs[i]);
+	}
+
+	bool AllDone = true;
+	for (size_t i = 0; i < Programs.size(); i++){
+		if (Programs[i].Stage == STAGE_LINKING)
+			CompleteLink(Programs[i]);
+		AllDone = AllDone && Programs[i].Stage == STAGE_DONE;
+	}
+	return AllDone;
+}
+
+void FinishShaderPrograms(){
+	while (!PollShaderPrograms()){
+		// Nothing left to submit, only the worker threads or the driver are busy
+		std::this_thread::yield();
+	}
+}
+
+ShaderProgramStatus GetShaderProgramStatus(ShaderProgramHandle handle){
+	if (handle == 0 || handle > Programs.size())
+		return SHADER_PROGRAM_FAILED;
+	return Programs[handle - 1].Status;
+}
+
+GLuint GetShaderProgram(ShaderProgramHandle handle){
+	if (GetShaderProgramStatus(handle) != SHADER_PROGRAM_READY)
+		return 0;
+	return Programs[handle - 1].ProgramID;
+}
+
+static bool SameFile(const std::string& path, const char * file_name){
+	size_t Slash = path.find_last_of("/\\");
+	return path.compare(Slash == std::string::npos ? 0 : Slash + 1, std::string::npos, file_name) == 0;
+}
+
+// Includes count as well, they are known once the sources were read
+static bool UsesFile(const PendingProgram& program, const char * file_name){
+	if (SameFile(program.VertexPath, file_name) || SameFile(program.FragmentPath, file_name))
+		return true;
+	for (size_t i = 0; i < program.VertexFiles.size(); i++)
+		if (SameFile(program.VertexFiles[i], file_name))
+			return true;
+	for (size_t i = 0; i < program.FragmentFiles.size(); i++)
+		if (SameFile(program.FragmentFiles[i], file_name))
+			return true;
+	return false;
+}
+
+unsigned int ReloadShadersUsing(const char * file_name){
+	unsigned int Count = 0;
+	for (size_t i = 0; i < Programs.size(); i++){
+		PendingProgram& program = Programs[i];
+		if (!UsesFile(program, file_name))
+			continue;
+
+		if (program.Stage == STAGE_DONE)
+			StartBuild(program);
+		else
+			program.ReloadQueued = true;
+		Count++;
+	}
+	return Count;
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+	ShaderProgramHandle handle = LoadShadersAsync(vertex_file_path, fragment_file_path);
+	FinishShaderPrograms();
+	return GetShaderProgram(handle);
+}
 
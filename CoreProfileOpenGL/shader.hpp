@@ -1,6 +1,56 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+// Blocks until the program is linked (and every other pending program with it). Returns 0 on failure.
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
+// Asynchronous loading. The files are read on a worker thread and PollShaderPrograms submits all pending
+// compiles before any link. With GL_KHR/ARB_parallel_shader_compile the driver compiles on its own threads
+// and polling never blocks, so a frame can be drawn while programs are still being built.
+enum ShaderProgramStatus {
+	SHADER_PROGRAM_PENDING,
+	SHADER_PROGRAM_READY,
+	SHADER_PROGRAM_FAILED
+};
+
+typedef unsigned int ShaderProgramHandle;
+
+ShaderProgramHandle LoadShadersAsync(const char * vertex_file_path,const char * fragment_file_path);
+
+// Both stages are preprocessed before compiling: #include "file" lines are replaced by the file (relative to the
+// including one, each file at most once) and defines, a space separated list like "SPECULAR LIGHT_COUNT=4",
+// becomes #define lines after #version. Requests for a variant that was already requested, with the defines in any
+// order, return the existing handle, so every permutation is compiled once.
+ShaderProgramHandle LoadShaderVariantAsync(const char * vertex_file_path,const char * fragment_file_path, const char * defines);
+
+// Advances every pending program as far as it can go without waiting. Returns true when none is pending.
+bool PollShaderPrograms();
+void FinishShaderPrograms();
+
+ShaderProgramStatus GetShaderProgramStatus(ShaderProgramHandle handle);
+// 0 until the program is ready. Changes when a reload finished, callers compare it with the id they used last frame.
+GLuint GetShaderProgram(ShaderProgramHandle handle);
+
+// Rebuilds every program that uses the given file (matched by file name, includes count too) in the background. PollShaderPrograms
+// swaps a rebuilt program in after copying its uniform values and uniform block bindings. When the new source
+// does not compile or link, the previous program stays in use. Returns the number of programs being rebuilt.
+unsigned int ReloadShadersUsing(const char * file_name);
+
+// Linked programs are stored as glGetProgramBinary blobs in a cache directory, keyed by a hash of
+// both sources and the GL vendor/renderer/version. LoadShaders reloads them with glProgramBinary
+// and compiles from source when there is no blob or the driver rejects it.
+struct ShaderCacheStats {
+	unsigned int Hits;
+	unsigned int Misses;
+	unsigned int Rejected;		// Blobs found on disk but refused by the driver
+	double LoadMs;				// Time spent in glProgramBinary for hits
+	double CompileMs;			// Time spent compiling and linking misses
+	double SavedMs;				// Compile time recorded with each hit blob minus its load time
+};
+
+// Pass NULL to disable the cache. Defaults to "shader_cache" in the working directory.
+void SetShaderCacheDirectory(const char * directory);
+ShaderCacheStats GetShaderCacheStats();
+void PrintShaderCacheStats();
+
 #endif
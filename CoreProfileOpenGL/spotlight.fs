@@ -1,25 +1,5 @@
 #version 330 core
-struct Material 
-{
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;    
-    float shininess;
-}; 
-struct Light 
-{
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    
-    float constant;
-    float linear;
-    float quadratic;
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
-}; 
+#include "lighting_structs.glsl"
 
 in vec3 FragPos;  
 in vec3 Normal;  
@@ -41,7 +21,7 @@ void main()
     if(theta > light.cutOff) // Remember that we're working with angles as cosines instead of degrees so a '>' is used.
     {    
         // Ambient
-        vec3 ambient = light.ambient * material.ambient;
+        vec3 ambient = light.ambient * material.diffuse;
         
         // Diffuse 
         vec3 norm = normalize(Normal);        
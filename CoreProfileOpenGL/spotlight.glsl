@@ -0,0 +1,46 @@
+// Phong lighting of one spotlight with attenuation. Expects FragPos and material to be declared.
+//   SPECULAR      add the specular term, left out for materials without a highlight
+//   SOFT_EDGES    fade between cutOff and outerCutOff instead of a hard cone border
+//   CONE_AMBIENT  limit the ambient term to the cone as well
+vec3 CalcSpotlight(Light light, vec3 norm, vec3 viewDir)
+{
+    // Ambient
+    vec3 ambient = light.ambient * material.diffuse;
+    
+    // Diffuse 
+    vec3 lightDir = normalize(light.position - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * material.diffuse;  
+    
+#ifdef SPECULAR
+    // Specular
+    vec3 reflectDir = reflect(-lightDir, norm);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    vec3 specular = light.specular * spec * material.specular;
+#else
+    vec3 specular = vec3(0.0);
+#endif
+    
+    // Spotlight
+    float theta = dot(lightDir, normalize(-light.direction)); 
+#ifdef SOFT_EDGES
+    float epsilon = (light.cutOff - light.outerCutOff);
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+#else
+    float intensity = theta > light.cutOff ? 1.0 : 0.0;
+#endif
+#ifdef CONE_AMBIENT
+    ambient  *= intensity;
+#endif
+    diffuse  *= intensity;
+    specular *= intensity;
+    
+    // Attenuation
+    float distance    = length(light.position - FragPos);
+    float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    ambient  *= attenuation; 
+    diffuse  *= attenuation;
+    specular *= attenuation;   
+
+    return ambient + diffuse + specular;
+}
@@ -43,6 +43,37 @@ int
 		int block_size_x, int block_size_y
 	);
 
+/**
+	Computes rows [first_row, first_row+row_count) of the
+	next MIPmap level, averaging 2x2 blocks exactly like
+	mipmap_image( ..., 2, 2 ).  resampled points to the
+	whole level, so threads can each fill a range of rows.
+**/
+int
+	mipmap_image_rows
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int first_row, int row_count
+	);
+
+/**
+	Builds every MIPmap level below orig down to 1x1 in
+	one pass, each level from the one above with 2x2
+	blocks.  The levels are stored back to back in chain,
+	which needs room for all of them (about a third of the
+	size of orig).
+	\return the number of levels written
+**/
+int
+	mipmap_image_chain
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* chain
+	);
+
 /**
 	This function takes the RGB components of the image
 	and scales each channel from [0,255] to [16,235].
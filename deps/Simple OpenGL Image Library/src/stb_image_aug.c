@@ -78,6 +78,17 @@
 #include <assert.h>
 #include <stdarg.h>
 
+// SSE2 versions of the jpeg IDCT, upsampling and color conversion. MSVC
+// compiles the intrinsics for any x86 target, so there CPUID decides at run
+// time whether they are used
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define STBI_SSE2
+#include <emmintrin.h>
+#ifdef _M_IX86
+#include <intrin.h>
+#endif
+#endif
+
 #ifndef _MSC_VER
   #ifdef __cplusplus
   #define __forceinline inline
@@ -597,6 +608,13 @@ typedef struct
    int    delta[17];   // old 'firstsymbol' - old 'firstcode'
 } huffman;
 
+#if STBI_SIMD
+typedef stbi_idct_8x8 idct_block_func;
+#else
+typedef void (*idct_block_func)(uint8 *out, int out_stride, short data[64], uint8 *dequantize);
+#endif
+typedef void (*YCbCr_to_RGB_func)(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int count, int step);
+
 typedef struct
 {
    #if STBI_SIMD
@@ -634,6 +652,11 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+
+   // routines for this image, see select_jpeg_kernels
+   int sse2;
+   idct_block_func idct;
+   YCbCr_to_RGB_func YCbCr_to_RGB;
 } jpeg;
 
 static int build_huffman(huffman *h, int *count)
@@ -976,7 +999,8 @@ static void idct_block(uint8 *out, int out_stride, short data[64], unsigned shor
       o[4] = clamp((x3-t0) >> 17);
    }
 }
-static stbi_idct_8x8 stbi_idct_installed = idct_block;
+// NULL until one is installed, decoding then picks the built-in one
+static stbi_idct_8x8 stbi_idct_installed = NULL;
 
 extern void stbi_install_idct(stbi_idct_8x8 func)
 {
@@ -984,6 +1008,213 @@ extern void stbi_install_idct(stbi_idct_8x8 func)
 }
 #endif
 
+#ifdef STBI_SSE2
+// constant pairs for _mm_madd_epi16
+#define dct_const(x,y)  _mm_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y))
+
+// out0 = x*c0[0] + y*c0[1], out1 = x*c1[0] + y*c1[1]; 16 bit in, 32 bit out
+#define dct_rot(out0,out1, x,y,c0,c1) \
+   __m128i c0##lo = _mm_unpacklo_epi16((x),(y)); \
+   __m128i c0##hi = _mm_unpackhi_epi16((x),(y)); \
+   __m128i out0##_l = _mm_madd_epi16(c0##lo, c0); \
+   __m128i out0##_h = _mm_madd_epi16(c0##hi, c0); \
+   __m128i out1##_l = _mm_madd_epi16(c0##lo, c1); \
+   __m128i out1##_h = _mm_madd_epi16(c0##hi, c1)
+
+// out = in << 12; 16 bit in, 32 bit out
+#define dct_widen(out, in) \
+   __m128i out##_l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), (in)), 4); \
+   __m128i out##_h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+   __m128i out##_l = _mm_add_epi32(a##_l, b##_l); \
+   __m128i out##_h = _mm_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+   __m128i out##_l = _mm_sub_epi32(a##_l, b##_l); \
+   __m128i out##_h = _mm_sub_epi32(a##_h, b##_h)
+
+// out0 = (a + bias + b) >> s, out1 = (a + bias - b) >> s, packed to 16 bit
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+   { \
+      __m128i abiased_l = _mm_add_epi32(a##_l, bias); \
+      __m128i abiased_h = _mm_add_epi32(a##_h, bias); \
+      dct_wadd(sum, abiased, b); \
+      dct_wsub(dif, abiased, b); \
+      out0 = _mm_packs_epi32(_mm_srai_epi32(sum_l, s), _mm_srai_epi32(sum_h, s)); \
+      out1 = _mm_packs_epi32(_mm_srai_epi32(dif_l, s), _mm_srai_epi32(dif_h, s)); \
+   }
+
+// interleave steps of the transposes
+#define dct_interleave8(a, b) \
+   tmp = a; \
+   a = _mm_unpacklo_epi8(a, b); \
+   b = _mm_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+   tmp = a; \
+   a = _mm_unpacklo_epi16(a, b); \
+   b = _mm_unpackhi_epi16(tmp, b)
+
+// IDCT_1D on eight columns at once, row0..row7 are s0..s7 in and out
+#define dct_pass(bias,shift) \
+   { \
+      /* even part */ \
+      dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+      __m128i sum04 = _mm_add_epi16(row0, row4); \
+      __m128i dif04 = _mm_sub_epi16(row0, row4); \
+      dct_widen(t0e, sum04); \
+      dct_widen(t1e, dif04); \
+      dct_wadd(x0, t0e, t3e); \
+      dct_wsub(x3, t0e, t3e); \
+      dct_wadd(x1, t1e, t2e); \
+      dct_wsub(x2, t1e, t2e); \
+      /* odd part */ \
+      dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+      dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+      __m128i sum17 = _mm_add_epi16(row1, row7); \
+      __m128i sum35 = _mm_add_epi16(row3, row5); \
+      dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+      dct_wadd(x4, y0o, y4o); \
+      dct_wadd(x5, y1o, y5o); \
+      dct_wadd(x6, y2o, y5o); \
+      dct_wadd(x7, y3o, y4o); \
+      dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+      dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+      dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+      dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+   }
+
+#if STBI_SIMD
+#define dct_load(r) _mm_mullo_epi16(_mm_loadu_si128((const __m128i *) (data + (r)*8)), \
+                       _mm_loadu_si128((const __m128i *) (dequantize + (r)*8)))
+#else
+#define dct_load(r) _mm_mullo_epi16(_mm_loadu_si128((const __m128i *) (data + (r)*8)), \
+                       _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (dequantize + (r)*8)), _mm_setzero_si128()))
+#endif
+
+// idct_block with the eight columns, then the eight rows, in SSE2 registers.
+// The products and sums are the same as in IDCT_1D, just regrouped, and the
+// intermediates are kept in 16 bits, so the output is identical for every
+// block an 8-bit image can produce; only coefficients no encoder writes can
+// saturate where idct_block would not
+#if STBI_SIMD
+static void idct_block_sse2(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
+#else
+static void idct_block_sse2(uint8 *out, int out_stride, short data[64], uint8 *dequantize)
+#endif
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7, tmp;
+
+   __m128i rot0_0 = dct_const(f2f(0.5411961f), f2f(0.5411961f) + f2f(-1.847759065f));
+   __m128i rot0_1 = dct_const(f2f(0.5411961f) + f2f( 0.765366865f), f2f(0.5411961f));
+   __m128i rot1_0 = dct_const(f2f(1.175875602f) + f2f(-0.899976223f), f2f(1.175875602f));
+   __m128i rot1_1 = dct_const(f2f(1.175875602f), f2f(1.175875602f) + f2f(-2.562915447f));
+   __m128i rot2_0 = dct_const(f2f(-1.961570560f) + f2f( 0.298631336f), f2f(-1.961570560f));
+   __m128i rot2_1 = dct_const(f2f(-1.961570560f), f2f(-1.961570560f) + f2f( 3.072711026f));
+   __m128i rot3_0 = dct_const(f2f(-0.390180644f) + f2f( 2.053119869f), f2f(-0.390180644f));
+   __m128i rot3_1 = dct_const(f2f(-0.390180644f), f2f(-0.390180644f) + f2f( 1.501321110f));
+
+   // the rounding of the two passes in idct_block; the row pass also adds
+   // the 128 that clamp adds
+   __m128i bias_0 = _mm_set1_epi32(512);
+   __m128i bias_1 = _mm_set1_epi32(65536 + (128<<17));
+
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // columns
+   dct_pass(bias_0, 10);
+
+   // 16 bit 8x8 transpose
+   dct_interleave16(row0, row4);
+   dct_interleave16(row1, row5);
+   dct_interleave16(row2, row6);
+   dct_interleave16(row3, row7);
+
+   dct_interleave16(row0, row2);
+   dct_interleave16(row1, row3);
+   dct_interleave16(row4, row6);
+   dct_interleave16(row5, row7);
+
+   dct_interleave16(row0, row1);
+   dct_interleave16(row2, row3);
+   dct_interleave16(row4, row5);
+   dct_interleave16(row6, row7);
+
+   // rows
+   dct_pass(bias_1, 17);
+
+   {
+      // clamp to bytes, two rows per register
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8 bit 8x8 transpose
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+}
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#endif // STBI_SSE2
+
+static int stbi_jpeg_simd_enabled = 1;
+
+void stbi_jpeg_use_simd(int enable)
+{
+   stbi_jpeg_simd_enabled = enable;
+}
+
+// whether this decode uses the SSE2 routines
+static int jpeg_use_sse2(void)
+{
+#ifdef STBI_SSE2
+   #ifdef _M_IX86
+   int info[4];
+   if (!stbi_jpeg_simd_enabled) return 0;
+   __cpuid(info, 1);
+   return (info[3] >> 26) & 1;
+   #else
+   return stbi_jpeg_simd_enabled;
+   #endif
+#else
+   return 0;
+#endif
+}
+
 #define MARKER_none  0xff
 // if there's a pending marker from the entropy stream, return that
 // otherwise, fetch from the stream and get a marker. if there's no
@@ -1037,9 +1268,9 @@ static int parse_entropy_coded_data(jpeg *z)
          for (i=0; i < w; ++i) {
             if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
             #if STBI_SIMD
-            stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+            z->idct(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
             #else
-            idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+            z->idct(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
             #endif
             // every data block is an MCU, so countdown the restart interval
             if (--z->todo <= 0) {
@@ -1067,9 +1298,9 @@ static int parse_entropy_coded_data(jpeg *z)
                      int y2 = (j*z->img_comp[n].v + y)*8;
                      if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
                      #if STBI_SIMD
-                     stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+                     z->idct(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
                      #else
-                     idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+                     z->idct(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
                      #endif
                   }
                }
@@ -1116,7 +1347,7 @@ static int process_marker(jpeg *z, int m)
                z->dequant[t][dezigzag[i]] = get8u(&z->s);
             #if STBI_SIMD
             for (i=0; i < 64; ++i)
-               z->dequant2[t][i] = dequant[t][i];
+               z->dequant2[t][i] = z->dequant[t][i];
             #endif
             L -= 65;
          }
@@ -1368,6 +1599,92 @@ static uint8 *resample_row_hv_2(uint8 *out, uint8 *in_near, uint8 *in_far, int w
    return out;
 }
 
+#ifdef STBI_SSE2
+// the 16 outputs of 8 inputs t for the 2x horizontal upsamplers: output 2i is
+// (3*t[i] + t[i-1] + bias) >> shift and output 2i+1 takes t[i+1] instead,
+// with prev and next the neighbours of the first and last input
+static void upsample_8_sse2(uint8 *out, __m128i t, int prev, int next, __m128i bias, __m128i shift)
+{
+   __m128i t3 = _mm_add_epi16(_mm_add_epi16(t, t), t);
+   __m128i left = _mm_or_si128(_mm_slli_si128(t, 2), _mm_cvtsi32_si128(prev));
+   __m128i right = _mm_or_si128(_mm_srli_si128(t, 2), _mm_slli_si128(_mm_cvtsi32_si128(next), 14));
+   __m128i even = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(t3, left), bias), shift);
+   __m128i odd = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(t3, right), bias), shift);
+   _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd)));
+}
+
+static uint8 *resample_row_v_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i two = _mm_set1_epi16(2);
+   int i;
+   (void)hs;
+   for (i=0; i+16 <= w; i += 16) {
+      __m128i n = _mm_loadu_si128((const __m128i *) (in_near+i));
+      __m128i f = _mm_loadu_si128((const __m128i *) (in_far+i));
+      __m128i n_lo = _mm_unpacklo_epi8(n, zero), n_hi = _mm_unpackhi_epi8(n, zero);
+      __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(n_lo, n_lo), n_lo), _mm_add_epi16(_mm_unpacklo_epi8(f, zero), two));
+      __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(n_hi, n_hi), n_hi), _mm_add_epi16(_mm_unpackhi_epi8(f, zero), two));
+      _mm_storeu_si128((__m128i *) (out+i), _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+   }
+   for (; i < w; ++i)
+      out[i] = div4(3*in_near[i] + in_far[i] + 2);
+   return out;
+}
+
+// the first and last input are their own outer neighbours, which gives the
+// same edge outputs as resample_row_h_2 and resample_row_hv_2
+static uint8 *resample_row_h_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i bias = _mm_set1_epi16(2);
+   __m128i shift = _mm_cvtsi32_si128(2);
+   int i, t0 = in_near[0];
+   (void)in_far;
+   (void)hs;
+   for (i=0; i+8 < w; i += 8) {
+      __m128i t = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_near+i)), zero);
+      upsample_8_sse2(out + i*2, t, t0, in_near[i+8], bias, shift);
+      t0 = in_near[i+7];
+   }
+   for (; i < w; ++i) {
+      int t1 = in_near[i];
+      int t2 = i+1 < w ? in_near[i+1] : t1;
+      out[i*2+0] = div4(3*t1 + t0 + 2);
+      out[i*2+1] = div4(3*t1 + t2 + 2);
+      t0 = t1;
+   }
+   // resample_row_h_2 weights the last pair of inputs the other way round
+   if (w > 1)
+      out[w*2-2] = div4(3*in_near[w-2] + in_near[w-1] + 2);
+   return out;
+}
+
+static uint8 *resample_row_hv_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i bias = _mm_set1_epi16(8);
+   __m128i shift = _mm_cvtsi32_si128(4);
+   int i, t0 = 3*in_near[0] + in_far[0];
+   (void)hs;
+   for (i=0; i+8 < w; i += 8) {
+      __m128i n = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_near+i)), zero);
+      __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (in_far+i)), zero);
+      __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(n, n), n), f);
+      upsample_8_sse2(out + i*2, t, t0, 3*in_near[i+8] + in_far[i+8], bias, shift);
+      t0 = 3*in_near[i+7] + in_far[i+7];
+   }
+   for (; i < w; ++i) {
+      int t1 = 3*in_near[i] + in_far[i];
+      int t2 = i+1 < w ? 3*in_near[i+1] + in_far[i+1] : t1;
+      out[i*2+0] = div16(3*t1 + t0 + 8);
+      out[i*2+1] = div16(3*t1 + t2 + 8);
+      t0 = t1;
+   }
+   return out;
+}
+#endif
+
 static uint8 *resample_row_generic(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -1407,8 +1724,68 @@ static void YCbCr_to_RGB_row(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int c
    }
 }
 
+#ifdef STBI_SSE2
+// c as the _mm_madd_epi16 pair (c & 3, c >> 2) for the inputs (x, x << 2)
+#define ycc_const(c)  _mm_set1_epi32((int) (((unsigned int) ((c) >> 2) << 16) | ((c) & 3)))
+
+// YCbCr_to_RGB_row eight pixels at a time; the fixed point products are the
+// same 32 bit ones, so is the result
+static void YCbCr_to_RGB_row_sse2(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int count, int step)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i center = _mm_set1_epi16(128);
+   __m128i round = _mm_set1_epi32(32768);
+   __m128i cr_r = ycc_const( float2fixed(1.40200f));
+   __m128i cr_g = ycc_const(-float2fixed(0.71414f));
+   __m128i cb_g = ycc_const(-float2fixed(0.34414f));
+   __m128i cb_b = ycc_const( float2fixed(1.77200f));
+   __m128i alpha = _mm_set1_epi8((char) 255);
+   uint8 rgba[32];
+   int i, k;
+   for (i=0; i+8 <= count; i += 8) {
+      __m128i yw = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (y+i)), zero);
+      __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcr+i)), zero), center);
+      __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcb+i)), zero), center);
+      __m128i cr_lo = _mm_unpacklo_epi16(cr, _mm_slli_epi16(cr, 2));
+      __m128i cr_hi = _mm_unpackhi_epi16(cr, _mm_slli_epi16(cr, 2));
+      __m128i cb_lo = _mm_unpacklo_epi16(cb, _mm_slli_epi16(cb, 2));
+      __m128i cb_hi = _mm_unpackhi_epi16(cb, _mm_slli_epi16(cb, 2));
+      // (y << 16) + 32768
+      __m128i y_lo = _mm_add_epi32(_mm_unpacklo_epi16(zero, yw), round);
+      __m128i y_hi = _mm_add_epi32(_mm_unpackhi_epi16(zero, yw), round);
+      __m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, _mm_madd_epi16(cr_lo, cr_r)), 16),
+                                  _mm_srai_epi32(_mm_add_epi32(y_hi, _mm_madd_epi16(cr_hi, cr_r)), 16));
+      __m128i g = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(y_lo, _mm_madd_epi16(cr_lo, cr_g)), _mm_madd_epi16(cb_lo, cb_g)), 16),
+                                  _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(y_hi, _mm_madd_epi16(cr_hi, cr_g)), _mm_madd_epi16(cb_hi, cb_g)), 16));
+      __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, _mm_madd_epi16(cb_lo, cb_b)), 16),
+                                  _mm_srai_epi32(_mm_add_epi32(y_hi, _mm_madd_epi16(cb_hi, cb_b)), 16));
+      // clamp to bytes and interleave to RGBA
+      __m128i rg = _mm_packus_epi16(r, g);
+      __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+      rg = _mm_unpacklo_epi8(rg, _mm_srli_si128(rg, 8));
+      if (step == 4) {
+         _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(rg, ba));
+         _mm_storeu_si128((__m128i *) (out+16), _mm_unpackhi_epi16(rg, ba));
+      } else {
+         _mm_storeu_si128((__m128i *) rgba, _mm_unpacklo_epi16(rg, ba));
+         _mm_storeu_si128((__m128i *) (rgba+16), _mm_unpackhi_epi16(rg, ba));
+         for (k=0; k < 8; ++k) {
+            out[k*3+0] = rgba[k*4+0];
+            out[k*3+1] = rgba[k*4+1];
+            out[k*3+2] = rgba[k*4+2];
+         }
+      }
+      out += 8*step;
+   }
+   YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+
+#undef ycc_const
+#endif // STBI_SSE2
+
 #if STBI_SIMD
-static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row;
+// NULL until one is installed, decoding then picks the built-in one
+static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = NULL;
 
 void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 {
@@ -1443,12 +1820,32 @@ typedef struct
    int ypos;    // which pre-expansion row we're on
 } stbi_resample;
 
+// an installed IDCT or color conversion (STBI_SIMD) comes first, then the
+// SSE2 versions where the CPU has them, then the C ones
+static void select_jpeg_kernels(jpeg *z)
+{
+   z->sse2 = jpeg_use_sse2();
+   z->idct = idct_block;
+   z->YCbCr_to_RGB = YCbCr_to_RGB_row;
+   #ifdef STBI_SSE2
+   if (z->sse2) {
+      z->idct = idct_block_sse2;
+      z->YCbCr_to_RGB = YCbCr_to_RGB_row_sse2;
+   }
+   #endif
+   #if STBI_SIMD
+   if (stbi_idct_installed) z->idct = stbi_idct_installed;
+   if (stbi_YCbCr_installed) z->YCbCr_to_RGB = (YCbCr_to_RGB_func) stbi_YCbCr_installed;
+   #endif
+}
+
 static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n;
    // validate req_comp
    if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
    z->s.img_n = 0;
+   select_jpeg_kernels(z);
 
    // load a jpeg image from whichever source
    if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
@@ -1490,6 +1887,13 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
          else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
          else                               r->resample = resample_row_generic;
+         #ifdef STBI_SSE2
+         if (z->sse2) {
+            if      (r->resample == resample_row_v_2)  r->resample = resample_row_v_2_sse2;
+            else if (r->resample == resample_row_h_2)  r->resample = resample_row_h_2_sse2;
+            else if (r->resample == resample_row_hv_2) r->resample = resample_row_hv_2_sse2;
+         }
+         #endif
       }
 
       // can't error after this so, this is safe
@@ -1516,11 +1920,7 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          if (n >= 3) {
             uint8 *y = coutput[0];
             if (z->s.img_n == 3) {
-               #if STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #endif
+               z->YCbCr_to_RGB(out, y, coutput[1], coutput[2], z->s.img_x, n);
             } else
                for (i=0; i < z->s.img_x; ++i) {
                   out[0] = out[1] = out[2] = y[i];
@@ -1815,7 +2215,7 @@ static int parse_huffman_block(zbuf *a)
 static int compute_huffman_codes(zbuf *a)
 {
    static uint8 length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
-   static zhuffman z_codelength; // static just to save stack space
+   zhuffman z_codelength; // on the stack so several threads can decode at once
    uint8 lencodes[286+32+137];//padding for maximum single op
    uint8 codelength_sizes[19];
    int i,n;
@@ -19,6 +19,11 @@
 	method fails for finding the largest eigenvector	*/
 #define USE_COV_MAT	1
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_DXT_SSE2 1
+#endif
+
 /********* Function Prototypes *********/
 /*
 	Takes a 4x4 block of pixels and compresses it into 8 bytes
@@ -38,6 +43,41 @@ void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
 
+/*
+	Copies the 4x4 block at pixel (i, j) into 16 RGBA pixels,
+	alpha is 255 for images without one.  The parts of the
+	block outside the image repeat its first pixel.
+*/
+static void gather_block(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels,
+				int i, int j,
+				unsigned char ublock[16*4] );
+/*
+	Compresses block rows of the image to DXT1 (with_alpha == 0)
+	or DXT5, see compress_image_to_DXT1_rows
+*/
+static int compress_image_rows(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels,
+				unsigned char *compressed,
+				int first_block_row, int block_row_count,
+				int reference, int with_alpha );
+#ifdef IMAGE_DXT_SSE2
+/*
+	The same as compress_DDS_color_block and compress_DDS_alpha_block
+	for an RGBA block, with the per texel math done on 4 texels at
+	once.  The sums of the color line are exact in integers and the
+	float math runs in the same order, so the bytes are identical.
+*/
+static void compress_DDS_color_block_SSE2(
+				const unsigned char uncompressed[16*4],
+				unsigned char compressed[8] );
+static void compress_DDS_alpha_block_SSE2(
+				const unsigned char uncompressed[16*4],
+				unsigned char compressed[8] );
+#endif
+
 /********* Actual Exposed Functions *********/
 int
 	save_image_as_DDS
@@ -104,11 +144,6 @@ unsigned char* convert_image_to_DXT1(
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -117,65 +152,13 @@ unsigned char* convert_image_to_DXT1(
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
 	/*	get the RAM for the compressed image
 		(8 bytes per 4x4 pixel block)	*/
 	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
 	compressed = (unsigned char*)malloc( *out_size );
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
-	{
-		for( i = 0; i < width; i += 4 )
-		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-		}
-	}
+	compress_image_to_DXT1_rows( uncompressed, width, height, channels,
+			compressed, 0, (height+3) >> 2, 0 );
 	return compressed;
 }
 
@@ -185,11 +168,6 @@ unsigned char* convert_image_to_DXT5(
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -198,83 +176,162 @@ unsigned char* convert_image_to_DXT5(
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
 	/*	get the RAM for the compressed image
 		(16 bytes per 4x4 pixel block)	*/
 	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
 	compressed = (unsigned char*)malloc( *out_size );
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	compress_image_to_DXT5_rows( uncompressed, width, height, channels,
+			compressed, 0, (height+3) >> 2, 0 );
+	return compressed;
+}
+
+int
+	compress_image_to_DXT1_rows
+	(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		unsigned char *compressed,
+		int first_block_row, int block_row_count,
+		int reference
+	)
+{
+	return compress_image_rows( uncompressed, width, height, channels,
+			compressed, first_block_row, block_row_count, reference, 0 );
+}
+
+int
+	compress_image_to_DXT5_rows
+	(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		unsigned char *compressed,
+		int first_block_row, int block_row_count,
+		int reference
+	)
+{
+	return compress_image_rows( uncompressed, width, height, channels,
+			compressed, first_block_row, block_row_count, reference, 1 );
+}
+
+/********* Helper Functions *********/
+static void gather_block(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int i, int j,
+		unsigned char ublock[16*4] )
+{
+	int x, y;
+	int idx = 0;
+	int mx = 4, my = 4;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
+	int chan_step = channels < 3 ? 0 : 1;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	int has_alpha = 1 - (channels & 1);
+	if( j+4 >= height )
+	{
+		my = height - j;
+	}
+	if( i+4 >= width )
+	{
+		mx = width - i;
+	}
+	for( y = 0; y < my; ++y )
+	{
+		const unsigned char *row = uncompressed + ((j+y)*width + i)*channels;
+		if( (channels == 4) && (mx == 4) )
+		{
+			memcpy( ublock + idx, row, 16 );
+			idx += 16;
+			continue;
+		}
+		for( x = 0; x < mx; ++x )
+		{
+			ublock[idx++] = row[x*channels];
+			ublock[idx++] = row[x*channels+chan_step];
+			ublock[idx++] = row[x*channels+chan_step+chan_step];
+			ublock[idx++] =
+				has_alpha * row[x*channels+channels-1]
+				+ (1-has_alpha)*255;
+		}
+		for( x = mx; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+			ublock[idx++] = ublock[1];
+			ublock[idx++] = ublock[2];
+			ublock[idx++] = ublock[3];
+		}
+	}
+	for( y = my; y < 4; ++y )
+	{
+		for( x = 0; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+			ublock[idx++] = ublock[1];
+			ublock[idx++] = ublock[2];
+			ublock[idx++] = ublock[3];
+		}
+	}
+}
+
+static int compress_image_rows(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		unsigned char *compressed,
+		int first_block_row, int block_row_count,
+		int reference, int with_alpha )
+{
+	int i, j;
+	int block_rows = (height+3) >> 2;
+	int block_bytes = with_alpha ? 16 : 8;
+	unsigned char ublock[16*4];
+	unsigned char *out;
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) || (NULL == compressed) ||
+		(channels < 1) || (channels > 4) ||
+		(first_block_row < 0) || (block_row_count < 0) )
+	{
+		return 0;
+	}
+	if( block_row_count > block_rows - first_block_row )
+	{
+		block_row_count = block_rows - first_block_row;
+	}
+	out = compressed + first_block_row * ((width+3) >> 2) * block_bytes;
+	for( j = first_block_row*4; j < (first_block_row+block_row_count)*4; j += 4 )
 	{
 		for( i = 0; i < width; i += 4 )
 		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
+			/*	copy this block into a new one, the color
+				code only reads the first 3 channels of
+				the 4, so DXT1 gives the same as from RGB	*/
+			gather_block( uncompressed, width, height, channels, i, j, ublock );
+#ifdef IMAGE_DXT_SSE2
+			if( !reference )
 			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
+				if( with_alpha )
 				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] =
-						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
-						+ (1-has_alpha)*255;
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
+					compress_DDS_alpha_block_SSE2( ublock, out );
+					out += 8;
 				}
+				compress_DDS_color_block_SSE2( ublock, out );
+				out += 8;
+				continue;
 			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
+#endif
+			if( with_alpha )
 			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
+				compress_DDS_alpha_block( ublock, out );
+				out += 8;
 			}
+			compress_DDS_color_block( 4, ublock, out );
+			out += 8;
 		}
 	}
-	return compressed;
+	return 1;
 }
 
-/********* Helper Functions *********/
 int convert_bit_range( int c, int from_bits, int to_bits )
 {
 	int b = (1 << (from_bits - 1)) + c * ((1 << to_bits) - 1);
@@ -630,3 +687,274 @@ void
 	}
 	/*	done compressing to DXT1	*/
 }
+
+#ifdef IMAGE_DXT_SSE2
+static void
+	compress_DDS_color_block_SSE2
+	(
+		const unsigned char uncompressed[16*4],
+		unsigned char compressed[8]
+	)
+{
+	const __m128i byte_mask = _mm_set1_epi32( 0xFF );
+	__m128i r[4], g[4], b[4];
+	__m128 rf[4], gf[4], bf[4];
+	__m128i sums[9];
+	int totals[9];
+	float point[3], direction[3];
+	float sum_rr, sum_gg, sum_bb, sum_rg, sum_rb, sum_gb;
+	float sum_r, sum_g, sum_b;
+	float vec_len2, dot, dot_min, dot_max;
+	float color_line[3], dot_offset;
+	int c0[3], c1[3], enc_c0, enc_c1;
+	int i, k;
+	__m128 lo, hi, line0, line1, line2, offset;
+	__m128i indices[2];
+	unsigned int bit_planes[2];
+	unsigned int bits = 0;
+	/*	split the 16 texels into R, G and B, 4 at a time, as 32 bit
+		lanes whose upper half is 0, so _mm_madd_epi16 squares them	*/
+	for( k = 0; k < 9; ++k )
+	{
+		sums[k] = _mm_setzero_si128();
+	}
+	for( i = 0; i < 4; ++i )
+	{
+		__m128i texels = _mm_loadu_si128( (const __m128i*)(uncompressed + 16*i) );
+		r[i] = _mm_and_si128( texels, byte_mask );
+		g[i] = _mm_and_si128( _mm_srli_epi32( texels, 8 ), byte_mask );
+		b[i] = _mm_and_si128( _mm_srli_epi32( texels, 16 ), byte_mask );
+		sums[0] = _mm_add_epi32( sums[0], r[i] );
+		sums[1] = _mm_add_epi32( sums[1], g[i] );
+		sums[2] = _mm_add_epi32( sums[2], b[i] );
+		sums[3] = _mm_add_epi32( sums[3], _mm_madd_epi16( r[i], r[i] ) );
+		sums[4] = _mm_add_epi32( sums[4], _mm_madd_epi16( g[i], g[i] ) );
+		sums[5] = _mm_add_epi32( sums[5], _mm_madd_epi16( b[i], b[i] ) );
+		sums[6] = _mm_add_epi32( sums[6], _mm_madd_epi16( r[i], g[i] ) );
+		sums[7] = _mm_add_epi32( sums[7], _mm_madd_epi16( r[i], b[i] ) );
+		sums[8] = _mm_add_epi32( sums[8], _mm_madd_epi16( g[i], b[i] ) );
+		rf[i] = _mm_cvtepi32_ps( r[i] );
+		gf[i] = _mm_cvtepi32_ps( g[i] );
+		bf[i] = _mm_cvtepi32_ps( b[i] );
+	}
+	for( k = 0; k < 9; ++k )
+	{
+		__m128i sum = _mm_add_epi32( sums[k], _mm_shuffle_epi32( sums[k], _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		totals[k] = _mm_cvtsi128_si32( sum );
+	}
+	/*	from here on compute_color_line_STDEV, the sums are below 2^24
+		so the float sums it builds up are these exact integers	*/
+	sum_r = (float)totals[0] * (1.0f / 16.0f);
+	sum_g = (float)totals[1] * (1.0f / 16.0f);
+	sum_b = (float)totals[2] * (1.0f / 16.0f);
+	sum_rr = (float)totals[3] - 16.0f * sum_r * sum_r;
+	sum_gg = (float)totals[4] - 16.0f * sum_g * sum_g;
+	sum_bb = (float)totals[5] - 16.0f * sum_b * sum_b;
+	sum_rg = (float)totals[6] - 16.0f * sum_r * sum_g;
+	sum_rb = (float)totals[7] - 16.0f * sum_r * sum_b;
+	sum_gb = (float)totals[8] - 16.0f * sum_g * sum_b;
+	point[0] = sum_r;
+	point[1] = sum_g;
+	point[2] = sum_b;
+	#if USE_COV_MAT
+	direction[0] = 1.0f;
+	direction[1] = 2.718281828f;
+	direction[2] = 3.141592654f;
+	for( k = 0; k < 3; ++k )
+	{
+		sum_r = direction[0];
+		sum_g = direction[1];
+		sum_b = direction[2];
+		direction[0] = sum_r*sum_rr + sum_g*sum_rg + sum_b*sum_rb;
+		direction[1] = sum_r*sum_rg + sum_g*sum_gg + sum_b*sum_gb;
+		direction[2] = sum_r*sum_rb + sum_g*sum_gb + sum_b*sum_bb;
+	}
+	#else
+	direction[0] = sqrt( sum_rr );
+	direction[1] = sqrt( sum_gg );
+	direction[2] = sqrt( sum_bb );
+	if( sum_gg > sum_rr )
+	{
+		if( sum_rg < 0.0f )
+		{
+			direction[0] = -direction[0];
+		}
+		if( sum_gb < 0.0f )
+		{
+			direction[2] = -direction[2];
+		}
+	} else
+	{
+		if( sum_rg < 0.0f )
+		{
+			direction[1] = -direction[1];
+		}
+		if( sum_rb < 0.0f )
+		{
+			direction[2] = -direction[2];
+		}
+	}
+	#endif
+	/*	LSE_master_colors_max_min: the extent of the texels along the line	*/
+	vec_len2 = 1.0f / ( 0.00001f +
+			direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2] );
+	line0 = _mm_set1_ps( direction[0] );
+	line1 = _mm_set1_ps( direction[1] );
+	line2 = _mm_set1_ps( direction[2] );
+	lo = hi = _mm_add_ps( _mm_add_ps( _mm_mul_ps( line0, rf[0] ), _mm_mul_ps( line1, gf[0] ) ), _mm_mul_ps( line2, bf[0] ) );
+	for( i = 1; i < 4; ++i )
+	{
+		__m128 dots = _mm_add_ps( _mm_add_ps( _mm_mul_ps( line0, rf[i] ), _mm_mul_ps( line1, gf[i] ) ), _mm_mul_ps( line2, bf[i] ) );
+		lo = _mm_min_ps( lo, dots );
+		hi = _mm_max_ps( hi, dots );
+	}
+	lo = _mm_min_ps( lo, _mm_shuffle_ps( lo, lo, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	lo = _mm_min_ps( lo, _mm_shuffle_ps( lo, lo, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	hi = _mm_max_ps( hi, _mm_shuffle_ps( hi, hi, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	hi = _mm_max_ps( hi, _mm_shuffle_ps( hi, hi, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	dot_min = _mm_cvtss_f32( lo );
+	dot_max = _mm_cvtss_f32( hi );
+	dot = direction[0]*point[0] + direction[1]*point[1] + direction[2]*point[2];
+	dot_min -= dot;
+	dot_max -= dot;
+	dot_min *= vec_len2;
+	dot_max *= vec_len2;
+	for( i = 0; i < 3; ++i )
+	{
+		c0[i] = (int)(0.5f + point[i] + dot_max * direction[i]);
+		c0[i] = c0[i] < 0 ? 0 : (c0[i] > 255 ? 255 : c0[i]);
+		c1[i] = (int)(0.5f + point[i] + dot_min * direction[i]);
+		c1[i] = c1[i] < 0 ? 0 : (c1[i] > 255 ? 255 : c1[i]);
+	}
+	enc_c0 = rgb_to_565( c0[0], c0[1], c0[2] );
+	enc_c1 = rgb_to_565( c1[0], c1[1], c1[2] );
+	if( enc_c0 < enc_c1 )
+	{
+		k = enc_c0;
+		enc_c0 = enc_c1;
+		enc_c1 = k;
+	}
+	/*	compress_DDS_color_block: the master colors, then the index of
+		every texel on the line between them	*/
+	compressed[0] = (enc_c0 >> 0) & 255;
+	compressed[1] = (enc_c0 >> 8) & 255;
+	compressed[2] = (enc_c1 >> 0) & 255;
+	compressed[3] = (enc_c1 >> 8) & 255;
+	rgb_888_from_565( enc_c0, &c0[0], &c0[1], &c0[2] );
+	rgb_888_from_565( enc_c1, &c1[0], &c1[1], &c1[2] );
+	vec_len2 = 0.0f;
+	for( i = 0; i < 3; ++i )
+	{
+		color_line[i] = (float)(c1[i] - c0[i]);
+		vec_len2 += color_line[i] * color_line[i];
+	}
+	if( vec_len2 > 0.0f )
+	{
+		vec_len2 = 1.0f / vec_len2;
+	}
+	color_line[0] *= vec_len2;
+	color_line[1] *= vec_len2;
+	color_line[2] *= vec_len2;
+	dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
+	line0 = _mm_set1_ps( color_line[0] );
+	line1 = _mm_set1_ps( color_line[1] );
+	line2 = _mm_set1_ps( color_line[2] );
+	offset = _mm_set1_ps( dot_offset );
+	for( i = 0; i < 4; ++i )
+	{
+		__m128 dots = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( line0, rf[i] ), _mm_mul_ps( line1, gf[i] ) ), _mm_mul_ps( line2, bf[i] ) ), offset );
+		__m128i values = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( dots, _mm_set1_ps( 3.0f ) ), _mm_set1_ps( 0.5f ) ) );
+		if( i & 1 )
+		{
+			/*	saturating to 16 bits keeps the clamp to [0,3] the same	*/
+			indices[i >> 1] = _mm_packs_epi32( indices[i >> 1], values );
+			indices[i >> 1] = _mm_min_epi16( _mm_max_epi16( indices[i >> 1], _mm_setzero_si128() ), _mm_set1_epi16( 3 ) );
+		} else
+		{
+			indices[i >> 1] = values;
+		}
+	}
+	/*	swizzle4 as bit math: 0, 1, 2, 3 -> 0, 2, 3, 1	*/
+	for( i = 0; i < 2; ++i )
+	{
+		__m128i high = _mm_srli_epi16( indices[i], 1 );
+		__m128i low = _mm_and_si128( _mm_xor_si128( indices[i], high ), _mm_set1_epi16( 1 ) );
+		indices[i] = _mm_or_si128( high, _mm_slli_epi16( low, 1 ) );
+	}
+	/*	gather bit 0 and bit 1 of the 16 indices with movemask,
+		then interleave the two masks	*/
+	indices[0] = _mm_packus_epi16( indices[0], indices[1] );
+	bit_planes[0] = (unsigned int)_mm_movemask_epi8( _mm_slli_epi16( indices[0], 7 ) );
+	bit_planes[1] = (unsigned int)_mm_movemask_epi8( _mm_slli_epi16( indices[0], 6 ) );
+	for( i = 0; i < 2; ++i )
+	{
+		unsigned int x = bit_planes[i];
+		x = (x | (x << 8)) & 0x00FF00FFu;
+		x = (x | (x << 4)) & 0x0F0F0F0Fu;
+		x = (x | (x << 2)) & 0x33333333u;
+		x = (x | (x << 1)) & 0x55555555u;
+		bits |= x << i;
+	}
+	compressed[4] = (bits >> 0) & 255;
+	compressed[5] = (bits >> 8) & 255;
+	compressed[6] = (bits >> 16) & 255;
+	compressed[7] = (bits >> 24) & 255;
+}
+
+static void
+	compress_DDS_alpha_block_SSE2
+	(
+		const unsigned char uncompressed[16*4],
+		unsigned char compressed[8]
+	)
+{
+	__m128i alpha[2], lo, hi;
+	int values[16];
+	int i, a0, a1;
+	float scale_me;
+	/*	stupid order	*/
+	const int swizzle8[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+	unsigned int bits_lo = 0, bits_hi = 0;
+	/*	the alpha bytes as 16 bit values, 8 per register	*/
+	for( i = 0; i < 2; ++i )
+	{
+		__m128i first = _mm_srli_epi32( _mm_loadu_si128( (const __m128i*)(uncompressed + 32*i) ), 24 );
+		__m128i second = _mm_srli_epi32( _mm_loadu_si128( (const __m128i*)(uncompressed + 32*i + 16) ), 24 );
+		alpha[i] = _mm_packs_epi32( first, second );
+	}
+	/*	the alpha limits (a0 > a1)	*/
+	lo = _mm_min_epi16( alpha[0], alpha[1] );
+	hi = _mm_max_epi16( alpha[0], alpha[1] );
+	lo = _mm_min_epi16( lo, _mm_shuffle_epi32( lo, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	hi = _mm_max_epi16( hi, _mm_shuffle_epi32( hi, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	lo = _mm_min_epi16( lo, _mm_shuffle_epi32( lo, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	hi = _mm_max_epi16( hi, _mm_shuffle_epi32( hi, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	lo = _mm_min_epi16( lo, _mm_srli_epi32( lo, 16 ) );
+	hi = _mm_max_epi16( hi, _mm_srli_epi32( hi, 16 ) );
+	a1 = _mm_cvtsi128_si32( lo ) & 0xFFFF;
+	a0 = _mm_cvtsi128_si32( hi ) & 0xFFFF;
+	compressed[0] = a0;
+	compressed[1] = a1;
+	/*	convert every alpha value to a 3 bit number, 4 at a time	*/
+	scale_me = 7.9999f / (a0 - a1);
+	for( i = 0; i < 4; ++i )
+	{
+		__m128i texels = _mm_srli_epi32( _mm_loadu_si128( (const __m128i*)(uncompressed + 16*i) ), 24 );
+		__m128 offsets = _mm_cvtepi32_ps( _mm_sub_epi32( texels, _mm_set1_epi32( a1 ) ) );
+		_mm_storeu_si128( (__m128i*)(values + 4*i), _mm_cvttps_epi32( _mm_mul_ps( offsets, _mm_set1_ps( scale_me ) ) ) );
+	}
+	/*	48 bits of indices, 8 texels into each 24 bit half	*/
+	for( i = 0; i < 8; ++i )
+	{
+		bits_lo |= (unsigned int)swizzle8[ values[i] & 7 ] << (3*i);
+		bits_hi |= (unsigned int)swizzle8[ values[i + 8] & 7 ] << (3*i);
+	}
+	compressed[2] = (bits_lo >> 0) & 255;
+	compressed[3] = (bits_lo >> 8) & 255;
+	compressed[4] = (bits_lo >> 16) & 255;
+	compressed[5] = (bits_hi >> 0) & 255;
+	compressed[6] = (bits_hi >> 8) & 255;
+	compressed[7] = (bits_hi >> 16) & 255;
+}
+#endif
@@ -10,6 +10,10 @@
 #ifndef HEADER_IMAGE_DXT
 #define HEADER_IMAGE_DXT
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
 	Converts an image from an array of unsigned chars (RGB or RGBA) to
 	DXT1 or DXT5, then saves the converted image to disk.
@@ -45,6 +49,38 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	compress block rows [first_block_row, first_block_row+block_row_count)
+	of the image to DXT1 into compressed, which holds the whole image
+	laid out as convert_image_to_DXT1 returns it, so threads can each
+	take a band of block rows.  With SSE2 the per texel math runs on
+	4 texels at once and gives the same bytes; reference != 0 always
+	uses the plain code.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+compress_image_to_DXT1_rows
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    unsigned char *compressed,
+    int first_block_row, int block_row_count,
+    int reference
+);
+
+/**
+	the same for DXT5 (with alpha)
+**/
+int
+compress_image_to_DXT5_rows
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    unsigned char *compressed,
+    int first_block_row, int block_row_count,
+    int reference
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
@@ -120,4 +156,8 @@ DDS_header ;
 #define DDSCAPS2_CUBEMAP_NEGATIVEZ	0x00008000
 #define DDSCAPS2_VOLUME	0x00200000
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* HEADER_IMAGE_DXT	*/
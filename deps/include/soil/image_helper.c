@@ -10,6 +10,92 @@
 #include <stdlib.h>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_HELPER_SSE2 1
+#endif
+
+/*	Averages 2x2 blocks of two source rows into one row of the next
+	MIPmap level, rounding like mipmap_image does.  A source only 1
+	pixel wide uses that pixel twice, which gives the same result as
+	the 1x2 block mipmap_image would average.	*/
+static void
+	downsample_row_2x2
+	(
+		const unsigned char* row0, const unsigned char* row1,
+		int width, int channels,
+		unsigned char* out
+	)
+{
+	int out_width = width / 2;
+	int i = 0, c;
+	if( width < 2 )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			out[c] = (unsigned char)((2*row0[c] + 2*row1[c] + 2) >> 2);
+		}
+		return;
+	}
+#ifdef IMAGE_HELPER_SSE2
+	/*	32 source bytes of both rows make 16 output bytes, for
+		the pixel sizes that divide 16	*/
+	if( (channels == 1) || (channels == 2) || (channels == 4) )
+	{
+		const int step = 16 / channels;
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi16( 2 );
+		const __m128i low_bytes = _mm_set1_epi16( 0x00FF );
+		for( ; i + step <= out_width; i += step )
+		{
+			const unsigned char *src0 = row0 + 2*i*channels;
+			const unsigned char *src1 = row1 + 2*i*channels;
+			__m128i sum[2];
+			int half;
+			for( half = 0; half < 2; ++half )
+			{
+				__m128i a = _mm_loadu_si128( (const __m128i*)(src0 + 16*half) );
+				__m128i b = _mm_loadu_si128( (const __m128i*)(src1 + 16*half) );
+				if( channels == 1 )
+				{
+					/*	neighbours are the low and high byte of every 16 bit lane	*/
+					sum[half] = _mm_add_epi16(
+							_mm_add_epi16( _mm_and_si128( a, low_bytes ), _mm_srli_epi16( a, 8 ) ),
+							_mm_add_epi16( _mm_and_si128( b, low_bytes ), _mm_srli_epi16( b, 8 ) ) );
+				} else
+				{
+					/*	sum the rows as 16 bit, then neighbouring pixels, which are
+						the 32 bit (2 channels) or 64 bit (4 channels) lanes	*/
+					__m128i lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+					__m128i hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+					if( channels == 2 )
+					{
+						sum[half] = _mm_add_epi16(
+								_mm_castps_si128( _mm_shuffle_ps( _mm_castsi128_ps( lo ), _mm_castsi128_ps( hi ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) ),
+								_mm_castps_si128( _mm_shuffle_ps( _mm_castsi128_ps( lo ), _mm_castsi128_ps( hi ), _MM_SHUFFLE( 3, 1, 3, 1 ) ) ) );
+					} else
+					{
+						sum[half] = _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ), _mm_unpackhi_epi64( lo, hi ) );
+					}
+				}
+				sum[half] = _mm_srli_epi16( _mm_add_epi16( sum[half], round ), 2 );
+			}
+			_mm_storeu_si128( (__m128i*)(out + i*channels), _mm_packus_epi16( sum[0], sum[1] ) );
+		}
+	}
+#endif
+	for( ; i < out_width; ++i )
+	{
+		const unsigned char *src0 = row0 + 2*i*channels;
+		const unsigned char *src1 = row1 + 2*i*channels;
+		for( c = 0; c < channels; ++c )
+		{
+			out[i*channels + c] = (unsigned char)((src0[c] + src0[channels + c] +
+					src1[c] + src1[channels + c] + 2) >> 2);
+		}
+	}
+}
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -102,6 +188,12 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
+	/*	the common 2x2 case has a faster path	*/
+	if( (block_size_x == 2) && (block_size_y == 2) )
+	{
+		return mipmap_image_rows( orig, width, height, channels,
+				resampled, 0, height );
+	}
 	mip_width = width / block_size_x;
 	mip_height = height / block_size_y;
 	if( mip_width < 1 )
@@ -151,6 +243,111 @@ int
 	return 1;
 }
 
+int
+	mipmap_image_rows
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int first_row, int row_count
+	)
+{
+	int mip_width, mip_height;
+	int j;
+
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (orig == NULL) ||
+		(resampled == NULL) ||
+		(first_row < 0) || (row_count < 0) )
+	{
+		/*	nothing to do	*/
+		return 0;
+	}
+	mip_width = width > 1 ? width / 2 : 1;
+	mip_height = height > 1 ? height / 2 : 1;
+	if( row_count > mip_height - first_row )
+	{
+		row_count = mip_height - first_row;
+	}
+	for( j = first_row; j < first_row + row_count; ++j )
+	{
+		const unsigned char *row0 = orig + (2*j)*width*channels;
+		/*	a 1 pixel high source uses its row twice	*/
+		const unsigned char *row1 = height > 1 ? row0 + width*channels : row0;
+		downsample_row_2x2( row0, row1, width, channels,
+				resampled + j*mip_width*channels );
+	}
+	return 1;
+}
+
+int
+	mipmap_image_chain
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* chain
+	)
+{
+	const unsigned char *level_data[32];
+	int level_width[32], level_height[32];
+	int levels = 0;
+	int j;
+
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (orig == NULL) ||
+		(chain == NULL) )
+	{
+		/*	nothing to do	*/
+		return 0;
+	}
+	/*	lay out the levels back to back	*/
+	level_data[0] = orig;
+	level_width[0] = width;
+	level_height[0] = height;
+	while( (level_width[levels] > 1) || (level_height[levels] > 1) )
+	{
+		int w = level_width[levels] > 1 ? level_width[levels] / 2 : 1;
+		int h = level_height[levels] > 1 ? level_height[levels] / 2 : 1;
+		level_data[levels + 1] = levels == 0 ? chain :
+				level_data[levels] + level_width[levels]*level_height[levels]*channels;
+		level_width[levels + 1] = w;
+		level_height[levels + 1] = h;
+		++levels;
+	}
+	/*	one pass down the source: as soon as a row of a level completes
+		a pair, the row of the next level is made from it, so the
+		smaller levels are built from rows that are still in the cache	*/
+	for( j = 0; j < (levels > 0 ? level_height[1] : 0); ++j )
+	{
+		int level = 1, row = j;
+		while( 1 )
+		{
+			const int src_width = level_width[level - 1];
+			const unsigned char *row0 = level_data[level - 1] + (2*row)*src_width*channels;
+			const unsigned char *row1 = level_height[level - 1] > 1 ? row0 + src_width*channels : row0;
+			downsample_row_2x2( row0, row1, src_width, channels,
+					(unsigned char*)level_data[level] + row*level_width[level]*channels );
+			if( level == levels )
+			{
+				break;
+			}
+			/*	does this row finish a row of the next level?	*/
+			if( level_height[level] > 1 )
+			{
+				if( ((row & 1) == 0) || ((row >> 1) >= level_height[level + 1]) )
+				{
+					break;
+				}
+				row >>= 1;
+			}
+			++level;
+		}
+	}
+	return levels;
+}
+
 int
 	scale_image_RGB_to_NTSC_safe
 	(
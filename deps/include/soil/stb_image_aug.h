@@ -253,6 +253,11 @@ extern int      stbi_jpeg_info            (char const *filename,     int *x, int
 extern int      stbi_jpeg_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
+// decode jpegs with the SSE2 IDCT, upsampling and color conversion where the
+// CPU has SSE2 (default 1); 0 forces the C versions, e.g. to compare speeds.
+// NOT THREADSAFE
+extern void     stbi_jpeg_use_simd        (int enable);
+
 // is it a png?
 extern int      stbi_png_test_memory      (stbi_uc const *buffer, int len);
 extern stbi_uc *stbi_png_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
@@ -1,5 +1,11 @@
 #include <string>
 #include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cstdio>
+#include <sstream>
 
 #include <windows.h>
 #include <shellapi.h>
@@ -7,10 +13,16 @@
 #include <gl/glext.h>
 
 #include "SOIL.h"
+#include "image_helper.h"
+#include "image_DXT.h"
+#include "stb_image_aug.h"
 
 LRESULT CALLBACK WindowProc(HWND, UINT, WPARAM, LPARAM);
 void EnableOpenGL(HWND hwnd, HDC*, HGLRC*);
 void DisableOpenGL(HWND, HDC, HGLRC);
+void benchmark_mipmaps();
+void benchmark_DXT();
+void benchmark_jpeg( const std::string& files );
 
 int WINAPI WinMain(HINSTANCE hInstance,
                    HINSTANCE hPrevInstance,
@@ -40,6 +52,25 @@ int WINAPI WinMain(HINSTANCE hInstance,
     wcex.hIconSm = LoadIcon(NULL, IDI_APPLICATION);
 
 
+    //	"benchmark_mipmaps" on the command line times the MIPmap code instead of showing an image
+    if( std::string( lpCmdLine ) == "benchmark_mipmaps" )
+    {
+        benchmark_mipmaps();
+        return 0;
+    }
+    //	and "benchmark_DXT" the DXT compressor
+    if( std::string( lpCmdLine ) == "benchmark_DXT" )
+    {
+        benchmark_DXT();
+        return 0;
+    }
+    //	and "benchmark_jpeg [files]" the jpeg decoder
+    if( std::string( lpCmdLine ).compare( 0, 14, "benchmark_jpeg" ) == 0 )
+    {
+        benchmark_jpeg( std::string( lpCmdLine ).substr( 14 ) );
+        return 0;
+    }
+
     if (!RegisterClassEx(&wcex))
         return 0;
 
@@ -377,3 +408,335 @@ void DisableOpenGL (HWND hwnd, HDC hDC, HGLRC hRC)
     ReleaseDC(hwnd, hDC);
 }
 
+//	the per channel box filter mipmap_image used for every block size before it had a 2x2 path, as the reference
+static void scalar_mipmap_2x2( const unsigned char* orig, int width, int height, int channels, unsigned char* resampled )
+{
+	const int block_size_x = 2, block_size_y = 2;
+	int mip_width = width > 1 ? width / 2 : 1;
+	int mip_height = height > 1 ? height / 2 : 1;
+	for( int j = 0; j < mip_height; ++j )
+	for( int i = 0; i < mip_width; ++i )
+	for( int c = 0; c < channels; ++c )
+	{
+		const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
+		int u_block = block_size_x;
+		int v_block = block_size_y;
+		if( block_size_x * (i+1) > width )
+		{
+			u_block = width - i*block_size_x;
+		}
+		if( block_size_y * (j+1) > height )
+		{
+			v_block = height - j*block_size_y;
+		}
+		int block_area = u_block*v_block;
+		int sum_value = block_area >> 1;
+		for( int v = 0; v < v_block; ++v )
+		for( int u = 0; u < u_block; ++u )
+		{
+			sum_value += orig[index + v*width*channels + u*channels];
+		}
+		resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
+	}
+}
+
+struct mipmap_rows_job
+{
+	const unsigned char* orig;
+	int width, height, channels;
+	unsigned char* resampled;
+	int first_row, row_count;
+};
+
+static DWORD WINAPI mipmap_rows_thread( LPVOID param )
+{
+	mipmap_rows_job* job = (mipmap_rows_job*)param;
+	mipmap_image_rows( job->orig, job->width, job->height, job->channels,
+			job->resampled, job->first_row, job->row_count );
+	return 0;
+}
+
+//	builds the chain below orig into chain, one level after the other, with the given number of threads per level
+static void threaded_mipmap_chain( const unsigned char* orig, int width, int height, int channels, unsigned char* chain, int threads )
+{
+	while( (width > 1) || (height > 1) )
+	{
+		int mip_width = width > 1 ? width / 2 : 1;
+		int mip_height = height > 1 ? height / 2 : 1;
+		std::vector<mipmap_rows_job> jobs( threads );
+		std::vector<HANDLE> handles;
+		for( int t = 0; t < threads; ++t )
+		{
+			jobs[t].orig = orig;
+			jobs[t].width = width;
+			jobs[t].height = height;
+			jobs[t].channels = channels;
+			jobs[t].resampled = chain;
+			jobs[t].first_row = mip_height * t / threads;
+			jobs[t].row_count = mip_height * (t + 1) / threads - jobs[t].first_row;
+			if( t + 1 < threads )
+			{
+				handles.push_back( CreateThread( NULL, 0, mipmap_rows_thread, &jobs[t], 0, NULL ) );
+			} else
+			{
+				mipmap_rows_thread( &jobs[t] );
+			}
+		}
+		if( !handles.empty() )
+		{
+			WaitForMultipleObjects( (DWORD)handles.size(), &handles[0], TRUE, INFINITE );
+		}
+		for( size_t h = 0; h < handles.size(); ++h )
+		{
+			CloseHandle( handles[h] );
+		}
+		orig = chain;
+		chain += mip_width * mip_height * channels;
+		width = mip_width;
+		height = mip_height;
+	}
+}
+
+void benchmark_mipmaps()
+{
+	const int size = 2048;
+	const int repeats = 20;
+	for( int channels = 3; channels <= 4; ++channels )
+	{
+		std::vector<unsigned char> image( size * size * channels );
+		for( size_t i = 0; i < image.size(); ++i )
+		{
+			image[i] = (unsigned char)(rand() >> 4);
+		}
+		//	the levels below a square image take a third of its size
+		std::vector<unsigned char> reference( image.size() / 3 + channels );
+		std::vector<unsigned char> chain( reference.size() );
+		double seconds[5];
+		bool identical[5];
+		for( int method = 0; method < 5; ++method )
+		{
+			clock_t start = clock();
+			for( int r = 0; r < repeats; ++r )
+			{
+				const unsigned char* level = &image[0];
+				unsigned char* out = method == 0 ? &reference[0] : &chain[0];
+				int width = size, height = size;
+				switch( method )
+				{
+				case 0:
+				case 1:
+					//	level by level, scalar reference or mipmap_image
+					while( (width > 1) || (height > 1) )
+					{
+						if( method == 0 )
+						{
+							scalar_mipmap_2x2( level, width, height, channels, out );
+						} else
+						{
+							mipmap_image( level, width, height, channels, out, 2, 2 );
+						}
+						level = out;
+						width = width > 1 ? width / 2 : 1;
+						height = height > 1 ? height / 2 : 1;
+						out += width * height * channels;
+					}
+					break;
+				case 2:
+					mipmap_image_chain( level, width, height, channels, out );
+					break;
+				default:
+					threaded_mipmap_chain( level, width, height, channels, out, method == 3 ? 2 : 4 );
+					break;
+				}
+			}
+			seconds[method] = (double)(clock() - start) / CLOCKS_PER_SEC;
+			identical[method] = (method == 0) || (memcmp( &reference[0], &chain[0], reference.size() ) == 0);
+		}
+		const char* names[5] = { "scalar per channel", "mipmap_image 2x2", "mipmap_image_chain", "rows on 2 threads", "rows on 4 threads" };
+		std::cout << size << "x" << size << " with " << channels << " channels, " << repeats << " chains:" << std::endl;
+		for( int method = 0; method < 5; ++method )
+		{
+			double megabytes = (double)image.size() * repeats / (1024.0 * 1024.0);
+			std::cout << "  " << names[method] << ": " << seconds[method] << " seconds, "
+				<< (seconds[method] > 0.0 ? megabytes / seconds[method] : 0.0) << " MB/s of source"
+				<< (identical[method] ? "" : " (DIFFERENT RESULT)") << std::endl;
+		}
+	}
+}
+
+struct DXT_rows_job
+{
+	const unsigned char* uncompressed;
+	int width, height, channels;
+	unsigned char* compressed;
+	int first_block_row, block_row_count;
+	int reference;
+};
+
+static DWORD WINAPI DXT_rows_thread( LPVOID param )
+{
+	DXT_rows_job* job = (DXT_rows_job*)param;
+	if( (job->channels & 1) == 1 )
+	{
+		compress_image_to_DXT1_rows( job->uncompressed, job->width, job->height, job->channels,
+				job->compressed, job->first_block_row, job->block_row_count, job->reference );
+	} else
+	{
+		compress_image_to_DXT5_rows( job->uncompressed, job->width, job->height, job->channels,
+				job->compressed, job->first_block_row, job->block_row_count, job->reference );
+	}
+	return 0;
+}
+
+//	compresses the image with every thread taking a band of block rows
+static void threaded_DXT( const unsigned char* uncompressed, int width, int height, int channels, unsigned char* compressed, int threads, int reference )
+{
+	int block_rows = (height + 3) / 4;
+	std::vector<DXT_rows_job> jobs( threads );
+	std::vector<HANDLE> handles;
+	for( int t = 0; t < threads; ++t )
+	{
+		jobs[t].uncompressed = uncompressed;
+		jobs[t].width = width;
+		jobs[t].height = height;
+		jobs[t].channels = channels;
+		jobs[t].compressed = compressed;
+		jobs[t].first_block_row = block_rows * t / threads;
+		jobs[t].block_row_count = block_rows * (t + 1) / threads - jobs[t].first_block_row;
+		jobs[t].reference = reference;
+		if( t + 1 < threads )
+		{
+			handles.push_back( CreateThread( NULL, 0, DXT_rows_thread, &jobs[t], 0, NULL ) );
+		} else
+		{
+			DXT_rows_thread( &jobs[t] );
+		}
+	}
+	if( !handles.empty() )
+	{
+		WaitForMultipleObjects( (DWORD)handles.size(), &handles[0], TRUE, INFINITE );
+	}
+	for( size_t h = 0; h < handles.size(); ++h )
+	{
+		CloseHandle( handles[h] );
+	}
+}
+
+void benchmark_DXT()
+{
+	const int size = 4096;
+	for( int channels = 3; channels <= 4; ++channels )
+	{
+		//	smooth gradients with noise, so the blocks are not all flat
+		std::vector<unsigned char> image( size * size * channels );
+		for( int y = 0; y < size; ++y )
+		for( int x = 0; x < size; ++x )
+		for( int c = 0; c < channels; ++c )
+		{
+			image[(y*size + x)*channels + c] = (unsigned char)((x*(c + 1) + y*(3 - c) + (rand() & 15)) >> 3);
+		}
+		int block_bytes = (channels & 1) == 1 ? 8 : 16;
+		std::vector<unsigned char> reference( (size / 4) * (size / 4) * block_bytes );
+		std::vector<unsigned char> compressed( reference.size() );
+		const char* names[4] = { "reference", "SSE2", "SSE2 on 2 threads", "SSE2 on 4 threads" };
+		const int threads[4] = { 1, 1, 2, 4 };
+		std::cout << size << "x" << size << " with " << channels << " channels to DXT" << ((channels & 1) == 1 ? 1 : 5) << ":" << std::endl;
+		for( int method = 0; method < 4; ++method )
+		{
+			clock_t start = clock();
+			threaded_DXT( &image[0], size, size, channels, method == 0 ? &reference[0] : &compressed[0], threads[method], method == 0 );
+			double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+			bool identical = (method == 0) || (memcmp( &reference[0], &compressed[0], reference.size() ) == 0);
+			std::cout << "  " << names[method] << ": " << 1000.0 * seconds << " ms"
+				<< (identical ? "" : " (DIFFERENT RESULT)") << std::endl;
+		}
+	}
+}
+
+void benchmark_jpeg( const std::string& files )
+{
+	const int repeats = 20;
+	std::vector<std::string> names;
+	std::istringstream list( files );
+	std::string name;
+	while( list >> name )
+	{
+		names.push_back( name );
+	}
+	if( names.empty() )
+	{
+		names.push_back( "img_cheryl.jpg" );
+	}
+	double total_megabytes = 0.0, total_seconds[2] = { 0.0, 0.0 };
+	for( size_t f = 0; f < names.size(); ++f )
+	{
+		//	decode from memory, so the disk is not timed
+		std::vector<unsigned char> file;
+		FILE* in = fopen( names[f].c_str(), "rb" );
+		if( in )
+		{
+			unsigned char buffer[4096];
+			size_t read;
+			while( (read = fread( buffer, 1, sizeof( buffer ), in )) > 0 )
+			{
+				file.insert( file.end(), buffer, buffer + read );
+			}
+			fclose( in );
+		}
+		if( file.empty() )
+		{
+			std::cout << names[f] << ": could not be read" << std::endl;
+			continue;
+		}
+		std::vector<unsigned char> reference;
+		double seconds[2];
+		bool identical = true;
+		int width = 0, height = 0, channels = 0;
+		for( int simd = 0; simd < 2; ++simd )
+		{
+			stbi_jpeg_use_simd( simd );
+			clock_t start = clock();
+			for( int r = 0; r < repeats; ++r )
+			{
+				unsigned char* pixels = stbi_load_from_memory( &file[0], (int)file.size(), &width, &height, &channels, 4 );
+				if( !pixels )
+				{
+					break;
+				}
+				if( r == 0 )
+				{
+					if( simd == 0 )
+					{
+						reference.assign( pixels, pixels + width * height * 4 );
+					} else
+					{
+						identical = memcmp( &reference[0], pixels, reference.size() ) == 0;
+					}
+				}
+				stbi_image_free( pixels );
+			}
+			seconds[simd] = (double)(clock() - start) / CLOCKS_PER_SEC;
+		}
+		stbi_jpeg_use_simd( 1 );
+		if( reference.empty() )
+		{
+			std::cout << names[f] << ": " << stbi_failure_reason() << std::endl;
+			continue;
+		}
+		//	MB of RGBA pixels out
+		double megabytes = (double)reference.size() * repeats / (1024.0 * 1024.0);
+		total_megabytes += megabytes;
+		total_seconds[0] += seconds[0];
+		total_seconds[1] += seconds[1];
+		std::cout << names[f] << " (" << width << "x" << height << "): C "
+			<< (seconds[0] > 0.0 ? megabytes / seconds[0] : 0.0) << " MB/s, SSE2 "
+			<< (seconds[1] > 0.0 ? megabytes / seconds[1] : 0.0) << " MB/s"
+			<< (identical ? "" : " (DIFFERENT RESULT)") << std::endl;
+	}
+	if( total_seconds[0] > 0.0 && total_seconds[1] > 0.0 )
+	{
+		std::cout << "all: C " << total_megabytes / total_seconds[0] << " MB/s, SSE2 "
+			<< total_megabytes / total_seconds[1] << " MB/s, "
+			<< total_seconds[0] / total_seconds[1] << "x" << std::endl;
+	}
+}